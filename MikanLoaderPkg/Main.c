@@ -1,4 +1,5 @@
 #include <Guid/FileInfo.h>
+#include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/PrintLib.h>
@@ -10,12 +11,26 @@
 #include <Protocol/SimpleFileSystem.h>
 #include <Uefi.h>
 
+#include "boot_info.hpp"
 #include "elf.hpp"
 #include "frame_buffer_config.hpp"
 #include "memory_map.hpp"
+#include "mklz.h"
 
 extern EFI_GUID gEfiGraphicsOutputProtocolGuid;
 
+// カーネルに渡す起動時間の記録
+struct BootInfo boot_info = {kBootInfoMagic, kBootInfoVersion};
+
+void StampBootPhase(const CHAR8 *name) {
+  if (boot_info.num_stamps >= kBootStampMax) {
+    return;
+  }
+  struct BootStamp *stamp = &boot_info.stamps[boot_info.num_stamps++];
+  AsciiStrnCpyS(stamp->name, kBootStampNameLen, name, kBootStampNameLen - 1);
+  stamp->tsc = AsmReadTsc();
+}
+
 EFI_STATUS GetMemoryMap(struct MemoryMap *map) {
   if (map->buffer == NULL) {
     return EFI_BUFFER_TOO_SMALL;
@@ -147,48 +162,117 @@ const CHAR16 *GetPixelFormatUnicode(EFI_GRAPHICS_PIXEL_FORMAT fmt) {
   }
 }
 
-void CalcLoadAddressRange(Elf64_Ehdr *ehdr, UINT64 *first, UINT64 *last) {
-  Elf64_Phdr *phdr = (Elf64_Phdr *)((UINT64)ehdr + ehdr->e_phoff);
+// ローダが確保したメモリの量と，その最大値
+UINTN loader_allocated_bytes;
+
+void TrackAllocation(INTN bytes) {
+  loader_allocated_bytes += bytes;
+  if (boot_info.loader_peak_bytes < loader_allocated_bytes) {
+    boot_info.loader_peak_bytes = loader_allocated_bytes;
+  }
+}
+
+void CalcLoadAddressRange(Elf64_Phdr *phdr, Elf64_Half phnum, UINT64 *first,
+                          UINT64 *last) {
   *first = MAX_UINT64;
   *last = 0;
-  for (Elf64_Half i = 0; i < ehdr->e_phnum; ++i) {
+  for (Elf64_Half i = 0; i < phnum; ++i) {
     if (phdr[i].p_type != PT_LOAD) continue;
     *first = MIN(*first, phdr[i].p_vaddr);
     *last = MAX(*last, phdr[i].p_vaddr + phdr[i].p_memsz);
   }
 }
 
-void CopyLoadSegments(Elf64_Ehdr *ehdr) {
-  Elf64_Phdr *phdr = (Elf64_Phdr *)((UINT64)ehdr + ehdr->e_phoff);
-  for (Elf64_Half i = 0; i < ehdr->e_phnum; ++i) {
+// ファイルから各セグメントを置き場所へ直接読み込む
+EFI_STATUS LoadSegments(struct MklzReader *reader, Elf64_Phdr *phdr,
+                        Elf64_Half phnum) {
+  EFI_STATUS status;
+  for (Elf64_Half i = 0; i < phnum; ++i) {
     if (phdr[i].p_type != PT_LOAD) continue;
 
-    UINT64 segm_in_file = (UINT64)ehdr + phdr[i].p_offset;
-    CopyMem((VOID *)phdr[i].p_vaddr, (VOID *)segm_in_file, phdr[i].p_filesz);
+    status = MklzRead(reader, phdr[i].p_offset, phdr[i].p_filesz,
+                      (VOID *)phdr[i].p_vaddr);
+    if (EFI_ERROR(status)) {
+      return status;
+    }
 
     UINTN remain_bytes = phdr[i].p_memsz - phdr[i].p_filesz;
     SetMem((VOID *)(phdr[i].p_vaddr + phdr[i].p_filesz), remain_bytes, 0);
   }
+  return EFI_SUCCESS;
 }
 
-EFI_STATUS ReadFile(EFI_FILE_PROTOCOL *file, VOID **buffer) {
+/*
+  ELF ヘッダとプログラムヘッダだけを先に読み，ロード先のページを確保してから
+  セグメントをそこへ直接読み込む．ファイル全体をプールに読む必要はない．
+  MKLZ で圧縮されたファイルなら読みながら展開する．
+*/
+EFI_STATUS LoadKernel(struct MklzReader *reader, UINT64 *first_addr,
+                      UINT64 *last_addr, UINT64 *entry_addr) {
   EFI_STATUS status;
-  UINTN file_info_size = sizeof(EFI_FILE_INFO) + sizeof(CHAR16) * 12;
-  UINT8 file_info_buffer[file_info_size];
-  status =
-      file->GetInfo(file, &gEfiFileInfoGuid, &file_info_size, file_info_buffer);
+  Elf64_Ehdr ehdr;
+  status = MklzRead(reader, 0, sizeof(ehdr), &ehdr);
   if (EFI_ERROR(status)) {
     return status;
   }
 
-  EFI_FILE_INFO *file_info = (EFI_FILE_INFO *)file_info_buffer;
-  UINTN file_size = file_info->FileSize;
-  status = gBS->AllocatePool(EfiLoaderData, file_size, buffer);
+  UINTN phdrs_bytes = sizeof(Elf64_Phdr) * ehdr.e_phnum;
+  Elf64_Phdr *phdr;
+  status = gBS->AllocatePool(EfiLoaderData, phdrs_bytes, (VOID **)&phdr);
   if (EFI_ERROR(status)) {
     return status;
   }
+  TrackAllocation(phdrs_bytes);
+
+  status = MklzRead(reader, ehdr.e_phoff, phdrs_bytes, phdr);
+  if (EFI_ERROR(status)) {
+    gBS->FreePool(phdr);
+    return status;
+  }
+  StampBootPhase("loader_kernel_phdr");
+
+  CalcLoadAddressRange(phdr, ehdr.e_phnum, first_addr, last_addr);
+  UINTN num_pages = (*last_addr - *first_addr + 0xfff) / 0x1000;
+  status = gBS->AllocatePages(AllocateAddress, EfiLoaderData, num_pages,
+                              first_addr);
+  if (!EFI_ERROR(status)) {
+    TrackAllocation(num_pages * 0x1000);
+    status = LoadSegments(reader, phdr, ehdr.e_phnum);
+  }
+
+  gBS->FreePool(phdr);
+  TrackAllocation(-(INTN)phdrs_bytes);
+  *entry_addr = ehdr.e_entry;
+  return status;
+}
+
+// MklzReader を開き，そのバッファを確保した量に数える
+EFI_STATUS OpenReader(struct MklzReader *reader, EFI_FILE_PROTOCOL *file) {
+  EFI_STATUS status = MklzOpen(reader, file);
+  TrackAllocation(MklzBufferBytes(reader));
+  return status;
+}
 
-  return file->Read(file, &file_size, *buffer);
+void CloseReader(struct MklzReader *reader) {
+  TrackAllocation(-(INTN)MklzBufferBytes(reader));
+  MklzClose(reader);
+}
+
+// ファイル全体を確保したバッファに読む．MKLZ なら展開した中身を読む
+EFI_STATUS ReadFile(EFI_FILE_PROTOCOL *file, VOID **buffer) {
+  struct MklzReader reader;
+  EFI_STATUS status = OpenReader(&reader, file);
+  if (!EFI_ERROR(status)) {
+    status = gBS->AllocatePool(EfiLoaderData, reader.size, buffer);
+  }
+  if (!EFI_ERROR(status)) {
+    TrackAllocation(reader.size);
+    status = MklzRead(&reader, 0, reader.size, *buffer);
+  }
+  boot_info.volume_read_bytes = reader.read_bytes;
+  boot_info.volume_loaded_bytes = EFI_ERROR(status) ? 0 : reader.size;
+  CloseReader(&reader);
+  return status;
 }
 
 EFI_STATUS OpenBlockIoProtocolForLoadedImage(EFI_HANDLE image_handle,
@@ -210,16 +294,94 @@ EFI_STATUS OpenBlockIoProtocolForLoadedImage(EFI_HANDLE image_handle,
   return status;
 }
 
-EFI_STATUS ReadBlocks(EFI_BLOCK_IO_PROTOCOL *block_io, UINT32 media_id,
-                      UINTN read_bytes, VOID **buffer) {
-  EFI_STATUS status = gBS->AllocatePool(EfiLoaderData, read_bytes, buffer);
+// buffer の offset から bytes バイトを，ボリュームの同じ位置から読み込む
+EFI_STATUS ReadVolumeRange(EFI_BLOCK_IO_PROTOCOL *block_io, UINT8 *buffer,
+                           UINTN offset, UINTN bytes) {
+  UINT32 block_size = block_io->Media->BlockSize;
+  UINTN end = ALIGN_VALUE(offset + bytes, block_size);
+  offset = offset / block_size * block_size;
+  boot_info.volume_read_bytes += end - offset;
+  return block_io->ReadBlocks(block_io, block_io->Media->MediaId,
+                              offset / block_size, end - offset,
+                              buffer + offset);
+}
+
+/*
+  FAT32 のボリュームなら，予約領域と FAT だけを先に読み，データ領域は
+  FAT で使用中のクラスタが連続する範囲ごとに読む．空きクラスタは 0 で埋める．
+  FAT32 として読めないときはボリューム全体を読む．
+*/
+EFI_STATUS ReadVolumeBlocks(EFI_BLOCK_IO_PROTOCOL *block_io,
+                            UINTN volume_bytes, UINT8 *buffer) {
+  EFI_STATUS status;
+  UINT32 block_size = block_io->Media->BlockSize;
+
+  status = ReadVolumeRange(block_io, buffer, 0, block_size);
   if (EFI_ERROR(status)) {
     return status;
   }
 
-  status = block_io->ReadBlocks(block_io, media_id, 0, read_bytes, *buffer);
+  // BPB の各フィールドはアラインされていないので，バイト単位で読む
+  UINT16 bytes_per_sector = ReadUnaligned16((UINT16 *)(buffer + 11));
+  UINT8 sectors_per_cluster = buffer[13];
+  UINT16 reserved_sectors = ReadUnaligned16((UINT16 *)(buffer + 14));
+  UINT8 num_fats = buffer[16];
+  UINT16 fat_size_16 = ReadUnaligned16((UINT16 *)(buffer + 22));
+  UINT32 fat_size = ReadUnaligned32((UINT32 *)(buffer + 36));
+
+  UINTN meta_bytes =
+      ((UINTN)reserved_sectors + (UINTN)num_fats * fat_size) * bytes_per_sector;
+  UINTN cluster_bytes = (UINTN)sectors_per_cluster * bytes_per_sector;
+  // FAT12/16 ではオフセット 36 に FAT の大きさはないので，
+  // fat::Initialize と同じく種類の文字列も確かめる
+  BOOLEAN is_fat32 = buffer[510] == 0x55 && buffer[511] == 0xaa &&
+                     fat_size_16 == 0 &&
+                     CompareMem(buffer + 82, "FAT32", 5) == 0 &&
+                     bytes_per_sector != 0 &&
+                     bytes_per_sector % block_size == 0 &&
+                     sectors_per_cluster != 0 && fat_size != 0 &&
+                     meta_bytes < volume_bytes;
+  if (!is_fat32) {
+    boot_info.volume_read_bytes = 0;
+    return ReadVolumeRange(block_io, buffer, 0, volume_bytes);
+  }
 
-  return status;
+  status = ReadVolumeRange(block_io, buffer, 0, meta_bytes);
+  if (EFI_ERROR(status)) {
+    return status;
+  }
+
+  UINT32 *fat = (UINT32 *)(buffer + (UINTN)reserved_sectors * bytes_per_sector);
+  UINTN num_clusters = (volume_bytes - meta_bytes) / cluster_bytes;
+  UINTN fat_entries = (UINTN)fat_size * bytes_per_sector / sizeof(UINT32);
+  if (num_clusters > fat_entries - 2) {
+    num_clusters = fat_entries - 2;
+  }
+
+  // データ領域はクラスタ番号 2 から始まる
+  UINTN filled = meta_bytes;
+  UINTN cluster = 2;
+  while (cluster < num_clusters + 2) {
+    if ((fat[cluster] & 0x0ffffffflu) == 0) {
+      ++cluster;
+      continue;
+    }
+    UINTN run_begin = cluster;
+    while (cluster < num_clusters + 2 && (fat[cluster] & 0x0ffffffflu) != 0) {
+      ++cluster;
+    }
+
+    UINTN offset = meta_bytes + (run_begin - 2) * cluster_bytes;
+    UINTN bytes = (cluster - run_begin) * cluster_bytes;
+    SetMem(buffer + filled, offset - filled, 0);
+    status = ReadVolumeRange(block_io, buffer, offset, bytes);
+    if (EFI_ERROR(status)) {
+      return status;
+    }
+    filled = offset + bytes;
+  }
+  SetMem(buffer + filled, volume_bytes - filled, 0);
+  return EFI_SUCCESS;
 }
 
 void Halt(void) {
@@ -228,6 +390,11 @@ void Halt(void) {
 
 EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle,
                            EFI_SYSTEM_TABLE *system_table) {
+  // TSC は CPU のリセットから数えるので，0 をファームウェアの開始とみなす
+  StampBootPhase("firmware");
+  boot_info.stamps[0].tsc = 0;
+  StampBootPhase("loader_entry");
+
   Print(L"Hellllllllllllllllll!\n");
 
   CHAR8 memmap_buf[4096 * 4];
@@ -245,6 +412,7 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle,
 
   SaveMemoryMap(&memmap, memmap_file);
   memmap_file->Close(memmap_file);
+  StampBootPhase("loader_memmap");
 
   EFI_GRAPHICS_OUTPUT_PROTOCOL *gop;
   OpenGOP(image_handle, &gop);
@@ -264,52 +432,24 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle,
   root_dir->Open(root_dir, &kernel_file, L"\\kernel.elf", EFI_FILE_MODE_READ,
                  0);
 
-  UINTN file_info_size = sizeof(EFI_FILE_INFO) + sizeof(CHAR16) * 12;
-  UINT8 file_info_buffer[file_info_size];
-
-  kernel_file->GetInfo(kernel_file, &gEfiFileInfoGuid, &file_info_size,
-                       file_info_buffer);
-
-  EFI_FILE_INFO *file_info = (EFI_FILE_INFO *)file_info_buffer;
-  UINTN kernel_file_size = file_info->FileSize;
-
-  VOID *kernel_buffer;
-
   EFI_STATUS status;
-  status = gBS->AllocatePool(EfiLoaderData, kernel_file_size, &kernel_buffer);
-  if (EFI_ERROR(status)) {
-    Print(L"error: %r", status);
-    Halt();
-  }
-
-  status = kernel_file->Read(kernel_file, &kernel_file_size, kernel_buffer);
-  if (EFI_ERROR(status)) {
-    Print(L"error: %r", status);
-    Halt();
+  struct MklzReader kernel_reader;
+  UINT64 kernel_first_addr, kernel_last_addr, entry_addr;
+  status = OpenReader(&kernel_reader, kernel_file);
+  if (!EFI_ERROR(status)) {
+    status = LoadKernel(&kernel_reader, &kernel_first_addr, &kernel_last_addr,
+                        &entry_addr);
   }
-
-  Elf64_Ehdr *kernel_ehdr = (Elf64_Ehdr *)kernel_buffer;
-  UINT64 kernel_first_addr, kernel_last_addr;
-  CalcLoadAddressRange(kernel_ehdr, &kernel_first_addr, &kernel_last_addr);
-
-  UINTN num_pages = (kernel_last_addr - kernel_first_addr + 0xfff) / 0x1000;
-  status = gBS->AllocatePages(AllocateAddress, EfiLoaderData, num_pages,
-                              &kernel_first_addr);
   if (EFI_ERROR(status)) {
-    Print(L"failed to allocate pages: %r\n", status);
+    Print(L"failed to load kernel: %r\n", status);
     Halt();
   }
+  StampBootPhase("loader_kernel_load");
 
-  CopyLoadSegments(kernel_ehdr);
-
-  Print(L"Kernel: 0x%01x - 0x%01x (%lu bytes)\n", kernel_first_addr,
-        kernel_last_addr, kernel_file_size);
-
-  status = gBS->FreePool(kernel_buffer);
-  if (EFI_ERROR(status)) {
-    Print(L"faild to free pool: %r", status);
-    Halt();
-  }
+  Print(L"Kernel: 0x%01x - 0x%01x (read %lu bytes%s)\n", kernel_first_addr,
+        kernel_last_addr, kernel_reader.read_bytes,
+        kernel_reader.compressed ? L", compressed" : L"");
+  CloseReader(&kernel_reader);
 
   VOID *volume_image;
 
@@ -341,12 +481,25 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle,
           volume_bytes, media->MediaPresent, media->BlockSize,
           media->LastBlock);
 
-    status = ReadBlocks(block_io, media->MediaId, volume_bytes, &volume_image);
+    status = gBS->AllocatePool(EfiLoaderData, volume_bytes, &volume_image);
+    if (EFI_ERROR(status)) {
+      Print(L"failed to allocate pool: %r\n", status);
+      Halt();
+    }
+    TrackAllocation(volume_bytes);
+
+    status = ReadVolumeBlocks(block_io, volume_bytes, (UINT8 *)volume_image);
     if (EFI_ERROR(status)) {
       Print(L"failed to read blocks: %r\n", status);
       Halt();
     }
+    // 16MiB で打ち切ったかもしれないので，カーネルには読んだ範囲を伝える
+    boot_info.volume_loaded_bytes = volume_bytes;
   }
+  StampBootPhase("loader_volume_read");
+
+  Print(L"Volume: read %lu bytes, loader peak memory %lu bytes\n",
+        boot_info.volume_read_bytes, boot_info.loader_peak_bytes);
 
   status = gBS->ExitBootServices(image_handle, memmap.map_key);
   if (EFI_ERROR(status)) {
@@ -363,6 +516,8 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle,
     }
   }
 
+  StampBootPhase("loader_exit_bs");
+
   struct FrameBufferConfig config = {(UINT8 *)gop->Mode->FrameBufferBase,
                                      gop->Mode->Info->PixelsPerScanLine,
                                      gop->Mode->Info->HorizontalResolution,
@@ -392,11 +547,11 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle,
   }
 
   typedef void EntryPointType(const struct FrameBufferConfig *,
-                              const struct MemoryMap *, const VOID *, VOID *);
+                              const struct MemoryMap *, const VOID *, VOID *,
+                              const struct BootInfo *);
 
-  UINT64 entry_addr = *(UINT64 *)(kernel_first_addr + 24);
   EntryPointType *entry_point = (EntryPointType *)entry_addr;
-  entry_point(&config, &memmap, acpi_table, volume_image);
+  entry_point(&config, &memmap, acpi_table, volume_image, &boot_info);
 
   Print(L"All done\n");
 
@@ -0,0 +1,275 @@
+#include "mklz.h"
+
+#include <Guid/FileInfo.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+
+#define MKLZ_HEADER_SIZE 16
+#define MKLZ_STORED_FLAG 0x80000000u
+#define LZ4_MIN_MATCH 4
+
+// LZ4 の長さの続き（255 が続く間，足し続ける）を読む
+static BOOLEAN ReadLength(const UINT8 **ip, const UINT8 *iend, UINTN *len) {
+  UINT8 b;
+  do {
+    if (*ip >= iend) {
+      return FALSE;
+    }
+    b = *(*ip)++;
+    *len += b;
+  } while (b == 255);
+  return TRUE;
+}
+
+INTN Lz4DecodeBlock(const UINT8 *src, UINTN src_len, UINT8 *dst,
+                    UINTN dst_len) {
+  const UINT8 *ip = src;
+  const UINT8 *iend = src + src_len;
+  UINT8 *op = dst;
+  UINT8 *oend = dst + dst_len;
+
+  while (ip < iend) {
+    UINT8 token = *ip++;
+
+    UINTN len = token >> 4;
+    if (len == 15 && !ReadLength(&ip, iend, &len)) {
+      return -1;
+    }
+    if (len > (UINTN)(iend - ip) || len > (UINTN)(oend - op)) {
+      return -1;
+    }
+    CopyMem(op, ip, len);
+    op += len;
+    ip += len;
+    // 最後のシーケンスはリテラルだけで終わる
+    if (ip == iend) {
+      break;
+    }
+
+    if (iend - ip < 2) {
+      return -1;
+    }
+    UINTN offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (UINTN)(op - dst)) {
+      return -1;
+    }
+
+    len = token & 0xf;
+    if (len == 15 && !ReadLength(&ip, iend, &len)) {
+      return -1;
+    }
+    len += LZ4_MIN_MATCH;
+    if (len > (UINTN)(oend - op)) {
+      return -1;
+    }
+
+    const UINT8 *match = op - offset;
+    if (offset >= len) {
+      CopyMem(op, match, len);
+    } else {
+      // 一致がこれから書く部分に重なるので，前から 1 バイトずつ写す
+      for (UINTN i = 0; i < len; ++i) {
+        op[i] = match[i];
+      }
+    }
+    op += len;
+  }
+  return op - dst;
+}
+
+static EFI_STATUS ReadExact(struct MklzReader *reader, UINTN bytes,
+                            VOID *dst) {
+  UINTN read_bytes = bytes;
+  EFI_STATUS status = reader->file->Read(reader->file, &read_bytes, dst);
+  if (EFI_ERROR(status)) {
+    return status;
+  }
+  reader->read_bytes += read_bytes;
+  reader->file_pos += read_bytes;
+  return read_bytes == bytes ? EFI_SUCCESS : EFI_END_OF_FILE;
+}
+
+EFI_STATUS MklzOpen(struct MklzReader *reader, EFI_FILE_PROTOCOL *file) {
+  EFI_STATUS status;
+  ZeroMem(reader, sizeof(*reader));
+  reader->file = file;
+
+  UINT8 header[MKLZ_HEADER_SIZE];
+  UINTN header_bytes = sizeof(header);
+  status = file->Read(file, &header_bytes, header);
+  if (EFI_ERROR(status)) {
+    return status;
+  }
+
+  if (header_bytes == sizeof(header) && CompareMem(header, "MKLZ", 4) == 0) {
+    reader->compressed = TRUE;
+    reader->block_size = ReadUnaligned32((UINT32 *)(header + 4));
+    reader->size = ReadUnaligned64((UINT64 *)(header + 8));
+    reader->file_pos = MKLZ_HEADER_SIZE;
+    reader->read_bytes = MKLZ_HEADER_SIZE;
+    if (reader->block_size == 0 || reader->block_size >= MKLZ_STORED_FLAG) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    status = gBS->AllocatePool(EfiLoaderData, reader->block_size,
+                               (VOID **)&reader->packed);
+    if (EFI_ERROR(status)) {
+      return status;
+    }
+    return gBS->AllocatePool(EfiLoaderData, reader->block_size,
+                             (VOID **)&reader->block);
+  }
+
+  // 圧縮されていなければ，ファイルの大きさがそのまま展開後の大きさ
+  UINTN file_info_size = sizeof(EFI_FILE_INFO) + sizeof(CHAR16) * 12;
+  UINT8 file_info_buffer[file_info_size];
+  status =
+      file->GetInfo(file, &gEfiFileInfoGuid, &file_info_size, file_info_buffer);
+  if (EFI_ERROR(status)) {
+    return status;
+  }
+  reader->size = ((EFI_FILE_INFO *)file_info_buffer)->FileSize;
+  return EFI_SUCCESS;
+}
+
+/* 次のブロックを読む．dst が NULL でなければそこへ直接展開し，NULL なら
+   reader->block に展開する．skip_until より前で終わるブロックは読み飛ばす */
+static EFI_STATUS NextBlock(struct MklzReader *reader, UINT8 *dst,
+                            UINT64 skip_until) {
+  UINT32 header;
+  EFI_STATUS status = ReadExact(reader, sizeof(header), &header);
+  if (EFI_ERROR(status)) {
+    return status;
+  }
+  UINT32 packed_len = header & ~MKLZ_STORED_FLAG;
+  UINT64 block_len = reader->size - reader->next_begin;
+  if (block_len > reader->block_size) {
+    block_len = reader->block_size;
+  }
+  if (packed_len > reader->block_size) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  UINT64 begin = reader->next_begin;
+  reader->next_begin += block_len;
+
+  // 読みたい位置より前のブロックは，展開せずに読み飛ばす
+  if (begin + block_len <= skip_until) {
+    reader->file_pos += packed_len;
+    return reader->file->SetPosition(reader->file, reader->file_pos);
+  }
+
+  UINT8 *out = dst ? dst : reader->block;
+  if (header & MKLZ_STORED_FLAG) {
+    if (packed_len != block_len) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+    status = ReadExact(reader, packed_len, out);
+  } else {
+    status = ReadExact(reader, packed_len, reader->packed);
+    if (!EFI_ERROR(status) &&
+        Lz4DecodeBlock(reader->packed, packed_len, out, block_len) !=
+            (INTN)block_len) {
+      status = EFI_VOLUME_CORRUPTED;
+    }
+  }
+  if (EFI_ERROR(status)) {
+    return status;
+  }
+
+  if (dst) {
+    reader->block_len = 0;
+  } else {
+    reader->block_begin = begin;
+    reader->block_len = block_len;
+  }
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS MklzRead(struct MklzReader *reader, UINT64 offset, UINTN bytes,
+                    VOID *dst) {
+  EFI_STATUS status;
+  if (offset + bytes > reader->size) {
+    return EFI_END_OF_FILE;
+  }
+
+  if (!reader->compressed) {
+    status = reader->file->SetPosition(reader->file, offset);
+    if (EFI_ERROR(status)) {
+      return status;
+    }
+    UINTN read_bytes = bytes;
+    status = reader->file->Read(reader->file, &read_bytes, dst);
+    reader->read_bytes += read_bytes;
+    if (EFI_ERROR(status)) {
+      return status;
+    }
+    return read_bytes == bytes ? EFI_SUCCESS : EFI_END_OF_FILE;
+  }
+
+  UINT8 *out = (UINT8 *)dst;
+  while (bytes > 0) {
+    // 手元のブロックに入っていればそこから写す
+    if (reader->block_len > 0 && reader->block_begin <= offset &&
+        offset < reader->block_begin + reader->block_len) {
+      UINTN n = reader->block_begin + reader->block_len - offset;
+      if (n > bytes) {
+        n = bytes;
+      }
+      CopyMem(out, reader->block + (offset - reader->block_begin), n);
+      out += n;
+      offset += n;
+      bytes -= n;
+      continue;
+    }
+
+    if (offset < reader->next_begin) {
+      reader->file_pos = MKLZ_HEADER_SIZE;
+      reader->next_begin = 0;
+      reader->block_len = 0;
+      status = reader->file->SetPosition(reader->file, reader->file_pos);
+      if (EFI_ERROR(status)) {
+        return status;
+      }
+    }
+
+    // ブロックの境目から 1 ブロック以上読むなら，写さずに直接展開する
+    UINT64 block_len = reader->size - reader->next_begin;
+    if (block_len > reader->block_size) {
+      block_len = reader->block_size;
+    }
+    if (offset == reader->next_begin && bytes >= block_len) {
+      status = NextBlock(reader, out, 0);
+      if (EFI_ERROR(status)) {
+        return status;
+      }
+      out += block_len;
+      offset += block_len;
+      bytes -= block_len;
+      continue;
+    }
+
+    status = NextBlock(reader, NULL, offset);
+    if (EFI_ERROR(status)) {
+      return status;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+UINTN MklzBufferBytes(const struct MklzReader *reader) {
+  return reader->compressed ? 2 * (UINTN)reader->block_size : 0;
+}
+
+void MklzClose(struct MklzReader *reader) {
+  if (reader->packed) {
+    gBS->FreePool(reader->packed);
+  }
+  if (reader->block) {
+    gBS->FreePool(reader->block);
+  }
+  reader->packed = NULL;
+  reader->block = NULL;
+}
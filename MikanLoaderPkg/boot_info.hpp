@@ -0,0 +1 @@
+../kernel/boot_info.hpp
\ No newline at end of file
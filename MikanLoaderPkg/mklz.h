@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Protocol/SimpleFileSystem.h>
+#include <Uefi.h>
+
+/*
+  ファイルを先頭から順に読む読み手．中身が MKLZ 形式（tools/mklz.py）なら
+  ブロック単位で読みながら展開し，そうでなければそのまま読む．
+  MKLZ の中身は独立した LZ4 ブロックの列なので，
+  ブロック 1 つ分のバッファしか使わない．
+*/
+struct MklzReader {
+  EFI_FILE_PROTOCOL *file;
+  BOOLEAN compressed;
+  UINT64 size;         // 展開後の大きさ
+  UINT32 block_size;
+  UINT8 *packed;       // 圧縮されたブロック 1 つ分
+  UINT8 *block;        // 展開したブロック
+  UINT64 block_begin;  // block の先頭の，展開後のデータでの位置
+  UINT32 block_len;    // block に入っている量．0 なら空
+  UINT64 next_begin;   // 次のブロックの，展開後のデータでの位置
+  UINT64 file_pos;     // 次のブロックのヘッダのファイル上の位置
+  UINT64 read_bytes;   // ファイルから実際に読んだ量
+};
+
+EFI_STATUS MklzOpen(struct MklzReader *reader, EFI_FILE_PROTOCOL *file);
+
+/* 展開後のデータの offset から bytes バイトを dst に読む．
+   前に戻って読むとファイルの先頭から展開し直すので，
+   なるべく前から順に読むこと */
+EFI_STATUS MklzRead(struct MklzReader *reader, UINT64 offset, UINTN bytes,
+                    VOID *dst);
+
+// MklzOpen が確保したバッファの大きさ
+UINTN MklzBufferBytes(const struct MklzReader *reader);
+void MklzClose(struct MklzReader *reader);
+
+/* LZ4 ブロックを 1 つ展開し，展開した大きさを返す．
+   壊れたデータや dst_len を超える展開には -1 を返す */
+INTN Lz4DecodeBlock(const UINT8 *src, UINTN src_len, UINT8 *dst,
+                    UINTN dst_len);
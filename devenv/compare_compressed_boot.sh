@@ -0,0 +1,18 @@
+#!/bin/sh -e
+
+# 帯域を絞った仮想ディスクで，無圧縮と MKLZ 圧縮のイメージの起動時間を比べる．
+# どちらもボリュームを fat_disk として置くので，違いは圧縮の有無だけになる．
+#   THROTTLE_BPS  既定は 4 MiB/s
+#   BENCH         起動後に流すベンチマーク（既定は find_file だけ）
+
+DEVENV_DIR=$(dirname "$0")
+export THROTTLE_BPS=${THROTTLE_BPS:-4194304}
+export BENCH=${BENCH:-find_file}
+
+for COMPRESS in 0 1
+do
+  echo "== COMPRESS=$COMPRESS THROTTLE_BPS=$THROTTLE_BPS"
+  COMPRESS=$COMPRESS VOLUME_FILE=1 $DEVENV_DIR/run_bench.sh "$@" |
+    grep -e '^RUN ' -e 'qemu_wall_time' -e 'loader_' -e 'volume_read' \
+         -e 'first_frame' -e 'boot_time'
+done
@@ -0,0 +1,88 @@
+#!/bin/sh -ex
+
+# sudo と mount を使わずに（mtools で）ベンチマーク用のイメージを作る．
+# 環境変数:
+#   VOLUME_FILE  1 ならアプリと BOOT.CFG を別の FAT ボリュームに入れ，
+#                ESP に fat_disk として置く（ローダはそれを丸ごと読む）
+#   COMPRESS     1 なら kernel.elf と fat_disk を MKLZ 形式に圧縮して置く．
+#                VOLUME_FILE=1 を含む
+
+if [ $# -lt 3 ]
+then
+    echo "Usage: $0 <image name> <.efi file> <kernel.elf> [bench name]"
+    exit 1
+fi
+
+DISK_IMG=$1
+EFI_FILE=$2
+KERNEL_ELF=$3
+BENCH=${4:-all}
+
+for FILE in $EFI_FILE $KERNEL_ELF
+do
+  if [ ! -f $FILE ]
+  then
+      echo "No such file: $FILE"
+      exit 1
+  fi
+done
+
+rm -f $DISK_IMG
+qemu-img create -f raw $DISK_IMG 200M
+mkfs.fat -n 'MIKAN OS' -s 2 -f 2 -R 32 -F 32 $DISK_IMG
+
+mmd -i $DISK_IMG ::/EFI ::/EFI/BOOT
+mcopy -i $DISK_IMG $EFI_FILE ::/EFI/BOOT/BOOTX64.EFI
+
+DEVENV_DIR=$(dirname "$0")
+MKLZ="$DEVENV_DIR/../tools/mklz.py"
+WORK_DIR=$(mktemp -d)
+
+if [ "$COMPRESS" = "1" ]
+then
+  VOLUME_FILE=1
+  $MKLZ -o $WORK_DIR/kernel.elf $KERNEL_ELF
+  mcopy -i $DISK_IMG $WORK_DIR/kernel.elf ::/
+else
+  mcopy -i $DISK_IMG $KERNEL_ELF ::/
+fi
+
+# カーネルがファイルを読むボリューム
+if [ "$VOLUME_FILE" = "1" ]
+then
+  VOLUME_IMG=$WORK_DIR/fat_disk
+  qemu-img create -f raw $VOLUME_IMG 40M
+  mkfs.fat -n 'MIKAN OS' -s 1 -f 2 -R 32 -F 32 $VOLUME_IMG
+else
+  VOLUME_IMG=$DISK_IMG
+fi
+
+MIKANOS_DIR=$(pwd)
+
+for APP in $(ls "$MIKANOS_DIR/apps")
+do
+  if [ -f $MIKANOS_DIR/apps/$APP/$APP ]
+  then
+    mcopy -i $VOLUME_IMG "$MIKANOS_DIR/apps/$APP/$APP" ::/
+  fi
+done
+
+# 起動したらベンチマークを流し，終わったら isa-debug-exit で QEMU を終える
+BOOT_CFG=$WORK_DIR/BOOT.CFG
+cat > $BOOT_CFG <<CFG
+bench=$BENCH
+exit_after_bench=1
+CFG
+mcopy -i $VOLUME_IMG $BOOT_CFG ::/BOOT.CFG
+
+if [ "$VOLUME_FILE" = "1" ]
+then
+  if [ "$COMPRESS" = "1" ]
+  then
+    $MKLZ -o $WORK_DIR/fat_disk.lz $VOLUME_IMG
+    mv $WORK_DIR/fat_disk.lz $VOLUME_IMG
+  fi
+  mcopy -i $DISK_IMG $VOLUME_IMG ::/fat_disk
+fi
+
+rm -rf $WORK_DIR
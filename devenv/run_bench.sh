@@ -0,0 +1,89 @@
+#!/bin/sh -e
+
+# QEMU を画面なしで起動してカーネルのベンチマークを流し，結果を保存する．
+# 環境変数:
+#   BENCH        実行するベンチマーク（既定は all）
+#   RESULTS_DIR  結果を置くディレクトリ（既定は ./bench_results）
+#   TIMEOUT      QEMU を打ち切るまでの秒数（既定は 300）
+#   THROTTLE_BPS 仮想ディスクの読み書きを毎秒このバイト数に絞る
+#   VIRTIO_IMG   virtio-blk としてつなぐディスクイメージ（virtio_read で使う）
+#   QEMU_OPTS    QEMU に追加で渡すオプション
+#   COMPRESS, VOLUME_FILE  make_bench_image.sh を参照
+
+DEVENV_DIR=$(dirname "$0")
+LOADER_EFI=${1:-./edk2/Build/MikanLoaderX64/DEBUG_CLANG38/X64/Loader.efi}
+KERNEL_ELF=${2:-./kernel/kernel.elf}
+DISK_IMG=./bench.img
+RESULTS_DIR=${RESULTS_DIR:-./bench_results}
+
+$DEVENV_DIR/make_bench_image.sh $DISK_IMG $LOADER_EFI $KERNEL_ELF \
+    ${BENCH:-all} > /dev/null
+
+mkdir -p $RESULTS_DIR
+RUN_ID=$(date +%Y%m%d-%H%M%S)
+SERIAL_LOG=$RESULTS_DIR/$RUN_ID.serial.log
+RESULT=$RESULTS_DIR/$RUN_ID.txt
+
+# OVMF_VARS は書き換えられるので，実行ごとに複製したものを使う
+VARS_OPTS=""
+if [ -f $DEVENV_DIR/OVMF_VARS.fd ]
+then
+  VARS_FILE=$(mktemp)
+  cp $DEVENV_DIR/OVMF_VARS.fd $VARS_FILE
+  VARS_OPTS="-drive if=pflash,format=raw,file=$VARS_FILE"
+fi
+
+# 遅い起動メディアを真似て，ディスクの帯域を絞る
+DRIVE_OPTS=""
+if [ "$THROTTLE_BPS" != "" ]
+then
+  DRIVE_OPTS=",throttling.bps-total=$THROTTLE_BPS"
+fi
+
+VIRTIO_OPTS=""
+if [ "$VIRTIO_IMG" != "" ]
+then
+  VIRTIO_OPTS="-drive if=virtio,format=raw,file=$VIRTIO_IMG"
+fi
+
+START=$(date +%s%N)
+set +e
+timeout ${TIMEOUT:-300} qemu-system-x86_64 \
+    -m 1G \
+    -drive if=pflash,format=raw,readonly,file=$DEVENV_DIR/OVMF_CODE.fd \
+    $VARS_OPTS \
+    -drive if=ide,index=0,media=disk,format=raw,file=$DISK_IMG$DRIVE_OPTS \
+    $VIRTIO_OPTS \
+    -device nec-usb-xhci,id=xhci \
+    -device usb-mouse -device usb-kbd \
+    -device isa-debug-exit,iobase=0xf4,iosize=0x04 \
+    -display none -monitor none \
+    -serial file:$SERIAL_LOG \
+    $QEMU_OPTS
+QEMU_STATUS=$?
+set -e
+END=$(date +%s%N)
+rm -f ${VARS_FILE:-}
+
+# isa-debug-exit に書いた値 v に対して，QEMU は (v << 1) | 1 で終わる
+case $QEMU_STATUS in
+  1)
+    STATUS=ok
+    ;;
+  124)
+    STATUS=timeout
+    ;;
+  *)
+    STATUS="failed($QEMU_STATUS)"
+    ;;
+esac
+
+{
+  echo "RUN $RUN_ID $STATUS" \
+       "compress=${COMPRESS:-0} throttle=${THROTTLE_BPS:-none}"
+  echo "BENCH qemu_wall_time $(( (END - START) / 1000000 )) ms"
+  grep -a -e '^BOOT ' -e '^BENCH ' $SERIAL_LOG | tr -d '\r'
+} > $RESULT
+cat $RESULT
+
+[ "$STATUS" = ok ]
@@ -19,6 +19,32 @@ IoIn32:
     in eax, dx
     ret
 
+global IoOut16
+IoOut16:
+    mov dx, di
+    mov ax, si
+    out dx, ax
+    ret
+
+global IoIn16
+IoIn16:
+    mov dx, di
+    in ax, dx
+    ret
+
+global IoOut8
+IoOut8:
+    mov dx, di
+    mov al, sil
+    out dx, al
+    ret
+
+global IoIn8
+IoIn8:
+    mov dx, di
+    in al, dx
+    ret
+
 global GetCS
 GetCS:
     xor eax, eax
@@ -81,12 +107,75 @@ GetCR3:
     mov rax, cr3
     ret
 
+global GetCR2
+GetCR2:
+    mov rax, cr2
+    ret
+
+global GetCR0
+GetCR0:
+    mov rax, cr0
+    ret
+
+global SetCR0
+SetCR0:
+    mov cr0, rdi
+    ret
+
+global ReadTSC
+ReadTSC:
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    ret
+
+global ReadPMC
+ReadPMC:
+    mov ecx, edi
+    rdpmc
+    shl rdx, 32
+    or rax, rdx
+    ret
+
+global ReadMSR
+ReadMSR:
+    mov ecx, edi
+    rdmsr
+    shl rdx, 32
+    or rax, rdx
+    ret
+
+global WriteMSR
+WriteMSR:
+    mov ecx, edi
+    mov eax, esi
+    mov rdx, rsi
+    shr rdx, 32
+    wrmsr
+    ret
+
+global CPUID
+CPUID:
+    push rbx
+    mov r10, rdx
+    mov r11, rcx
+    mov eax, edi
+    mov ecx, esi
+    cpuid
+    mov [r10], eax
+    mov [r11], ebx
+    mov [r8], ecx
+    mov [r9], edx
+    pop rbx
+    ret
+
 extern kernel_main_stack
 extern KernelMainNewStack
 
 global KernelMain
 KernelMain:
     mov rsp, kernel_main_stack + 1024 * 1024
+    xor rbp, rbp  ; バックトレースをここで止める
     call KernelMainNewStack
 .fin:
     hlt
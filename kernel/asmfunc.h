@@ -5,6 +5,10 @@
 extern "C" {
 void IoOut32(uint16_t addr, uint32_t data);
 uint32_t IoIn32(uint16_t addr);
+void IoOut16(uint16_t addr, uint16_t data);
+uint16_t IoIn16(uint16_t addr);
+void IoOut8(uint16_t addr, uint8_t data);
+uint8_t IoIn8(uint16_t addr);
 uint16_t GetCS(void);
 void LoadIDT(uint16_t limit, uint64_t offset);
 void LoadGDT(uint16_t limit, uint64_t offset);
@@ -12,5 +16,14 @@ void SetCSSS(uint16_t cs, uint16_t ss);
 void SetDSAll(uint16_t value);
 void SetCR3(uint64_t value);
 uint64_t GetCR3();
+uint64_t GetCR2();
+uint64_t GetCR0();
+void SetCR0(uint64_t value);
+uint64_t ReadTSC();
+uint64_t ReadPMC(uint32_t counter);
+uint64_t ReadMSR(uint32_t msr);
+void WriteMSR(uint32_t msr, uint64_t value);
+void CPUID(uint32_t leaf, uint32_t subleaf, uint32_t* eax, uint32_t* ebx,
+           uint32_t* ecx, uint32_t* edx);
 void SwitchContext(void* next_context, void* current_context);
 }
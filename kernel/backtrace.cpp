@@ -0,0 +1,64 @@
+#include "backtrace.hpp"
+
+#include "console.hpp"
+#include "paging.hpp"
+#include "serial.hpp"
+#include "symbol.hpp"
+
+namespace {
+
+const size_t kMaxFrames = 32;
+// アイデンティティマッピングしてある範囲を超えるフレームは辿らない
+const uint64_t kMappedBytes = kPageDirectoryCount * 512 * 2 * 1024 * 1024;
+// 1 つのフレームがこれより大きければ，壊れたフレームとみなす
+const uint64_t kMaxFrameBytes = 1024 * 1024;
+
+// lookup を含む関数を探して，addr と一緒に表示する
+void PrintFrame(size_t index, uint64_t addr, uint64_t lookup) {
+  uint64_t start;
+  if (auto name = FindEmbeddedSymbol(lookup, &start)) {
+    printk("  #%lu 0x%016lx %s+0x%lx\n", index, addr, name, addr - start);
+  } else {
+    printk("  #%lu 0x%016lx ?\n", index, addr);
+  }
+}
+
+}  // namespace
+
+size_t Backtrace(uint64_t rbp, uint64_t* return_addrs, size_t max) {
+  size_t n = 0;
+  while (n < max && rbp != 0 && rbp % 8 == 0 && rbp < kMappedBytes - 16) {
+    auto frame = reinterpret_cast<const uint64_t*>(rbp);
+    const uint64_t next = frame[0];
+    if (frame[1] == 0) {
+      break;
+    }
+    return_addrs[n++] = frame[1];
+    // スタックは下に伸びるので，呼び出し元のフレームは上にある
+    if (next <= rbp || next - rbp > kMaxFrameBytes) {
+      break;
+    }
+    rbp = next;
+  }
+  return n;
+}
+
+void PrintBacktrace(uint64_t rip, uint64_t rbp) {
+  uint64_t addrs[kMaxFrames];
+  const size_t n = Backtrace(rbp, addrs, kMaxFrames);
+
+  printk("backtrace:\n");
+  PrintFrame(0, rip, rip);
+  // 戻り番地は call の次の命令なので，関数の末尾の call だと次の関数を指して
+  // しまう．1 バイト前で関数を探す
+  for (size_t i = 0; i < n; ++i) {
+    PrintFrame(i + 1, addrs[i], addrs[i] - 1);
+  }
+  serial::Flush();
+}
+
+__attribute__((noinline)) void PrintBacktraceHere() {
+  auto frame = reinterpret_cast<const uint64_t*>(__builtin_frame_address(0));
+  PrintBacktrace(reinterpret_cast<uint64_t>(__builtin_return_address(0)),
+                 frame[0]);
+}
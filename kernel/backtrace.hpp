@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+  rbp が指すフレームを辿って戻り番地を集める．
+  カーネルは -fno-omit-frame-pointer でビルドし，各関数の先頭で
+  push rbp; mov rbp, rsp をしているので，[rbp] に呼び出し元の rbp，
+  [rbp + 8] に戻り番地が入っている．タスクの最初のフレームは rbp が 0．
+*/
+size_t Backtrace(uint64_t rbp, uint64_t* return_addrs, size_t max);
+
+/* rip から始まるバックトレースを，埋め込みのシンボル表で関数名にして
+   画面とシリアルに書き出す．ヒープを使わないので，例外ハンドラからも呼べる */
+void PrintBacktrace(uint64_t rip, uint64_t rbp);
+
+/* 呼び出した場所のバックトレースを書き出す．
+   newlib_support.c の _exit からも呼ぶので C のリンケージにする */
+extern "C" void PrintBacktraceHere();
@@ -1,7 +1,23 @@
 #include "benchmark.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+
+#include "asmfunc.h"
+#include "boot_config.hpp"
+#include "fat.hpp"
+#include "font.hpp"
+#include "frame_buffer.hpp"
 #include "layer.hpp"
+#include "memory_manager.hpp"
+#include "qemu.hpp"
+#include "serial.hpp"
 #include "task.hpp"
+#include "timer.hpp"
+#include "virtio_blk.hpp"
 #include "window.hpp"
 
 namespace {
@@ -62,3 +78,497 @@ void TaskBenchMark(uint64_t task_id, int64_t data) {
     }
   }
 }
+
+namespace {
+
+const int kBenchSurface = 256;
+
+uint64_t echo_task_id;
+// operator delete は何もしないので，描画先と読み込み先は一度だけ確保して
+// 使い回す
+FrameBuffer* surfaces[2];
+const size_t kReadBufferBytes = 4 * 1024 * 1024;
+uint8_t* read_buffer;
+
+// 経過時間をナノ秒で測る
+class Stopwatch {
+ public:
+  Stopwatch() : start_{ReadTSC()} {}
+  uint64_t Nanoseconds() const { return TSCToNanoseconds(ReadTSC() - start_); }
+
+ private:
+  uint64_t start_;
+};
+
+uint64_t PerSecond(uint64_t count, uint64_t ns) {
+  return ns ? count * 1000000000 / ns : 0;
+}
+
+uint64_t MegabytesPerSecond(uint64_t bytes, uint64_t ns) {
+  return ns ? bytes * 1000 / ns : 0;
+}
+
+// ピクセル形式は画面と同じにして，メモリ上だけに描く
+FrameBuffer& Surface(int i) {
+  if (!surfaces[i]) {
+    FrameBufferConfig config = screen_config;
+    config.frame_buffer = nullptr;
+    config.horizontal_resolution = kBenchSurface;
+    config.vertical_resolution = kBenchSurface;
+    surfaces[i] = new FrameBuffer;
+    surfaces[i]->Initialize(config);
+  }
+  return *surfaces[i];
+}
+
+// ファイルの読み込みを測るときの読み込み先．kReadBufferBytes ある
+uint8_t* ReadBuffer() {
+  if (!read_buffer) {
+    read_buffer = new uint8_t[kReadBufferBytes];
+  }
+  return read_buffer;
+}
+
+BenchResult BenchFillRect() {
+  auto& fb = Surface(0);
+  const int kRounds = 200;
+  Stopwatch sw;
+  for (int i = 0; i < kRounds; ++i) {
+    FillRect(fb.Writer(), {0, 0}, {kBenchSurface, kBenchSurface},
+             ToColor(i * 0x010101));
+  }
+  const uint64_t pixels = uint64_t{kBenchSurface} * kBenchSurface * kRounds;
+  return {"fill_rect", PerSecond(pixels, sw.Nanoseconds()), "pixel/s"};
+}
+
+BenchResult BenchCopyFrom() {
+  auto& src = Surface(0);
+  auto& dst = Surface(1);
+  const int kRounds = 200;
+  Stopwatch sw;
+  for (int i = 0; i < kRounds; ++i) {
+    dst.CopyFrom(src, {0, 0}, {{0, 0}, {kBenchSurface, kBenchSurface}});
+  }
+  const uint64_t pixels = uint64_t{kBenchSurface} * kBenchSurface * kRounds;
+  return {"copy_from", PerSecond(pixels, sw.Nanoseconds()), "pixel/s"};
+}
+
+BenchResult BenchWriteString() {
+  auto& fb = Surface(0);
+  const char* text = "The quick brown fox jumps over";  // 30 文字
+  const int kRounds = 2000;
+  Stopwatch sw;
+  for (int i = 0; i < kRounds; ++i) {
+    WriteString(fb.Writer(), 0, (i % 16) * 16, ToColor(0xffffff), text);
+  }
+  const uint64_t chars = strlen(text) * kRounds;
+  return {"write_string", PerSecond(chars, sw.Nanoseconds()), "char/s"};
+}
+
+void TaskBenchEcho(uint64_t task_id, int64_t data) {
+  asm("cli");
+  Task& task = task_manager->CurrentTask();
+  asm("sti");
+
+  while (true) {
+    asm("cli");
+    auto msg = task.ReceiveMessage();
+    if (!msg) {
+      task.Sleep();
+      asm("sti");
+      continue;
+    }
+    asm("sti");
+
+    if (msg->type != Message::kBenchPing) {
+      continue;
+    }
+    for (uint64_t i = 0; i < msg->arg.bench.switches; ++i) {
+      asm("cli");
+      task_manager->SwitchTask();
+      asm("sti");
+    }
+    Message pong{Message::kBenchPong};
+    pong.src_task = task_id;
+    asm("cli");
+    task_manager->SendMessage(msg->src_task, pong);
+    asm("sti");
+  }
+}
+
+void EnsureEchoTask() {
+  if (echo_task_id != 0) {
+    return;
+  }
+  asm("cli");
+  echo_task_id =
+      task_manager->NewTask().InitContext(TaskBenchEcho, 0).Wakeup().ID();
+  asm("sti");
+}
+
+/* 相手の応答を待つ．ベンチマーク中に届いた他のメッセージは deferred に
+   退避しておき，終わってから自分に送り直す． */
+void Ping(Task& task, uint64_t switches, std::deque<Message>& deferred) {
+  Message ping{Message::kBenchPing};
+  ping.src_task = task.ID();
+  ping.arg.bench.switches = switches;
+  asm("cli");
+  task_manager->SendMessage(echo_task_id, ping);
+  asm("sti");
+
+  for (uint64_t i = 0; i < switches; ++i) {
+    asm("cli");
+    task_manager->SwitchTask();
+    asm("sti");
+  }
+
+  while (true) {
+    asm("cli");
+    auto msg = task.ReceiveMessage();
+    if (!msg) {
+      task.Sleep();
+      asm("sti");
+      continue;
+    }
+    asm("sti");
+    if (msg->type == Message::kBenchPong) {
+      return;
+    }
+    deferred.push_back(*msg);
+  }
+}
+
+BenchResult BenchMessageRoundTrip(Task& task, std::deque<Message>& deferred) {
+  const int kRounds = 2000;
+  Stopwatch sw;
+  for (int i = 0; i < kRounds; ++i) {
+    Ping(task, 0, deferred);
+  }
+  return {"message_round_trip", sw.Nanoseconds() / kRounds, "ns"};
+}
+
+BenchResult BenchContextSwitch(Task& task, std::deque<Message>& deferred) {
+  // 2 つのタスクが交互に譲り合うので，切り替えは 2 * kSwitches 回起きる
+  const int kSwitches = 5000;
+  Stopwatch sw;
+  Ping(task, kSwitches, deferred);
+  return {"context_switch", sw.Nanoseconds() / (2 * kSwitches), "ns"};
+}
+
+BenchResult BenchFrameAllocate() {
+  const int kRounds = 20000;
+  Stopwatch sw;
+  for (int i = 0; i < kRounds; ++i) {
+    asm("cli");
+    auto [frame, err] = memory_manager->Allocate(1);
+    if (!err) {
+      memory_manager->Free(frame, 1);
+    }
+    asm("sti");
+  }
+  return {"frame_alloc_free", PerSecond(kRounds, sw.Nanoseconds()), "op/s"};
+}
+
+BenchResult BenchMalloc() {
+  const int kRounds = 20000;
+  Stopwatch sw;
+  for (int i = 0; i < kRounds; ++i) {
+    void* p = malloc(16 + i % 256);
+    free(p);
+  }
+  return {"malloc_free", PerSecond(kRounds, sw.Nanoseconds()), "op/s"};
+}
+
+// ボリュームにありそうなファイルのうち，見つかった最初のもの
+const char* BenchFileName() {
+  for (const char* name : {"kernel.elf", "nihongo.ttf"}) {
+    if (fat::FindFile(name)) {
+      return name;
+    }
+  }
+  return nullptr;
+}
+
+BenchResult BenchFindFile() {
+  const char* name = BenchFileName();
+  if (!name) {
+    return {"find_file", 0, "op/s"};
+  }
+  const int kRounds = 20000;
+  Stopwatch sw;
+  for (int i = 0; i < kRounds; ++i) {
+    fat::FindFile(name);
+  }
+  return {"find_file", PerSecond(kRounds, sw.Nanoseconds()), "op/s"};
+}
+
+/* ファイルの先頭 len バイトを chunk バイトずつ，合計 kTotalBytes 読んで
+   MB/s と 1 秒あたりの ReadFile 呼び出し回数を results に足す．
+   chunk は kReadBufferBytes 以下であること */
+void MeasureReadFile(const fat::DirectoryEntry& entry, size_t len,
+                     size_t chunk, const char* mbps_name,
+                     const char* iops_name,
+                     std::vector<BenchResult>& results) {
+  const size_t kTotalBytes = 32 * 1024 * 1024;
+  auto buf = ReadBuffer();
+
+  uint64_t bytes = 0, ops = 0;
+  Stopwatch sw;
+  while (len > 0 && bytes < kTotalBytes) {
+    for (size_t offset = 0; offset < len; offset += chunk) {
+      const size_t n = fat::ReadFile(entry, offset, buf,
+                                     std::min(chunk, len - offset));
+      bytes += n;
+      ++ops;
+    }
+  }
+  const auto ns = sw.Nanoseconds();
+  results.push_back({mbps_name, MegabytesPerSecond(bytes, ns), "MB/s"});
+  results.push_back({iops_name, PerSecond(ops, ns), "IOPS"});
+}
+
+/* BlockCache::kBypassBytes 以上の読み込みはキャッシュを通らないので，
+   4MiB ずつの読み込みは毎回デバイスから読む．
+   キャッシュに当たる場合は，キャッシュに収まる 1MiB を 16KiB ずつ読んで測る．
+   最初の 1 回でキャッシュに載せ，その後の読み込みだけを測る． */
+void BenchReadFile(std::vector<BenchResult>& results) {
+  const char* name = BenchFileName();
+  if (!name) {
+    results.push_back({"read_file_bypass", 0, "MB/s"});
+    return;
+  }
+  const auto entry = *fat::FindFile(name);
+
+  MeasureReadFile(entry, std::min<size_t>(entry.file_size, kReadBufferBytes),
+                  kReadBufferBytes, "read_file_bypass", "read_file_bypass_iops",
+                  results);
+
+  const size_t kChunk = 16 * 1024;
+  static_assert(kChunk < BlockCache::kBypassBytes);
+  const size_t len = std::min<size_t>(entry.file_size, 1024 * 1024);
+  for (size_t offset = 0; offset < len; offset += kChunk) {
+    fat::ReadFile(entry, offset, ReadBuffer(), std::min(kChunk, len - offset));
+  }
+  MeasureReadFile(entry, len, kChunk, "read_file_cached",
+                  "read_file_cached_iops", results);
+}
+
+/* アプリと同じ経路（newlib の fopen/fread から open/read，fat::FileDescriptor）
+   でファイル全体を読む．開いて閉じるところも含めて測る． */
+BenchResult BenchFopenFread() {
+  const char* name = BenchFileName();
+  if (!name) {
+    return {"fopen_fread", 0, "byte/s"};
+  }
+  const size_t kTotalBytes = 32 * 1024 * 1024;
+  const size_t kChunk = 16 * 1024;
+  auto buf = ReadBuffer();
+
+  uint64_t bytes = 0;
+  Stopwatch sw;
+  while (bytes < kTotalBytes) {
+    FILE* f = fopen(name, "rb");
+    if (!f) {
+      return {"fopen_fread", 0, "byte/s"};
+    }
+    size_t n;
+    while ((n = fread(buf, 1, kChunk, f)) > 0) {
+      bytes += n;
+    }
+    fclose(f);
+  }
+  return {"fopen_fread", PerSecond(bytes, sw.Nanoseconds()), "byte/s"};
+}
+
+/* virtio-blk から 4KiB ずつ kVirtioReads 回読む．Read で 1 つずつ待つ場合と，
+   ReadAsync で kMaxRequests 個まで同時に発行し，完了の通知が届くたびに
+   次を発行する場合を比べる．読む位置は先頭 64MiB の中を順に回る． */
+const size_t kVirtioReadSectors = 8;
+const size_t kVirtioReads = 4096;
+const int kVirtioQueueDepth = virtio::BlockDriver::kMaxRequests;
+alignas(4096) uint8_t virtio_read_buf[kVirtioQueueDepth]
+                                     [kVirtioReadSectors * 512];
+
+void BenchVirtioRead(Task& task, std::deque<Message>& deferred,
+                     std::vector<BenchResult>& results) {
+  auto driver = virtio::block_driver;
+  const size_t span =
+      driver ? std::min<size_t>(driver->SectorCount(), 64 * 1024 * 2) /
+                   kVirtioReadSectors
+             : 0;
+  if (span == 0) {
+    results.push_back({"virtio_read_qd1", 0, "MB/s"});
+    return;
+  }
+  auto lba = [span](size_t i) { return i % span * kVirtioReadSectors; };
+  const uint64_t bytes = kVirtioReads * sizeof(virtio_read_buf[0]);
+
+  Stopwatch sw1;
+  for (size_t i = 0; i < kVirtioReads; ++i) {
+    if (driver->Read(virtio_read_buf[0], lba(i), kVirtioReadSectors)) {
+      results.push_back({"virtio_read_qd1", 0, "MB/s"});
+      return;
+    }
+  }
+  const auto ns1 = sw1.Nanoseconds();
+  results.push_back({"virtio_read_qd1", MegabytesPerSecond(bytes, ns1),
+                     "MB/s"});
+  results.push_back({"virtio_read_qd1_iops", PerSecond(kVirtioReads, ns1),
+                     "IOPS"});
+
+  if (!driver->AsyncAvailable()) {
+    results.push_back({"virtio_read_qd32", 0, "MB/s"});
+    return;
+  }
+
+  // 要求の ID からバッファを引く．0 は使っていないバッファ
+  uint32_t ids[kVirtioQueueDepth] = {};
+  size_t issued = 0, completed = 0;
+  bool failed = false;
+  auto issue = [&](int b) {
+    auto [id, err] = driver->ReadAsync(virtio_read_buf[b], lba(issued),
+                                       kVirtioReadSectors, task.ID());
+    if (err) {
+      failed = true;
+      return;
+    }
+    ids[b] = id;
+    ++issued;
+  };
+
+  Stopwatch sw32;
+  for (int b = 0; b < kVirtioQueueDepth && !failed; ++b) {
+    issue(b);
+  }
+  while (completed < issued) {
+    asm("cli");
+    auto msg = task.ReceiveMessage();
+    if (!msg) {
+      task.Sleep();
+      asm("sti");
+      continue;
+    }
+    asm("sti");
+    if (msg->type != Message::kBlockIOComplete) {
+      deferred.push_back(*msg);
+      continue;
+    }
+
+    ++completed;
+    failed |= msg->arg.block_io.status != 0;
+    for (int b = 0; b < kVirtioQueueDepth; ++b) {
+      if (ids[b] == msg->arg.block_io.request_id) {
+        ids[b] = 0;
+        if (!failed && issued < kVirtioReads) {
+          issue(b);
+        }
+        break;
+      }
+    }
+  }
+  const auto ns32 = sw32.Nanoseconds();
+  if (failed) {
+    results.push_back({"virtio_read_qd32", 0, "MB/s"});
+    return;
+  }
+  results.push_back({"virtio_read_qd32", MegabytesPerSecond(bytes, ns32),
+                     "MB/s"});
+  results.push_back({"virtio_read_qd32_iops", PerSecond(kVirtioReads, ns32),
+                     "IOPS"});
+}
+
+bool Selected(const char* filter, const char* name) {
+  return strcmp(filter, "all") == 0 || strcmp(filter, name) == 0;
+}
+
+}  // namespace
+
+std::vector<BenchResult> RunBenchmarks(const char* name) {
+  asm("cli");
+  Task& task = task_manager->CurrentTask();
+  asm("sti");
+  EnsureEchoTask();
+
+  std::vector<BenchResult> results;
+  std::deque<Message> deferred;
+  if (Selected(name, "fill_rect")) {
+    results.push_back(BenchFillRect());
+  }
+  if (Selected(name, "copy_from")) {
+    results.push_back(BenchCopyFrom());
+  }
+  if (Selected(name, "write_string")) {
+    results.push_back(BenchWriteString());
+  }
+  if (Selected(name, "message_round_trip")) {
+    results.push_back(BenchMessageRoundTrip(task, deferred));
+  }
+  if (Selected(name, "context_switch")) {
+    results.push_back(BenchContextSwitch(task, deferred));
+  }
+  if (Selected(name, "frame_alloc_free")) {
+    results.push_back(BenchFrameAllocate());
+  }
+  if (Selected(name, "malloc_free")) {
+    results.push_back(BenchMalloc());
+  }
+  if (Selected(name, "find_file")) {
+    results.push_back(BenchFindFile());
+  }
+  if (Selected(name, "read_file")) {
+    BenchReadFile(results);
+  }
+  if (Selected(name, "fopen_fread")) {
+    results.push_back(BenchFopenFread());
+  }
+  if (Selected(name, "virtio_read")) {
+    BenchVirtioRead(task, deferred, results);
+  }
+
+  asm("cli");
+  for (const auto& msg : deferred) {
+    task.SendMessage(msg);
+  }
+  asm("sti");
+
+  char s[128];
+  serial::Write("BENCH-BEGIN\n");
+  for (const auto& result : results) {
+    serial::Write(s, FormatBenchResult(result, s, sizeof(s)));
+  }
+  sprintf(s, "BENCH-END %lu\n", results.size());
+  serial::Write(s);
+  return results;
+}
+
+size_t FormatBenchResult(const BenchResult& result, char* buf, size_t size) {
+  const int n = snprintf(buf, size, "BENCH %s %lu %s\n", result.name,
+                         result.value, result.unit);
+  return std::min<size_t>(n, size - 1);
+}
+
+void TaskBenchmarkSuite(uint64_t task_id, int64_t data) {
+  // TSC は CPU のリセットから数えているので，ファームウェアの時間も含む
+  const BenchResult boot_time{"boot_time",
+                              TSCToNanoseconds(ReadTSC()) / 1000, "us"};
+  char s[128];
+  serial::Write(s, FormatBenchResult(boot_time, s, sizeof(s)));
+
+  const char* name = BootConfig("bench");
+  const auto results = RunBenchmarks(name ? name : "all");
+  serial::Flush();
+
+  // 無人で回すときは，結果を出し終えたら QEMU ごと終わる
+  if (BootConfig("exit_after_bench")) {
+    ExitQemu(results.empty() ? 1 : 0);
+  }
+
+  asm("cli");
+  Task& task = task_manager->CurrentTask();
+  asm("sti");
+  while (true) {
+    asm("cli");
+    task.Sleep();
+    asm("sti");
+  }
+}
@@ -1,8 +1,31 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <vector>
+
 #include "message.hpp"
 
 void InitializeBenchMark();
 void TaskBenchMark(uint64_t taskid, int64_t data);
+
+struct BenchResult {
+  const char* name;
+  uint64_t value;
+  const char* unit;
+};
+
+/*
+  name のベンチマークを実行する．"all" なら全部を実行する．
+  回数を固定しているので，同じ環境なら毎回同じ量の仕事をする．
+  結果はシリアルにも BENCH で始まる行として書き出す．
+  タスク間の通信を測るので，メインタスク以外のタスクから呼ぶこと．
+*/
+std::vector<BenchResult> RunBenchmarks(const char* name);
+
+// "BENCH <name> <value> <unit>" の 1 行にする
+size_t FormatBenchResult(const BenchResult& result, char* buf, size_t size);
+
+// 起動時に全部のベンチマークを実行するタスク
+void TaskBenchmarkSuite(uint64_t task_id, int64_t data);
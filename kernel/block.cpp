@@ -0,0 +1,219 @@
+#include "block.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+RAMBlockDevice::RAMBlockDevice(void* image, size_t sector_size,
+                               size_t sector_count)
+    : image_{reinterpret_cast<uint8_t*>(image)},
+      sector_size_{sector_size},
+      sector_count_{sector_count} {}
+
+Error RAMBlockDevice::Read(void* buf, size_t lba, size_t count) {
+  if (lba + count > sector_count_) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+  memcpy(buf, image_ + lba * sector_size_, count * sector_size_);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error RAMBlockDevice::Write(const void* buf, size_t lba, size_t count) {
+  if (lba + count > sector_count_) {
+    return MAKE_ERROR(Error::kIndexOutOfRange);
+  }
+  memcpy(image_ + lba * sector_size_, buf, count * sector_size_);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+BlockCache::BlockCache(BlockDevice& device, size_t line_sectors,
+                       size_t capacity_lines, size_t read_ahead_lines)
+    : device_{device},
+      line_sectors_{line_sectors},
+      line_bytes_{line_sectors * device.SectorSize()},
+      capacity_lines_{std::max(capacity_lines, read_ahead_lines + 1)},
+      read_ahead_lines_{read_ahead_lines} {}
+
+Error BlockCache::Read(size_t offset, void* buf, size_t len) {
+  auto p = reinterpret_cast<uint8_t*>(buf);
+  while (len > 0) {
+    const size_t number = offset / line_bytes_;
+    const size_t line_offset = offset % line_bytes_;
+    const size_t n = std::min(len, line_bytes_ - line_offset);
+
+    Line* line = Lookup(number);
+    if (line) {
+      ++stats_.hits;
+      if (line->prefetched) {
+        ++stats_.read_ahead_hits;
+        line->prefetched = false;
+      }
+    } else if (line_offset == 0 && len >= kBypassBytes &&
+               (number + 1) * line_sectors_ <= device_.SectorCount()) {
+      // キャッシュにないラインが続く限り，まとめてデバイスから直接読む
+      size_t count = 1;
+      while ((count + 1) * line_bytes_ <= len &&
+             (number + count + 1) * line_sectors_ <= device_.SectorCount() &&
+             map_.count(number + count) == 0) {
+        ++count;
+      }
+      if (auto err = device_.Read(p, number * line_sectors_,
+                                  count * line_sectors_)) {
+        return err;
+      }
+      stats_.bypass_bytes += count * line_bytes_;
+      p += count * line_bytes_;
+      offset += count * line_bytes_;
+      len -= count * line_bytes_;
+      continue;
+    } else {
+      ++stats_.misses;
+      auto [loaded, err] = Load(number);
+      if (err) {
+        return err;
+      }
+      line = loaded;
+    }
+
+    memcpy(p, &line->data[line_offset], n);
+    p += n;
+    offset += n;
+    len -= n;
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error BlockCache::Write(size_t offset, const void* buf, size_t len) {
+  auto p = reinterpret_cast<const uint8_t*>(buf);
+  while (len > 0) {
+    const size_t number = offset / line_bytes_;
+    const size_t line_offset = offset % line_bytes_;
+    const size_t n = std::min(len, line_bytes_ - line_offset);
+
+    Line* line = Lookup(number);
+    if (line) {
+      ++stats_.hits;
+    } else if (n == line_bytes_) {
+      // ライン全体を上書きするので，デバイスから読む必要はない
+      auto [inserted, err] = Insert(number);
+      if (err) {
+        return err;
+      }
+      line = inserted;
+    } else {
+      ++stats_.misses;
+      auto [loaded, err] = Load(number);
+      if (err) {
+        return err;
+      }
+      line = loaded;
+    }
+
+    memcpy(&line->data[line_offset], p, n);
+    line->dirty = true;
+    line->prefetched = false;
+    p += n;
+    offset += n;
+    len -= n;
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error BlockCache::Flush() {
+  for (auto& line : lines_) {
+    if (line.dirty) {
+      if (auto err = WriteBack(line)) {
+        return err;
+      }
+    }
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+size_t BlockCache::LineCount() const {
+  return (device_.SectorCount() + line_sectors_ - 1) / line_sectors_;
+}
+
+BlockCache::Line* BlockCache::Lookup(size_t number) {
+  auto it = map_.find(number);
+  if (it == map_.end()) {
+    return nullptr;
+  }
+  lines_.splice(lines_.begin(), lines_, it->second);
+  return &*it->second;
+}
+
+WithError<BlockCache::Line*> BlockCache::Load(size_t number) {
+  if (number >= LineCount()) {
+    return {nullptr, MAKE_ERROR(Error::kIndexOutOfRange)};
+  }
+
+  size_t count = 1;
+  while (count <= read_ahead_lines_ && number + count < LineCount() &&
+         map_.count(number + count) == 0) {
+    ++count;
+  }
+
+  // 要求されたラインと先読みするラインを 1 回のデバイス読み込みで取得する
+  const size_t first_sector = number * line_sectors_;
+  const size_t sectors = std::min(count * line_sectors_,
+                                  device_.SectorCount() - first_sector);
+  std::vector<uint8_t> buf(count * line_bytes_);
+  if (auto err = device_.Read(buf.data(), first_sector, sectors)) {
+    return {nullptr, err};
+  }
+
+  // 先読みしたラインから入れ，要求されたラインが最も新しくなるようにする
+  for (size_t i = count; i-- > 0;) {
+    auto [line, err] = Insert(number + i);
+    if (err) {
+      return {nullptr, err};
+    }
+    memcpy(line->data.data(), &buf[i * line_bytes_], line_bytes_);
+    line->prefetched = i > 0;
+  }
+  stats_.read_ahead_lines += count - 1;
+
+  return {&lines_.front(), MAKE_ERROR(Error::kSuccess)};
+}
+
+WithError<BlockCache::Line*> BlockCache::Insert(size_t number) {
+  if (lines_.size() >= capacity_lines_) {
+    if (auto err = Evict()) {
+      return {nullptr, err};
+    }
+  } else {
+    lines_.push_back(Line{0, std::vector<uint8_t>(line_bytes_), false, false});
+  }
+
+  // 末尾のラインを使い回して先頭へ移す
+  auto it = std::prev(lines_.end());
+  it->number = number;
+  it->dirty = false;
+  it->prefetched = false;
+  lines_.splice(lines_.begin(), lines_, it);
+  map_[number] = it;
+  return {&*it, MAKE_ERROR(Error::kSuccess)};
+}
+
+Error BlockCache::Evict() {
+  auto& victim = lines_.back();
+  if (victim.dirty) {
+    if (auto err = WriteBack(victim)) {
+      return err;
+    }
+  }
+  map_.erase(victim.number);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error BlockCache::WriteBack(Line& line) {
+  const size_t first_sector = line.number * line_sectors_;
+  const size_t sectors =
+      std::min(line_sectors_, device_.SectorCount() - first_sector);
+  if (auto err = device_.Write(line.data.data(), first_sector, sectors)) {
+    return err;
+  }
+  line.dirty = false;
+  ++stats_.write_backs;
+  return MAKE_ERROR(Error::kSuccess);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hpp"
+
+/*
+  セクタ単位で読み書きするデバイス．
+  lba はデバイス先頭からのセクタ番号，count はセクタ数．
+*/
+class BlockDevice {
+ public:
+  virtual ~BlockDevice() = default;
+  virtual Error Read(void* buf, size_t lba, size_t count) = 0;
+  virtual Error Write(const void* buf, size_t lba, size_t count) = 0;
+  virtual size_t SectorSize() const = 0;
+  virtual size_t SectorCount() const = 0;
+
+  // 内容がそのままメモリ上にあるデバイスなら，その先頭を返す
+  virtual uint8_t* MemoryImage() { return nullptr; }
+};
+
+// ブートローダがメモリに読み込んだボリュームイメージ
+class RAMBlockDevice : public BlockDevice {
+ public:
+  RAMBlockDevice(void* image, size_t sector_size, size_t sector_count);
+  Error Read(void* buf, size_t lba, size_t count) override;
+  Error Write(const void* buf, size_t lba, size_t count) override;
+  size_t SectorSize() const override { return sector_size_; }
+  size_t SectorCount() const override { return sector_count_; }
+  uint8_t* MemoryImage() override { return image_; }
+
+ private:
+  uint8_t* image_;
+  size_t sector_size_, sector_count_;
+};
+
+struct BlockCacheStats {
+  uint64_t hits, misses;
+  uint64_t read_ahead_lines, read_ahead_hits;
+  uint64_t bypass_bytes;
+  uint64_t write_backs;
+};
+
+/*
+  BlockDevice の前に置く LRU キャッシュ．
+  連続する line_sectors 個のセクタを 1 ラインとして扱う．
+  書き込みは Flush か追い出しまでデバイスに反映しない（ライトバック）．
+  ミスしたときは後続の read_ahead_lines ライン分をまとめて先読みする．
+*/
+class BlockCache {
+ public:
+  BlockCache(BlockDevice& device, size_t line_sectors, size_t capacity_lines,
+             size_t read_ahead_lines);
+
+  // offset はデバイス先頭からのバイト位置
+  Error Read(size_t offset, void* buf, size_t len);
+  Error Write(size_t offset, const void* buf, size_t len);
+  Error Flush();
+
+  BlockDevice& Device() { return device_; }
+  size_t LineBytes() const { return line_bytes_; }
+  const BlockCacheStats& Stats() const { return stats_; }
+  void ResetStats() { stats_ = {}; }
+
+  /* この長さ以上の読み込みで，キャッシュにないラインはキャッシュを通さずに
+     直接バッファへ読み込む．大きなファイルがキャッシュを追い出すのを防ぐ． */
+  static const size_t kBypassBytes = 64 * 1024;
+
+ private:
+  struct Line {
+    size_t number;
+    std::vector<uint8_t> data;
+    bool dirty;
+    bool prefetched;  // 先読みされてからまだ参照されていない
+  };
+
+  BlockDevice& device_;
+  const size_t line_sectors_, line_bytes_, capacity_lines_, read_ahead_lines_;
+  std::list<Line> lines_;  // 先頭ほど最近使われた
+  std::unordered_map<size_t, std::list<Line>::iterator> map_;
+  BlockCacheStats stats_{};
+
+  size_t LineCount() const;
+  Line* Lookup(size_t number);
+  WithError<Line*> Load(size_t number);
+  WithError<Line*> Insert(size_t number);
+  Error Evict();
+  Error WriteBack(Line& line);
+};
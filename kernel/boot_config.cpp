@@ -0,0 +1,61 @@
+#include "boot_config.hpp"
+
+#include <map>
+#include <string>
+
+#include "fat.hpp"
+
+namespace {
+
+std::map<std::string, std::string>* boot_config;
+
+std::string Trim(const std::string& s) {
+  const auto begin = s.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  const auto end = s.find_last_not_of(" \t\r");
+  return s.substr(begin, end - begin + 1);
+}
+
+}  // namespace
+
+Error LoadBootConfig(const char* path) {
+  boot_config = new std::map<std::string, std::string>;
+
+  auto entry = fat::FindFile(path);
+  if (!entry) {
+    return MAKE_ERROR(Error::kNoSuchFile);
+  }
+  std::string text(entry->file_size, '\0');
+  fat::ReadFile(*entry, 0, &text[0], text.size());
+
+  size_t line_begin = 0;
+  while (line_begin < text.size()) {
+    auto line_end = text.find('\n', line_begin);
+    if (line_end == std::string::npos) {
+      line_end = text.size();
+    }
+    auto line = text.substr(line_begin, line_end - line_begin);
+    line_begin = line_end + 1;
+
+    line = line.substr(0, line.find('#'));
+    const auto eq = line.find('=');
+    if (eq == std::string::npos) {
+      continue;
+    }
+    const auto key = Trim(line.substr(0, eq));
+    if (!key.empty()) {
+      (*boot_config)[key] = Trim(line.substr(eq + 1));
+    }
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+const char* BootConfig(const char* key) {
+  if (!boot_config) {
+    return nullptr;
+  }
+  auto it = boot_config->find(key);
+  return it == boot_config->end() ? nullptr : it->second.c_str();
+}
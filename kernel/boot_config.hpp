@@ -0,0 +1,15 @@
+#pragma once
+
+#include "error.hpp"
+
+/*
+  ボリュームのルートにある設定ファイル（BOOT.CFG）を読む．
+  1 行に 1 つ key=value を書く．# から行末まではコメント．
+    bench=all
+    exit_after_bench=1
+    deferred_init=1
+*/
+Error LoadBootConfig(const char* path);
+
+// key が設定されていなければ nullptr を返す
+const char* BootConfig(const char* key);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+  ローダからカーネルへ渡す起動時の情報．ローダ（C）とカーネル（C++）の
+  両方から読むので，C で書ける型だけを使う．
+*/
+
+enum { kBootStampMax = 32, kBootStampNameLen = 24 };
+
+/* BootInfo の先頭に置く目印（"MKBI"）と版．古いローダは第 5 引数を
+   設定しないので，カーネルはこれが合うときだけ中身を信用する．
+   フィールドを変えたら kBootInfoVersion を上げること． */
+enum { kBootInfoMagic = 0x49424b4d, kBootInfoVersion = 2 };
+
+// 起動のある段階に入ったときの TSC
+struct BootStamp {
+  char name[kBootStampNameLen];
+  uint64_t tsc;
+};
+
+struct BootInfo {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_stamps;
+  struct BootStamp stamps[kBootStampMax];
+  uint64_t loader_peak_bytes;  // ローダが同時に確保していたメモリの最大値
+  uint64_t volume_read_bytes;  // ボリュームイメージのうち実際に読んだ量
+  uint64_t volume_loaded_bytes;  // メモリ上のボリュームイメージの大きさ
+};
@@ -0,0 +1,84 @@
+#include "boot_timeline.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "asmfunc.h"
+#include "interrupt.hpp"
+#include "logger.hpp"
+#include "serial.hpp"
+#include "timer.hpp"
+
+namespace {
+
+BootInfo timeline;
+
+/* ローダの静的データ（boot_info）は 4GiB 未満に置かれる．この外を指す値は
+   読むとフォルトするかもしれないので，触らずに捨てる */
+const uintptr_t kBootInfoAddressLimit = 4ul * 1024 * 1024 * 1024;
+
+}  // namespace
+
+void InitializeBootTimeline(const BootInfo* boot_info) {
+  /* 古いローダは第 5 引数を設定しないので，中身はでたらめかもしれない．
+     4GiB 未満の揃ったアドレスで，目印と版が合うものだけを使う． */
+  const auto addr = reinterpret_cast<uintptr_t>(boot_info);
+  if (addr != 0 && addr % alignof(BootInfo) == 0 &&
+      addr < kBootInfoAddressLimit && boot_info->magic == kBootInfoMagic &&
+      boot_info->version == kBootInfoVersion &&
+      boot_info->num_stamps <= kBootStampMax) {
+    timeline = *boot_info;
+  }
+  StampBootPhase("kernel_entry");
+}
+
+uint64_t VolumeLoadedBytes() {
+  return timeline.volume_loaded_bytes;
+}
+
+void StampBootPhase(const char* name) {
+  const auto rflags = SaveAndDisableInterrupts();
+  if (timeline.num_stamps < kBootStampMax) {
+    auto& stamp = timeline.stamps[timeline.num_stamps++];
+    strncpy(stamp.name, name, kBootStampNameLen - 1);
+    stamp.name[kBootStampNameLen - 1] = '\0';
+    stamp.tsc = ReadTSC();
+  }
+  RestoreInterrupts(rflags);
+}
+
+void ReportBootTimeline() {
+  const auto rflags = SaveAndDisableInterrupts();
+  const BootInfo snapshot = timeline;
+  RestoreInterrupts(rflags);
+
+  if (snapshot.num_stamps == 0) {
+    return;
+  }
+
+  // BOOT <段階> <最初からの us> us +<前の段階からの us>
+  const uint64_t origin = snapshot.stamps[0].tsc;
+  uint64_t prev = origin;
+  char s[96];
+  for (uint32_t i = 0; i < snapshot.num_stamps; ++i) {
+    const auto& stamp = snapshot.stamps[i];
+    const int n = snprintf(s, sizeof(s), "BOOT %s %lu us +%lu\n", stamp.name,
+                           TSCToNanoseconds(stamp.tsc - origin) / 1000,
+                           TSCToNanoseconds(stamp.tsc - prev) / 1000);
+    prev = stamp.tsc;
+    // ログの設定によらずシリアルには必ず出す．トレースには kDebug で残す
+    serial::Write(s, std::min<size_t>(n, sizeof(s) - 1));
+    Log(kDebug, "%s", s);
+  }
+
+  if (snapshot.loader_peak_bytes) {
+    const int n = snprintf(s, sizeof(s),
+                           "BOOT loader_peak_memory %lu KiB\n"
+                           "BOOT volume_read %lu KiB\n",
+                           snapshot.loader_peak_bytes / 1024,
+                           snapshot.volume_read_bytes / 1024);
+    serial::Write(s, std::min<size_t>(n, sizeof(s) - 1));
+    Log(kDebug, "%s", s);
+  }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "boot_info.hpp"
+
+/*
+  起動の各段階に入った時刻を TSC で記録する．
+  ローダが記録した分を引き継ぎ，カーネルの段階をその後ろに付け足す．
+*/
+
+// ローダから受け取った記録を写し取る．ローダのスタックは後で上書きされるので，
+// カーネルの入り口ですぐに呼ぶこと
+void InitializeBootTimeline(const BootInfo* boot_info);
+
+/* ローダがメモリに読み込んだボリュームイメージの大きさ．
+   ローダから受け取れなかったときは 0 を返す． */
+uint64_t VolumeLoadedBytes();
+
+// 記録が一杯のときは何もしない
+void StampBootPhase(const char* name);
+
+/* ここまでの記録を，最初の記録からの経過時間と前の段階からの差で表示する．
+   TSC の周波数を使うので，InitializeLAPICTimer の後に呼ぶこと．
+   BOOT で始まる行をシリアルに書き出す． */
+void ReportBootTimeline();
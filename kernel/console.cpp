@@ -4,7 +4,9 @@
 #include <cstring>
 
 #include "font.hpp"
+#include "frame_buffer.hpp"
 #include "layer.hpp"
+#include "serial.hpp"
 
 Console::Console(const PixelColor &fgColor_, const PixelColor &bgColor_)
     : writer(nullptr),
@@ -15,6 +17,9 @@ Console::Console(const PixelColor &fgColor_, const PixelColor &bgColor_)
       cursorColumns(0) {}
 
 void Console::PutString(const char *str) {
+  const int first_row = cursorRow;
+  scroll_lines = 0;
+
   while (*str) {
     if (*str == '\n') {
       NewLine();
@@ -29,10 +34,12 @@ void Console::PutString(const char *str) {
     ++str;
   }
   if (layer_manager) {
-    layer_manager->Draw(this->layer_id);
+    Flush(first_row);
   }
 }
 
+void Console::Flush(int first_row) { layer_manager->Draw(this->layer_id); }
+
 void Console::SetWriter(PixelWriter &writer) {
   if (this->writer == &writer) {
     return;
@@ -49,12 +56,24 @@ void Console::NewLine() {
     return;
   }
 
-  FillRect(*writer, {0, 0}, {8 * kColumns, 16 * kRows}, bgColor);
+  ++scroll_lines;
   for (int row = 0; row < kRows - 1; ++row) {
     memcpy(buffer[row], buffer[row + 1], kColumns + 1);
-    WriteString(*writer, 0, 16 * row, fgColor, buffer[row]);
   }
   memset(buffer[kRows - 1], 0, kColumns + 1);
+
+  if (frame_config) {
+    // 描画先のフレームバッファが分かっていれば画素ごと上にずらす
+    MoveFrameBufferArea(*frame_config, {0, 0},
+                        {{0, 16}, {8 * kColumns, 16 * (kRows - 1)}});
+    FillRect(*writer, {0, 16 * (kRows - 1)}, {8 * kColumns, 16}, bgColor);
+    return;
+  }
+
+  FillRect(*writer, {0, 0}, {8 * kColumns, 16 * kRows}, bgColor);
+  for (int row = 0; row < kRows - 1; ++row) {
+    WriteString(*writer, 0, 16 * row, fgColor, buffer[row]);
+  }
 }
 
 void Console::Refresh() {
@@ -87,11 +106,30 @@ void WindowConsole::NewLine() {
     return;
   }
 
+  ++scroll_lines;
   Rectangle<int> move_src{{0, 16}, {8 * kColumns, 16 * (kRows - 1)}};
   window->Move({0, 0}, move_src);
   FillRect(*writer, {0, 16 * (kRows - 1)}, {8 * kColumns, 16}, bgColor);
 }
 
+void WindowConsole::Flush(int first_row) {
+  const Rectangle<int> text_area{ToplevelWindow::kTopLeftMargin,
+                                 {8 * kColumns, 16 * kRows}};
+  if (scroll_lines >= kRows) {
+    layer_manager->Draw(layer_id, text_area);
+    return;
+  }
+
+  int top = first_row;
+  if (scroll_lines > 0) {
+    layer_manager->Scroll(layer_id, text_area, 16 * scroll_lines);
+    top = std::max(first_row - scroll_lines, 0);
+  }
+
+  layer_manager->Draw(layer_id, {text_area.pos + Vector2D<int>{0, 16 * top},
+                                 {8 * kColumns, 16 * (cursorRow - top + 1)}});
+}
+
 Console *direct_console;
 WindowConsole *console;
 
@@ -104,6 +142,7 @@ void InitializeDirectConsole() {
   direct_console =
       new (direct_console_buf) Console(kConsoleCharColor, kDesktopBGColor);
   direct_console->SetWriter(*::screen_writer.get());
+  direct_console->SetFrameBufferConfig(&::screen_config);
 }
 
 void InitializeWindowConsole() {
@@ -131,5 +170,6 @@ int printk(const char *format, ...) {
   result = vsprintf(s, format, ap);
   va_end(ap);
   direct_console->PutString(s);
+  serial::Write(s);
   return result;
 }
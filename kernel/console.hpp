@@ -10,17 +10,23 @@ class Console {
   Console(const PixelColor &fgColor, const PixelColor &bgColor);
   void PutString(const char *a);
   void SetWriter(PixelWriter &writer);
+  void SetFrameBufferConfig(const FrameBufferConfig *config) {
+    frame_config = config;
+  }
   void SetLayerID(unsigned int id) { layer_id = id; }
   unsigned int LayerID() const;
 
  protected:
   virtual void NewLine();
+  virtual void Flush(int first_row);
   void Refresh();
   PixelWriter *writer;
+  const FrameBufferConfig *frame_config{nullptr};
   const PixelColor fgColor, bgColor;
   char buffer[kRows][kColumns + 1];
   int cursorRow;
   int cursorColumns;
+  int scroll_lines{0};
   unsigned int layer_id;
 
   friend int printk(const char *format, ...);
@@ -33,6 +39,7 @@ class WindowConsole : public Console {
                 const std::shared_ptr<ToplevelWindow> &window);
   void SetWindow(const std::shared_ptr<ToplevelWindow> &window);
   void NewLine() override;
+  void Flush(int first_row) override;
 
  private:
   std::shared_ptr<ToplevelWindow> window;
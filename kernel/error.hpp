@@ -30,6 +30,11 @@ class Error {
     kNoPCIMSI,
     kUnknownPixelFormat,
     kNoSuchTask,
+    kNoSuchFile,
+    kFreeTypeError,
+    kIOError,
+    kInvalidFormat,
+    kBusy,
     kLastOfCode,  // この列挙子は常に最後に配置する
   };
 
@@ -55,9 +60,14 @@ class Error {
       "kInvalidPhase",
       "kUnknownXHCISpeedID",
       "kNoWaiter",
+      "kNoPCIMSI",
       "kUnknownPixelFormat",
       "kNoSuchTask",
-      "kNoPCIMSI",
+      "kNoSuchFile",
+      "kFreeTypeError",
+      "kIOError",
+      "kInvalidFormat",
+      "kBusy",
   };
   static_assert(Error::Code::kLastOfCode == code_names_.size());
 
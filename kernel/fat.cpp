@@ -1,53 +1,438 @@
 #include "fat.hpp"
 
+#include <stdio.h>
+
+#include <algorithm>
 #include <cstring>
+#include <map>
+
+#include "logger.hpp"
+#include "paging.hpp"
+#include "perf.hpp"
+
+namespace {
+PerfRegion find_file_perf{"fat::FindFile"};
+
+// BPB から毎回計算しないよう，初期化時に求めておく
+size_t fat_offset;
+size_t data_offset;
+
+fat::BPB volume_bpb;
+
+/* FAT 全体の写し．書き込みはここに対して行い，変更したセクタに印をつけて
+   Sync でまとめて書き出す．free_bitmap は空きクラスタに 1 が立つ． */
+std::vector<uint32_t> fat_entries;
+std::vector<bool> fat_sector_dirty;
+bool fat_modified;
+std::vector<uint64_t> free_bitmap;
+unsigned long num_clusters;  // 有効なクラスタ番号は 2 以上 num_clusters 未満
+unsigned long alloc_hint;
+
+struct FileMapping {
+  uintptr_t addr;
+  size_t bytes;
+  uint8_t* buffer;  // 集めてからマップした場合のバッファ
+  int refs;         // MapFile から UnmapFile までの間，使っている数
+};
+// ファイルの先頭クラスタをキーとする
+std::map<unsigned long, FileMapping> file_mappings;
+// ファイルが書き換えられた後も使われ続けているマップ
+std::vector<FileMapping> detached_mappings;
+
+const size_t kMapPageBytes = 4096;
+
+void ReleaseMapping(FileMapping& mapping) {
+  Unmap(mapping.addr, mapping.bytes);
+  delete[] mapping.buffer;
+}
+
+/* ファイルを書き換える前に呼ぶ．誰も使っていなければマップを解除する．
+   フォントのようにまだ使われていれば，今の内容の写しに向け直して
+   file_mappings から外し，UnmapFile されるまで残しておく． */
+void InvalidateMapping(unsigned long first_cluster) {
+  auto it = file_mappings.find(first_cluster);
+  if (it == file_mappings.end()) {
+    return;
+  }
+  auto& mapping = it->second;
+  if (mapping.refs == 0) {
+    ReleaseMapping(mapping);
+  } else {
+    if (!mapping.buffer) {
+      // ページ内の位置を addr とそろえるため，1 ページ余分に確保する
+      mapping.buffer = new uint8_t[mapping.bytes + kMapPageBytes];
+      auto copy = mapping.buffer +
+                  (mapping.addr - reinterpret_cast<uintptr_t>(mapping.buffer)) %
+                      kMapPageBytes;
+      memcpy(copy, reinterpret_cast<const void*>(mapping.addr), mapping.bytes);
+      Remap(mapping.addr, reinterpret_cast<uintptr_t>(copy), mapping.bytes);
+    }
+    detached_mappings.push_back(mapping);
+  }
+  file_mappings.erase(it);
+}
+
+// 使われていないマップをすべて解除し，解除したかどうかを返す
+bool ReleaseUnusedMappings() {
+  bool released = false;
+  for (auto it = file_mappings.begin(); it != file_mappings.end();) {
+    if (it->second.refs == 0) {
+      ReleaseMapping(it->second);
+      it = file_mappings.erase(it);
+      released = true;
+    } else {
+      ++it;
+    }
+  }
+  return released;
+}
+
+// 4KiB を 1 ラインとして 4MiB 分をキャッシュし，ミス時は 16KiB 先読みする
+const size_t kCacheLineSectors = 8;
+const size_t kCacheLines = 1024;
+const size_t kCacheReadAheadLines = 4;
+
+std::map<unsigned long, std::vector<fat::Extent>> extent_cache;
+std::map<unsigned long, fat::DirectoryIndex> directory_indexes;
+
+std::string NormalizeName(const std::string& name) {
+  std::string normalized(name);
+  for (auto& c : normalized) {
+    if (static_cast<unsigned char>(c) < 0x80) {
+      c = toupper(c);
+    }
+  }
+  return normalized;
+}
+
+uint8_t ShortNameChecksum(const fat::DirectoryEntry& entry) {
+  uint8_t sum = 0;
+  for (int i = 0; i < 11; ++i) {
+    sum = ((sum & 1) << 7) + (sum >> 1) + entry.name[i];
+  }
+  return sum;
+}
+
+void CopyLongNameChars(const fat::LongNameEntry& lfn, uint16_t* dst) {
+  for (int i = 0; i < 5; ++i) *dst++ = lfn.name1[i];
+  for (int i = 0; i < 6; ++i) *dst++ = lfn.name2[i];
+  for (int i = 0; i < 2; ++i) *dst++ = lfn.name3[i];
+}
+
+// UCS-2 の長い名前を UTF-8 に変換する
+std::string DecodeLongName(const std::vector<uint16_t>& chars) {
+  std::string name;
+  for (auto c : chars) {
+    if (c == 0x0000 || c == 0xffff) {
+      break;
+    }
+    if (c < 0x80) {
+      name.push_back(c);
+    } else if (c < 0x800) {
+      name.push_back(0xc0 | (c >> 6));
+      name.push_back(0x80 | (c & 0x3f));
+    } else {
+      name.push_back(0xe0 | (c >> 12));
+      name.push_back(0x80 | ((c >> 6) & 0x3f));
+      name.push_back(0x80 | (c & 0x3f));
+    }
+  }
+  return name;
+}
+
+fat::DirectoryIndex& BuildDirectoryIndex(unsigned long directory_cluster) {
+  auto& index = directory_indexes[directory_cluster];
+
+  std::vector<uint16_t> lfn_chars;
+  uint8_t lfn_checksum = 0;
+
+  std::vector<uint8_t> buf(fat::bytes_per_cluster);
+  auto dir = reinterpret_cast<fat::DirectoryEntry*>(buf.data());
+
+  for (auto cluster = directory_cluster; cluster != fat::kEndOfClusterchain;
+       cluster = fat::NextCluster(cluster)) {
+    if (fat::ReadCluster(cluster, buf.data())) {
+      return index;
+    }
+    for (int i = 0; i < fat::bytes_per_cluster / sizeof(fat::DirectoryEntry);
+         ++i) {
+      if (dir[i].name[0] == 0x00) {
+        return index;
+      } else if (dir[i].name[0] == 0xe5) {
+        lfn_chars.clear();
+        continue;
+      }
+
+      if (dir[i].attr == fat::Attribute::kLongName) {
+        /* 長い名前は末尾側のエントリから順に並ぶ．
+           最初に現れるエントリ（ord に 0x40 が立つ）で全体の長さが分かる． */
+        const auto& lfn = reinterpret_cast<const fat::LongNameEntry&>(dir[i]);
+        const int seq = lfn.ord & 0x1f;
+        if (lfn.ord & 0x40) {
+          lfn_chars.assign(seq * 13, 0xffff);
+          lfn_checksum = lfn.checksum;
+        } else if (lfn.checksum != lfn_checksum) {
+          lfn_chars.clear();
+        }
+        if (seq == 0 || seq * 13 > lfn_chars.size()) {
+          lfn_chars.clear();
+          continue;
+        }
+        CopyLongNameChars(lfn, &lfn_chars[(seq - 1) * 13]);
+        continue;
+      }
+
+      if (static_cast<uint8_t>(dir[i].attr) &
+          static_cast<uint8_t>(fat::Attribute::kVolumeID)) {
+        lfn_chars.clear();
+        continue;
+      }
+
+      auto [base, ext] = fat::ReadName(dir[i]);
+      fat::IndexedEntry e{dir[i], ext.empty() ? base : base + "." + ext, "",
+                          cluster, i};
+      if (!lfn_chars.empty() && ShortNameChecksum(dir[i]) == lfn_checksum) {
+        e.long_name = DecodeLongName(lfn_chars);
+      }
+      lfn_chars.clear();
+
+      const size_t n = index.entries.size();
+      index.by_name[NormalizeName(e.short_name)] = n;
+      if (!e.long_name.empty()) {
+        index.by_name[NormalizeName(e.long_name)] = n;
+      }
+      index.entries.push_back(std::move(e));
+    }
+  }
+
+  return index;
+}
+
+fat::DirectoryIndex& GetIndex(unsigned long directory_cluster) {
+  if (directory_cluster == 0) {
+    directory_cluster = fat::boot_volume_image->root_cluster;
+  }
+  if (auto it = directory_indexes.find(directory_cluster);
+      it != directory_indexes.end()) {
+    return it->second;
+  }
+  return BuildDirectoryIndex(directory_cluster);
+}
+
+struct ResolvedPath {
+  fat::DirectoryIndex* directory;
+  fat::IndexedEntry* entry;
+};
+
+ResolvedPath ResolvePath(const char* name, unsigned long directory_cluster) {
+  if (name[0] == '/') {
+    directory_cluster = 0;
+    ++name;
+  }
+
+  ResolvedPath result{nullptr, nullptr};
+  while (true) {
+    const char* slash = strchr(name, '/');
+    const std::string component =
+        slash ? std::string(name, slash) : std::string(name);
+    if (component.empty()) {
+      if (!slash) {
+        return result;
+      }
+      name = slash + 1;
+      continue;
+    }
+
+    auto& index = GetIndex(directory_cluster);
+    auto it = index.by_name.find(NormalizeName(component));
+    if (it == index.by_name.end()) {
+      return {nullptr, nullptr};
+    }
+    result = {&index, &index.entries[it->second]};
+
+    if (!slash) {
+      return result;
+    } else if (!fat::IsDirectory(result.entry->entry)) {
+      return {nullptr, nullptr};
+    }
+    // ".." がルートを指すとき，先頭クラスタは 0 になっている
+    directory_cluster = result.entry->entry.FirstCluster();
+    name = slash + 1;
+  }
+}
+
+// offset から len バイトをファイルのクラスタとの間で転送する．
+// 範囲はクラスタチェーンの内側になければならない
+size_t TransferFile(const fat::DirectoryEntry& entry, size_t offset,
+                    uint8_t* buf, size_t len, bool write) {
+  const auto bpc = fat::bytes_per_cluster;
+  const auto& extents = fat::GetExtents(entry.FirstCluster());
+  auto it = std::upper_bound(
+      extents.begin(), extents.end(), offset / bpc,
+      [](unsigned long c, const fat::Extent& e) { return c < e.file_cluster; });
+  if (it == extents.begin()) {
+    return 0;
+  }
+  --it;
+
+  size_t total = 0;
+  for (; it != extents.end() && total < len; ++it) {
+    const size_t extent_offset = offset + total - it->file_cluster * bpc;
+    const size_t extent_bytes = it->length * bpc - extent_offset;
+    const size_t n = std::min(len - total, extent_bytes);
+    const size_t volume_offset =
+        fat::ClusterOffset(it->cluster) + extent_offset;
+    auto err = write ? fat::volume_cache->Write(volume_offset, buf + total, n)
+                     : fat::volume_cache->Read(volume_offset, buf + total, n);
+    if (err) {
+      break;
+    }
+    total += n;
+  }
+  return total;
+}
+}  // namespace
 
 namespace fat {
 BPB* boot_volume_image;
+BlockCache* volume_cache;
 unsigned long bytes_per_cluster;
 
-void Initialize(void* volume_image) {
-  boot_volume_image = reinterpret_cast<fat::BPB*>(volume_image);
-  bytes_per_cluster =
-      static_cast<unsigned long>(boot_volume_image->bytes_per_sector) *
-      boot_volume_image->sectors_per_cluster;
+Error Initialize(BlockDevice& device) {
+  std::vector<uint8_t> sector0(device.SectorSize());
+  if (auto err = device.Read(sector0.data(), 0, 1)) {
+    return err;
+  }
+  if (sector0[510] != 0x55 || sector0[511] != 0xaa ||
+      memcmp(sector0.data() + offsetof(BPB, fs_type), "FAT32", 5) != 0) {
+    return MAKE_ERROR(Error::kInvalidFormat);
+  }
+
+  /* 使っているボリュームを壊さないよう，新しいボリュームはすべてローカル変数
+     に読み込んで確かめ，最後にまとめて差し替える． */
+  BPB bpb;
+  memcpy(&bpb, sector0.data(), sizeof(bpb));
+  if (bpb.bytes_per_sector == 0 || bpb.sectors_per_cluster == 0 ||
+      bpb.num_fats == 0 || bpb.fat_size_32 == 0) {
+    return MAKE_ERROR(Error::kInvalidFormat);
+  }
+
+  const unsigned long new_bytes_per_cluster =
+      static_cast<unsigned long>(bpb.bytes_per_sector) *
+      bpb.sectors_per_cluster;
+  const unsigned long fat_sector = bpb.reserved_sector_count;
+  const unsigned long data_sector =
+      fat_sector + bpb.num_fats * bpb.fat_size_32;
+
+  /* BPB の総セクタ数よりデバイスが小さいことがある（ローダが先頭しか
+     読み込まなかったときなど）．デバイスに収まるクラスタだけを使う． */
+  const unsigned long bpb_sectors =
+      bpb.total_sectors_16 ? bpb.total_sectors_16 : bpb.total_sectors_32;
+  const unsigned long device_sectors =
+      device.SectorCount() * device.SectorSize() / bpb.bytes_per_sector;
+  const unsigned long total_sectors = std::min(bpb_sectors, device_sectors);
+  if (total_sectors <= data_sector) {
+    return MAKE_ERROR(Error::kInvalidFormat);
+  }
+
+  auto cache = new BlockCache(device, kCacheLineSectors, kCacheLines,
+                              kCacheReadAheadLines);
+  const size_t new_fat_offset = fat_sector * bpb.bytes_per_sector;
+  const size_t fat_bytes =
+      static_cast<size_t>(bpb.fat_size_32) * bpb.bytes_per_sector;
+  std::vector<uint32_t> entries(fat_bytes / sizeof(uint32_t), 0);
+  if (auto err = cache->Read(new_fat_offset, entries.data(), fat_bytes)) {
+    delete cache;
+    return err;
+  }
+
+  const unsigned long data_clusters =
+      (total_sectors - data_sector) / bpb.sectors_per_cluster;
+  const unsigned long new_num_clusters =
+      std::min<unsigned long>(data_clusters + 2, entries.size());
+  std::vector<uint64_t> bitmap((new_num_clusters + 63) / 64, 0);
+  for (unsigned long c = 2; c < new_num_clusters; ++c) {
+    if ((entries[c] & 0x0ffffffful) == 0) {
+      bitmap[c / 64] |= 1ull << (c % 64);
+    }
+  }
+
+  // ここから先は失敗しない
+  volume_bpb = bpb;
+  boot_volume_image = &volume_bpb;
+  bytes_per_cluster = new_bytes_per_cluster;
+  fat_offset = new_fat_offset;
+  data_offset = data_sector * bpb.bytes_per_sector;
+
+  delete volume_cache;
+  volume_cache = cache;
+  extent_cache.clear();
+  directory_indexes.clear();
+  // 以前のボリュームのマップは，使用中のものだけ写しに向け直して残す
+  while (!file_mappings.empty()) {
+    InvalidateMapping(file_mappings.begin()->first);
+  }
+
+  fat_entries = std::move(entries);
+  fat_sector_dirty.assign(bpb.fat_size_32, false);
+  fat_modified = false;
+  num_clusters = new_num_clusters;
+  free_bitmap = std::move(bitmap);
+  alloc_hint = 2;
+
+  return MAKE_ERROR(Error::kSuccess);
 }
 
-uintptr_t GetClusterAddr(unsigned long cluster) {
-  unsigned long sector_num =
-      boot_volume_image->reserved_sector_count +
-      boot_volume_image->num_fats * boot_volume_image->fat_size_32 +
-      (cluster - 2) * boot_volume_image->sectors_per_cluster;
+void Initialize(void* volume_image, size_t loaded_bytes) {
+  auto bpb = reinterpret_cast<BPB*>(volume_image);
+  if (bpb->bytes_per_sector == 0) {
+    Log(kError, "the RAM volume has no valid BPB\n");
+    return;
+  }
+  const size_t bpb_sectors =
+      bpb->total_sectors_16 ? bpb->total_sectors_16 : bpb->total_sectors_32;
+  // 読み込まれていない部分を RAM ディスクに含めると，その先を読み書きしてしまう
+  const size_t sectors =
+      std::min(bpb_sectors, loaded_bytes / bpb->bytes_per_sector);
+  auto ram_device =
+      new RAMBlockDevice(volume_image, bpb->bytes_per_sector, sectors);
+  if (auto err = Initialize(*ram_device)) {
+    Log(kError, "failed to initialize the RAM volume: %s at %s:%d\n",
+        err.Name(), err.File(), err.Line());
+  }
+}
+
+size_t ClusterOffset(unsigned long cluster) {
+  return data_offset + (cluster - 2) * bytes_per_cluster;
+}
 
-  uintptr_t offset = sector_num * boot_volume_image->bytes_per_sector;
-  return reinterpret_cast<uintptr_t>(boot_volume_image) + offset;
+Error ReadCluster(unsigned long cluster, void* buf) {
+  return volume_cache->Read(ClusterOffset(cluster), buf, bytes_per_cluster);
 }
 
 std::tuple<std::string, std::string> ReadName(const DirectoryEntry& entry) {
   std::string base;
   base.resize(8);
   memcpy(&base[0], &entry.name[0], 8);
-  for (int i = 7; i >= 0 && base[i] == 0x20; --i) {
-    base[i] = 0;
+  while (!base.empty() && base.back() == 0x20) {
+    base.pop_back();
   }
 
   std::string ext;
   ext.resize(3);
-  for (int i = 2; i >= 0 && ext[i] == 0x20; --i) {
-    ext[i] = 0;
+  memcpy(&ext[0], &entry.name[8], 3);
+  while (!ext.empty() && ext.back() == 0x20) {
+    ext.pop_back();
   }
 
   return std::make_tuple(base, ext);
 }
 
 unsigned long NextCluster(unsigned long cluster) {
-  uintptr_t fat_offset = boot_volume_image->reserved_sector_count *
-                         boot_volume_image->bytes_per_sector;
-
-  uint32_t* fat = reinterpret_cast<uint32_t*>(
-      reinterpret_cast<uintptr_t>(boot_volume_image) + fat_offset);
-
-  uint32_t next = fat[cluster];
+  if (cluster >= fat_entries.size()) {
+    return kEndOfClusterchain;
+  }
+  uint32_t next = fat_entries[cluster] & 0x0ffffffful;
   if (next >= 0x0ffffff8ul) {
     return kEndOfClusterchain;
   }
@@ -55,21 +440,14 @@ unsigned long NextCluster(unsigned long cluster) {
 }
 
 DirectoryEntry* FindFile(const char* name, unsigned long directory_cluster) {
-  if (directory_cluster == 0) {
-    directory_cluster = boot_volume_image->root_cluster;
-  }
-  while (directory_cluster != kEndOfClusterchain) {
-    auto dir = GetSectorByCluster<DirectoryEntry>(directory_cluster);
-    for (int i = 0; i < bytes_per_cluster / sizeof(DirectoryEntry); ++i) {
-      if (NameIsEqual(dir[i], name)) {
-        return &dir[i];
-      }
-    }
-
-    directory_cluster = NextCluster(directory_cluster);
-  }
+  ScopedPerfCounter perf{find_file_perf};
+  auto file = FindIndexedEntry(name, directory_cluster);
+  return file ? &file->entry : nullptr;
+}
 
-  return nullptr;
+IndexedEntry* FindIndexedEntry(const char* name,
+                               unsigned long directory_cluster) {
+  return ResolvePath(name, directory_cluster).entry;
 }
 
 bool NameIsEqual(const DirectoryEntry& entry, const char* name) {
@@ -88,4 +466,603 @@ bool NameIsEqual(const DirectoryEntry& entry, const char* name) {
   return memcmp(entry.name, name83, sizeof(name83)) == 0;
 }
 
+const std::vector<Extent>& GetExtents(unsigned long first_cluster) {
+  static const std::vector<Extent> kNoExtents;
+  if (first_cluster == 0) {
+    return kNoExtents;
+  }
+  if (auto it = extent_cache.find(first_cluster); it != extent_cache.end()) {
+    return it->second;
+  }
+
+  auto& extents = extent_cache[first_cluster];
+  unsigned long file_cluster = 0;
+  auto cluster = first_cluster;
+  while (cluster != 0 && cluster != kEndOfClusterchain) {
+    if (!extents.empty()) {
+      auto& last = extents.back();
+      if (last.cluster + last.length == cluster) {
+        ++last.length;
+        ++file_cluster;
+        cluster = NextCluster(cluster);
+        continue;
+      }
+    }
+    extents.push_back({file_cluster, cluster, 1});
+    ++file_cluster;
+    cluster = NextCluster(cluster);
+  }
+  return extents;
+}
+
+void InvalidateExtents(unsigned long first_cluster) {
+  extent_cache.erase(first_cluster);
+}
+
+const DirectoryIndex& GetDirectoryIndex(unsigned long directory_cluster) {
+  return GetIndex(directory_cluster);
+}
+
+void InvalidateDirectoryIndex(unsigned long directory_cluster) {
+  if (directory_cluster == 0) {
+    directory_cluster = boot_volume_image->root_cluster;
+  }
+  directory_indexes.erase(directory_cluster);
+}
+
+bool IsDirectory(const DirectoryEntry& entry) {
+  return static_cast<uint8_t>(entry.attr) &
+         static_cast<uint8_t>(Attribute::kDirectory);
+}
+
+size_t ReadFile(const DirectoryEntry& entry, size_t offset, void* buf,
+                size_t len) {
+  if (offset >= entry.file_size) {
+    return 0;
+  }
+  len = std::min<size_t>(len, entry.file_size - offset);
+
+  return TransferFile(entry, offset, reinterpret_cast<uint8_t*>(buf), len,
+                      false);
+}
+
+namespace {
+void SetFATEntry(unsigned long cluster, unsigned long value) {
+  fat_entries[cluster] =
+      (fat_entries[cluster] & 0xf0000000ul) | (value & 0x0ffffffful);
+  fat_sector_dirty[cluster * sizeof(uint32_t) /
+                   boot_volume_image->bytes_per_sector] = true;
+  fat_modified = true;
+
+  const uint64_t bit = 1ull << (cluster % 64);
+  if (value == 0) {
+    free_bitmap[cluster / 64] |= bit;
+  } else {
+    free_bitmap[cluster / 64] &= ~bit;
+  }
+}
+
+/* 空きクラスタを 1 つ確保して終端にする．
+   hint 以降を優先して探すので，続けて確保すると連続したクラスタになりやすい．
+   空きがなければ 0 を返す． */
+unsigned long AllocateCluster(unsigned long hint) {
+  if (hint < 2 || hint >= num_clusters) {
+    hint = alloc_hint;
+  }
+
+  const size_t num_words = free_bitmap.size();
+  for (size_t n = 0; n <= num_words; ++n) {
+    const size_t word = (hint / 64 + n) % num_words;
+    uint64_t bits = free_bitmap[word];
+    if (n == 0) {
+      bits &= ~0ull << (hint % 64);
+    }
+    if (bits == 0) {
+      continue;
+    }
+
+    const unsigned long cluster = word * 64 + __builtin_ctzll(bits);
+    SetFATEntry(cluster, kEndOfClusterchain);
+    alloc_hint = cluster + 1 < num_clusters ? cluster + 1 : 2;
+    return cluster;
+  }
+  return 0;
+}
+
+void FreeClusterChain(unsigned long cluster) {
+  while (cluster != 0 && cluster != kEndOfClusterchain) {
+    const auto next = NextCluster(cluster);
+    SetFATEntry(cluster, 0);
+    cluster = next;
+  }
+}
+
+Error WriteDirectoryEntry(const IndexedEntry& file) {
+  return volume_cache->Write(
+      ClusterOffset(file.cluster) + file.index * sizeof(DirectoryEntry),
+      &file.entry, sizeof(DirectoryEntry));
+}
+
+void SetFirstCluster(DirectoryEntry& entry, unsigned long cluster) {
+  entry.first_cluster_low = cluster & 0xffffu;
+  entry.first_cluster_high = (cluster >> 16) & 0xffffu;
+}
+
+/* ファイルのクラスタチェーンを num_file_clusters 個まで伸ばす．
+   空きが足りなければ，この呼び出しで足したクラスタを解放して kFull を返す． */
+Error ExtendClusterChain(IndexedEntry& file, size_t num_file_clusters) {
+  auto& entry = file.entry;
+  size_t have = 0;
+  unsigned long last = 0;
+  if (const auto& extents = GetExtents(entry.FirstCluster());
+      !extents.empty()) {
+    have = extents.back().file_cluster + extents.back().length;
+    last = extents.back().cluster + extents.back().length - 1;
+  }
+  const unsigned long old_last = last;
+
+  while (have < num_file_clusters) {
+    const auto cluster = AllocateCluster(last + 1);
+    if (cluster == 0) {
+      if (last != old_last) {
+        const auto added =
+            old_last == 0 ? entry.FirstCluster() : NextCluster(old_last);
+        InvalidateExtents(entry.FirstCluster());
+        if (old_last == 0) {
+          SetFirstCluster(entry, 0);
+        } else {
+          SetFATEntry(old_last, kEndOfClusterchain);
+        }
+        FreeClusterChain(added);
+      }
+      return MAKE_ERROR(Error::kFull);
+    }
+    if (last == 0) {
+      SetFirstCluster(entry, cluster);
+    } else {
+      SetFATEntry(last, cluster);
+    }
+
+    // チェーンを辿り直さずに済むよう，キャッシュ済みのエクステントを伸ばす
+    auto& extents = extent_cache[entry.FirstCluster()];
+    if (!extents.empty() &&
+        extents.back().cluster + extents.back().length == cluster) {
+      ++extents.back().length;
+    } else {
+      extents.push_back({have, cluster, 1});
+    }
+    last = cluster;
+    ++have;
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+// 名前を 8.3 形式のディレクトリエントリ名に変換する．収まらなければ false
+bool MakeShortName(const char* name, unsigned char* name83) {
+  memset(name83, 0x20, 11);
+  const char* dot = strrchr(name, '.');
+  const size_t base_len = dot ? dot - name : strlen(name);
+  const size_t ext_len = dot ? strlen(dot + 1) : 0;
+  if (base_len == 0 || base_len > 8 || ext_len > 3) {
+    return false;
+  }
+
+  auto convert = [](const char* src, size_t len, unsigned char* dst) {
+    for (size_t i = 0; i < len; ++i) {
+      const unsigned char c = src[i];
+      if (c <= 0x20 || c >= 0x7f || strchr("\"*+,./:;<=>?[\\]|", c)) {
+        return false;
+      }
+      dst[i] = toupper(c);
+    }
+    return true;
+  };
+  return convert(name, base_len, name83) &&
+         convert(dot ? dot + 1 : "", ext_len, name83 + 8);
+}
+
+struct DirectorySlot {
+  unsigned long cluster;
+  int index;
+};
+
+// ディレクトリの空きエントリを探す．なければクラスタを 1 つ足す
+WithError<DirectorySlot> AllocateDirectoryEntry(unsigned long dir_cluster) {
+  const int entries_per_cluster = bytes_per_cluster / sizeof(DirectoryEntry);
+  std::vector<uint8_t> buf(bytes_per_cluster);
+  auto dir = reinterpret_cast<DirectoryEntry*>(buf.data());
+
+  unsigned long last = dir_cluster;
+  for (auto cluster = dir_cluster; cluster != kEndOfClusterchain;
+       cluster = NextCluster(cluster)) {
+    if (auto err = ReadCluster(cluster, buf.data())) {
+      return {{}, err};
+    }
+    for (int i = 0; i < entries_per_cluster; ++i) {
+      if (dir[i].name[0] == 0x00 || dir[i].name[0] == 0xe5) {
+        return {{cluster, i}, MAKE_ERROR(Error::kSuccess)};
+      }
+    }
+    last = cluster;
+  }
+
+  const auto cluster = AllocateCluster(last + 1);
+  if (cluster == 0) {
+    return {{}, MAKE_ERROR(Error::kFull)};
+  }
+  SetFATEntry(last, cluster);
+  InvalidateExtents(dir_cluster);
+
+  memset(buf.data(), 0, buf.size());
+  if (auto err = volume_cache->Write(ClusterOffset(cluster), buf.data(),
+                                     buf.size())) {
+    return {{}, err};
+  }
+  return {{cluster, 0}, MAKE_ERROR(Error::kSuccess)};
+}
+}  // namespace
+
+WithError<IndexedEntry*> CreateFile(const char* path) {
+  if (auto file = FindIndexedEntry(path)) {
+    return {file, MAKE_ERROR(Error::kSuccess)};
+  }
+
+  unsigned long dir_cluster = boot_volume_image->root_cluster;
+  const char* name = path;
+  if (const char* slash = strrchr(path, '/')) {
+    name = slash + 1;
+    if (slash != path) {
+      const std::string dir_path(path, slash);
+      auto dir = FindIndexedEntry(dir_path.c_str());
+      if (!dir || !IsDirectory(dir->entry)) {
+        return {nullptr, MAKE_ERROR(Error::kNoSuchFile)};
+      }
+      if (dir->entry.FirstCluster() != 0) {
+        dir_cluster = dir->entry.FirstCluster();
+      }
+    }
+  }
+
+  DirectoryEntry entry{};
+  if (!MakeShortName(name, entry.name)) {
+    return {nullptr, MAKE_ERROR(Error::kNotImplemented)};
+  }
+  entry.attr = Attribute::kArchive;
+
+  auto [slot, err] = AllocateDirectoryEntry(dir_cluster);
+  if (err) {
+    return {nullptr, err};
+  }
+
+  auto& index = GetIndex(dir_cluster);
+  auto [base, ext] = ReadName(entry);
+  index.by_name[NormalizeName(ext.empty() ? base : base + "." + ext)] =
+      index.entries.size();
+  auto& file = index.entries.emplace_back(IndexedEntry{
+      entry, ext.empty() ? base : base + "." + ext, "", slot.cluster,
+      slot.index});
+
+  if (auto err = WriteDirectoryEntry(file)) {
+    return {nullptr, err};
+  }
+  return {&file, MAKE_ERROR(Error::kSuccess)};
+}
+
+WithError<size_t> WriteFile(IndexedEntry& file, size_t offset,
+                            const void* buf, size_t len) {
+  auto& entry = file.entry;
+  const size_t end = offset + len;
+  if (end > 0xfffffffful) {
+    return {0, MAKE_ERROR(Error::kFull)};
+  }
+  InvalidateMapping(entry.FirstCluster());
+
+  const size_t num_file_clusters =
+      (end + bytes_per_cluster - 1) / bytes_per_cluster;
+  if (auto err = ExtendClusterChain(file, num_file_clusters)) {
+    return {0, err};
+  }
+
+  // 末尾より後ろから書く場合は間を 0 で埋める
+  if (offset > entry.file_size) {
+    uint8_t zeros[512] = {};
+    for (size_t pos = entry.file_size; pos < offset;) {
+      const size_t n = std::min(sizeof(zeros), offset - pos);
+      TransferFile(entry, pos, zeros, n, true);
+      pos += n;
+    }
+  }
+
+  const size_t written = TransferFile(
+      entry, offset, reinterpret_cast<uint8_t*>(const_cast<void*>(buf)), len,
+      true);
+  if (offset + written > entry.file_size) {
+    entry.file_size = offset + written;
+  }
+  if (auto err = WriteDirectoryEntry(file)) {
+    return {written, err};
+  }
+  return {written, MAKE_ERROR(Error::kSuccess)};
+}
+
+Error TruncateFile(IndexedEntry& file, size_t size) {
+  auto& entry = file.entry;
+  if (size >= entry.file_size) {
+    return WriteFile(file, size, nullptr, 0).error;
+  }
+
+  const auto first = entry.FirstCluster();
+  const size_t keep = (size + bytes_per_cluster - 1) / bytes_per_cluster;
+  InvalidateMapping(first);
+  if (first != 0) {
+    unsigned long last = 0;
+    auto cluster = first;
+    for (size_t i = 0; i < keep; ++i) {
+      last = cluster;
+      cluster = NextCluster(cluster);
+    }
+    if (last == 0) {
+      SetFirstCluster(entry, 0);
+    } else {
+      SetFATEntry(last, kEndOfClusterchain);
+    }
+    FreeClusterChain(cluster);
+    InvalidateExtents(first);
+  }
+
+  entry.file_size = size;
+  return WriteDirectoryEntry(file);
+}
+
+Error DeleteFile(const char* path) {
+  auto [index, file] = ResolvePath(path, 0);
+  if (!file) {
+    return MAKE_ERROR(Error::kNoSuchFile);
+  } else if (IsDirectory(file->entry)) {
+    return MAKE_ERROR(Error::kNotImplemented);
+  } else if (file->open_count > 0) {
+    // 記述子がこのエントリとクラスタを使い続けるので，閉じるまで消さない
+    return MAKE_ERROR(Error::kBusy);
+  }
+
+  const auto first = file->entry.FirstCluster();
+  InvalidateMapping(first);
+  FreeClusterChain(first);
+  InvalidateExtents(first);
+
+  // 短い名前のエントリと，同じクラスタにある直前の長い名前のエントリを消す
+  std::vector<uint8_t> buf(bytes_per_cluster);
+  auto dir = reinterpret_cast<DirectoryEntry*>(buf.data());
+  if (auto err = ReadCluster(file->cluster, buf.data())) {
+    return err;
+  }
+  dir[file->index].name[0] = 0xe5;
+  for (int i = file->index - 1;
+       i >= 0 && dir[i].attr == Attribute::kLongName; --i) {
+    dir[i].name[0] = 0xe5;
+  }
+  if (auto err = volume_cache->Write(ClusterOffset(file->cluster), buf.data(),
+                                     buf.size())) {
+    return err;
+  }
+
+  index->by_name.erase(NormalizeName(file->short_name));
+  if (!file->long_name.empty()) {
+    index->by_name.erase(NormalizeName(file->long_name));
+  }
+  file->entry.name[0] = 0xe5;
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+Error Sync() {
+  const size_t bps = boot_volume_image->bytes_per_sector;
+  const auto fat_bytes = reinterpret_cast<const uint8_t*>(fat_entries.data());
+
+  // 連続する変更済みセクタは 1 回の書き込みにまとめる
+  for (size_t s = 0; s < fat_sector_dirty.size();) {
+    if (!fat_sector_dirty[s]) {
+      ++s;
+      continue;
+    }
+    size_t e = s;
+    while (e < fat_sector_dirty.size() && fat_sector_dirty[e]) {
+      fat_sector_dirty[e++] = false;
+    }
+    for (int f = 0; f < boot_volume_image->num_fats; ++f) {
+      const size_t offset =
+          fat_offset + (f * boot_volume_image->fat_size_32 + s) * bps;
+      if (auto err = volume_cache->Write(offset, fat_bytes + s * bps,
+                                         (e - s) * bps)) {
+        return err;
+      }
+    }
+    s = e;
+  }
+
+  // FSInfo の空きクラスタ数と次の空きクラスタの位置を更新する
+  if (fat_modified && boot_volume_image->fs_info != 0) {
+    const uint32_t fs_info[2] = {static_cast<uint32_t>(CountFreeClusters()),
+                                 static_cast<uint32_t>(alloc_hint)};
+    if (auto err = volume_cache->Write(
+            boot_volume_image->fs_info * bps + 488, fs_info, sizeof(fs_info))) {
+      return err;
+    }
+  }
+  fat_modified = false;
+
+  return volume_cache->Flush();
+}
+
+WithError<const uint8_t*> MapFile(const DirectoryEntry& entry) {
+  static const uint8_t kEmpty[1] = {};
+  const auto first = entry.FirstCluster();
+  if (first == 0 || entry.file_size == 0) {
+    return {kEmpty, MAKE_ERROR(Error::kSuccess)};
+  }
+
+  if (auto it = file_mappings.find(first); it != file_mappings.end()) {
+    if (it->second.bytes == entry.file_size) {
+      ++it->second.refs;
+      return {reinterpret_cast<const uint8_t*>(it->second.addr),
+              MAKE_ERROR(Error::kSuccess)};
+    }
+    InvalidateMapping(first);
+  }
+
+  FileMapping mapping{0, entry.file_size, nullptr, 1};
+  uintptr_t phys;
+  const auto& extents = GetExtents(first);
+  auto image = volume_cache->Device().MemoryImage();
+  if (image && extents.front().length * bytes_per_cluster >= entry.file_size) {
+    // キャッシュに残っている書き込みをイメージに反映してからマップする
+    if (auto err = volume_cache->Flush()) {
+      return {nullptr, err};
+    }
+    phys = reinterpret_cast<uintptr_t>(image) + ClusterOffset(first);
+  } else {
+    mapping.buffer = new uint8_t[entry.file_size];
+    ReadFile(entry, 0, mapping.buffer, entry.file_size);
+    phys = reinterpret_cast<uintptr_t>(mapping.buffer);
+  }
+
+  auto mapped = MapReadOnly(phys, entry.file_size);
+  if (mapped.error.Cause() == Error::kNoEnoughMemory &&
+      ReleaseUnusedMappings()) {
+    mapped = MapReadOnly(phys, entry.file_size);
+  }
+  if (mapped.error) {
+    delete[] mapping.buffer;
+    return {nullptr, mapped.error};
+  }
+  mapping.addr = mapped.value;
+  file_mappings[first] = mapping;
+  return {reinterpret_cast<const uint8_t*>(mapping.addr),
+          MAKE_ERROR(Error::kSuccess)};
+}
+
+void UnmapFile(const uint8_t* data) {
+  const auto addr = reinterpret_cast<uintptr_t>(data);
+  for (auto& [first, mapping] : file_mappings) {
+    if (mapping.addr == addr) {
+      // 次の MapFile で使い回せるよう，解除せずに残しておく
+      --mapping.refs;
+      return;
+    }
+  }
+  for (auto it = detached_mappings.begin(); it != detached_mappings.end();
+       ++it) {
+    if (it->addr == addr) {
+      if (--it->refs == 0) {
+        ReleaseMapping(*it);
+        detached_mappings.erase(it);
+      }
+      return;
+    }
+  }
+}
+
+FileDescriptor::FileDescriptor(IndexedEntry& file, bool append)
+    : file_{file}, append_{append} {
+  ++file_.open_count;
+}
+
+FileDescriptor::~FileDescriptor() {
+  Flush();
+  --file_.open_count;
+}
+
+size_t FileDescriptor::Read(void* buf, size_t len) {
+  Flush();
+  const size_t n = ReadFile(file_.entry, offset_, buf, len);
+  offset_ += n;
+  return n;
+}
+
+size_t FileDescriptor::Write(const void* buf, size_t len) {
+  if (append_) {
+    offset_ = Size();
+  }
+  // バッファの末尾に続かない位置への書き込みなら，先にバッファを書き出す．
+  // 書き出せなければ，以前に受け付けた分が失われたことをここで知らせる
+  if (!write_buf_.empty() &&
+      offset_ != write_buf_offset_ + write_buf_.size()) {
+    if (FlushBuffer().error) {
+      return 0;
+    }
+  }
+
+  if (write_buf_.empty() && len >= kWriteBufferBytes) {
+    auto [n, err] = WriteFile(file_, offset_, buf, len);
+    offset_ += n;
+    return n;
+  }
+
+  if (write_buf_.empty()) {
+    write_buf_.reserve(kWriteBufferBytes);
+    write_buf_offset_ = offset_;
+  }
+  const size_t begin = offset_;
+  auto p = reinterpret_cast<const uint8_t*>(buf);
+  write_buf_.insert(write_buf_.end(), p, p + len);
+  offset_ += len;
+  if (write_buf_.size() >= kWriteBufferBytes) {
+    const auto buf_offset = write_buf_offset_;
+    auto [n, err] = FlushBuffer();
+    if (err) {
+      // 今回の分のうち，書き出せたところまでを書いたことにする
+      const size_t end = std::max(buf_offset + n, begin);
+      offset_ = end;
+      return end - begin;
+    }
+  }
+  return len;
+}
+
+WithError<size_t> FileDescriptor::Seek(int64_t offset, int whence) {
+  int64_t base = 0;
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = offset_;
+      break;
+    case SEEK_END:
+      base = Size();
+      break;
+    default:
+      return {offset_, MAKE_ERROR(Error::kIndexOutOfRange)};
+  }
+  if (base + offset < 0) {
+    return {offset_, MAKE_ERROR(Error::kIndexOutOfRange)};
+  }
+  offset_ = base + offset;
+  return {offset_, MAKE_ERROR(Error::kSuccess)};
+}
+
+size_t FileDescriptor::Size() const {
+  return std::max<size_t>(file_.entry.file_size,
+                          write_buf_offset_ + write_buf_.size());
+}
+
+Error FileDescriptor::Flush() { return FlushBuffer().error; }
+
+WithError<size_t> FileDescriptor::FlushBuffer() {
+  if (write_buf_.empty()) {
+    return {0, MAKE_ERROR(Error::kSuccess)};
+  }
+  auto result =
+      WriteFile(file_, write_buf_offset_, write_buf_.data(), write_buf_.size());
+  write_buf_.clear();
+  return result;
+}
+
+size_t CountFreeClusters() {
+  size_t count = 0;
+  for (auto bits : free_bitmap) {
+    count += __builtin_popcountll(bits);
+  }
+  return count;
+}
+
 }  // namespace fat
@@ -1,8 +1,16 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <string>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "block.hpp"
+#include "error.hpp"
+#include "file.hpp"
 
 namespace fat {
 struct BPB {
@@ -65,15 +73,35 @@ struct DirectoryEntry {
   }
 } __attribute__((packed));
 
+// 長いファイル名（LFN）のエントリ．1 エントリにつき UCS-2 で 13 文字を持つ
+struct LongNameEntry {
+  uint8_t ord;
+  uint16_t name1[5];
+  Attribute attr;
+  uint8_t type;
+  uint8_t checksum;
+  uint16_t name2[6];
+  uint16_t first_cluster_low;
+  uint16_t name3[2];
+} __attribute__((packed));
+
 extern BPB* boot_volume_image;
-void Initialize(void* boot_volume_image);
 
-uintptr_t GetClusterAddr(unsigned long cluster);
+/*
+  ボリュームへの読み書きはすべて volume_cache を通す．
+  boot_volume_image は初期化時に読み込んだ BPB の写しを指す．
+*/
+extern BlockCache* volume_cache;
 
-template <class T>
-T* GetSectorByCluster(unsigned long cluster) {
-  return reinterpret_cast<T*>(GetClusterAddr(cluster));
-}
+Error Initialize(BlockDevice& device);
+
+/* ブートローダが読み込んだメモリ上のボリュームイメージで初期化する．
+   loaded_bytes は実際に読み込まれた量で，BPB の大きさより小さいことがある． */
+void Initialize(void* volume_image, size_t loaded_bytes);
+
+// クラスタの先頭の，ボリューム先頭からのバイト位置
+size_t ClusterOffset(unsigned long cluster);
+Error ReadCluster(unsigned long cluster, void* buf);
 
 std::tuple<std::string, std::string> ReadName(const DirectoryEntry& entry);
 
@@ -81,10 +109,144 @@ static const unsigned long kEndOfClusterchain = 0x0ffffffflu;
 
 unsigned long NextCluster(unsigned long cluster);
 
+/*
+  name をディレクトリから探す．"/apps/foo" のように / で区切られたパスも扱える．
+  / で始まるパスはルートディレクトリから，それ以外は directory_cluster
+  （0 ならルートディレクトリ）から辿る．
+  返すポインタはディレクトリ索引内の写しを指し，索引が無効化されるまで有効．
+*/
 DirectoryEntry* FindFile(const char* name, unsigned long directory_cluster = 0);
 
 extern unsigned long bytes_per_cluster;
 
 bool NameIsEqual(const DirectoryEntry& entry, const char* name);
 
+/*
+  クラスタチェーン上で番号が連続するクラスタの並び（エクステント）．
+  file_cluster はファイル先頭から数えたクラスタの位置．
+*/
+struct Extent {
+  unsigned long file_cluster;
+  unsigned long cluster;
+  unsigned long length;
+};
+
+// first_cluster から始まるクラスタチェーンをエクステントの列として返す．
+// 結果はキャッシュされ，2 回目以降はチェーンを辿らない．
+const std::vector<Extent>& GetExtents(unsigned long first_cluster);
+void InvalidateExtents(unsigned long first_cluster);
+
+// ファイルの offset バイト目から最大 len バイトを buf に読み込み，
+// 読み込んだバイト数を返す
+size_t ReadFile(const DirectoryEntry& entry, size_t offset, void* buf,
+                size_t len);
+
+/*
+  ディレクトリ索引の 1 エントリ．
+  entry は短い名前のエントリの写しで，cluster と index はそのエントリが
+  置かれているクラスタとクラスタ内の位置．
+*/
+struct IndexedEntry {
+  DirectoryEntry entry;
+  std::string short_name;  // "BASE.EXT" 形式
+  std::string long_name;   // UTF-8．長い名前がなければ空
+  unsigned long cluster;
+  int index;
+  int open_count{0};  // このエントリを指している FileDescriptor の数
+
+  const std::string& Name() const {
+    return long_name.empty() ? short_name : long_name;
+  }
+};
+
+/*
+  ディレクトリの全エントリを初回アクセス時に読み込んだもの．
+  by_name は大文字化した短い名前と長い名前の両方から entries の添字を引く．
+  エントリの追加で既存のエントリが動かないよう，entries は deque に置く．
+*/
+struct DirectoryIndex {
+  std::deque<IndexedEntry> entries;
+  std::unordered_map<std::string, size_t> by_name;
+};
+
+const DirectoryIndex& GetDirectoryIndex(unsigned long directory_cluster);
+
+// ディレクトリの内容を書き換えたら呼ぶ．次のアクセスで索引を作り直す
+void InvalidateDirectoryIndex(unsigned long directory_cluster);
+
+bool IsDirectory(const DirectoryEntry& entry);
+
+// FindFile と同じ規則で探し，索引のエントリを返す
+IndexedEntry* FindIndexedEntry(const char* name,
+                               unsigned long directory_cluster = 0);
+
+/*
+  書き込み系の操作．
+  FAT の変更はメモリ上の FAT の写しに対して行い，Sync を呼ぶまで
+  ボリュームへは書き出さない．データとディレクトリエントリは volume_cache に
+  書き込まれ，追い出されるか Sync されたときにデバイスへ反映される．
+*/
+
+// 空のファイルを作る．既にあればそのファイルを返す．
+// 新しく作る名前は 8.3 形式に収まるものに限る．
+WithError<IndexedEntry*> CreateFile(const char* path);
+
+// offset から len バイトを書き込む．ファイルの末尾より後ろから書く場合，
+// 間は 0 で埋める．必要に応じてクラスタを割り当てる．
+WithError<size_t> WriteFile(IndexedEntry& file, size_t offset,
+                            const void* buf, size_t len);
+
+Error TruncateFile(IndexedEntry& file, size_t size);
+
+/* ファイルを削除する．ディレクトリは削除できない．
+   開いている FileDescriptor があるファイルは kBusy を返して削除しない． */
+Error DeleteFile(const char* path);
+
+// 変更された FAT セクタをすべての FAT にまとめて書き出し，キャッシュを吐き出す
+Error Sync();
+
+size_t CountFreeClusters();
+
+/*
+  ファイルの内容を読み込み専用でマップし，先頭を指すポインタを返す．
+  クラスタが連続していてボリュームがメモリ上にあれば，そのページを
+  コピーせずに直接マップする．そうでなければ最初の 1 回だけ連続した
+  バッファに集めてからマップする．
+  使い終わったら UnmapFile を呼ぶ．呼ばずに持ち続けてもよい．
+  マップはファイルが書き換えられるまで使い回される．使用中に書き換えられた
+  マップは書き換え前の内容の写しに向け直されるので，読み続けても壊れない．
+*/
+WithError<const uint8_t*> MapFile(const DirectoryEntry& entry);
+void UnmapFile(const uint8_t* data);
+
+/*
+  FAT 上のファイルを指す記述子．
+  小さな書き込みは kWriteBufferBytes までためてから WriteFile にまとめて渡す．
+  ためた分を書き出せなかったときは，Write は書けた分までの短い数を返し，
+  Flush はエラーを返す．
+  生きている間は file の open_count を増やし，DeleteFile から守る．
+*/
+class FileDescriptor : public ::FileDescriptor {
+ public:
+  static const size_t kWriteBufferBytes = 64 * 1024;
+
+  FileDescriptor(IndexedEntry& file, bool append);
+  ~FileDescriptor() override;
+  size_t Read(void* buf, size_t len) override;
+  size_t Write(const void* buf, size_t len) override;
+  WithError<size_t> Seek(int64_t offset, int whence) override;
+  size_t Size() const override;
+  Error Flush() override;
+
+ private:
+  // write_buf_ を書き出し，書き出せたバイト数を返す
+  WithError<size_t> FlushBuffer();
+
+  IndexedEntry& file_;
+  bool append_;
+  size_t offset_{0};
+  std::vector<uint8_t> write_buf_{};
+  size_t write_buf_offset_{0};  // write_buf_ の先頭が対応するファイル上の位置
+};
+
 }  // namespace fat
@@ -0,0 +1,160 @@
+#include "file.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "console.hpp"
+#include "fat.hpp"
+#include "task.hpp"
+
+size_t ConsoleFileDescriptor::Write(const void* buf, size_t len) {
+  Console* c = console ? static_cast<Console*>(console) : direct_console;
+  auto p = reinterpret_cast<const char*>(buf);
+  char s[128];
+  for (size_t i = 0; i < len;) {
+    const size_t n = std::min(len - i, sizeof(s) - 1);
+    memcpy(s, p + i, n);
+    s[n] = 0;
+    c->PutString(s);
+    i += n;
+  }
+  return len;
+}
+
+FileTable& CurrentFileTable() {
+  // タスク管理の初期化前はカーネル全体で 1 つの表を使う
+  static FileTable boot_files;
+  auto& files = task_manager ? task_manager->CurrentTask().Files() : boot_files;
+  if (files.empty()) {
+    auto console_fd = std::make_shared<ConsoleFileDescriptor>();
+    files = {console_fd, console_fd, console_fd};
+  }
+  return files;
+}
+
+namespace {
+FileDescriptor* GetFD(int fd) {
+  auto& files = CurrentFileTable();
+  if (fd < 0 || fd >= files.size() || !files[fd]) {
+    return nullptr;
+  }
+  return files[fd].get();
+}
+}  // namespace
+
+/*
+  newlib から呼ばれるシステムコールのスタブ．
+  エラーのときは errno を設定して -1 を返す．
+*/
+extern "C" {
+
+int open(const char* path, int flags, ...) {
+  fat::IndexedEntry* file;
+  if (flags & O_CREAT) {
+    auto [created, err] = fat::CreateFile(path);
+    if (err) {
+      errno = err.Cause() == Error::kFull ? ENOSPC : ENOENT;
+      return -1;
+    }
+    file = created;
+  } else {
+    file = fat::FindIndexedEntry(path);
+  }
+  if (!file) {
+    errno = ENOENT;
+    return -1;
+  } else if (fat::IsDirectory(file->entry)) {
+    errno = EISDIR;
+    return -1;
+  }
+
+  if ((flags & O_TRUNC) && (flags & O_ACCMODE) != O_RDONLY) {
+    fat::TruncateFile(*file, 0);
+  }
+
+  auto& files = CurrentFileTable();
+  int fd = 0;
+  while (fd < files.size() && files[fd]) {
+    ++fd;
+  }
+  if (fd == files.size()) {
+    files.emplace_back();
+  }
+  files[fd] = std::make_shared<fat::FileDescriptor>(*file, flags & O_APPEND);
+  return fd;
+}
+
+int close(int fd) {
+  auto f = GetFD(fd);
+  if (!f) {
+    errno = EBADF;
+    return -1;
+  }
+  // ためておいた書き込みが失敗していれば，記述子は閉じてから知らせる
+  auto err = f->Flush();
+  CurrentFileTable()[fd].reset();
+  if (err) {
+    errno = err.Cause() == Error::kFull ? ENOSPC : EIO;
+    return -1;
+  }
+  return 0;
+}
+
+ssize_t read(int fd, void* buf, size_t count) {
+  auto f = GetFD(fd);
+  if (!f) {
+    errno = EBADF;
+    return -1;
+  }
+  return f->Read(buf, count);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+  auto f = GetFD(fd);
+  if (!f) {
+    errno = EBADF;
+    return -1;
+  }
+  return f->Write(buf, count);
+}
+
+off_t lseek(int fd, off_t offset, int whence) {
+  auto f = GetFD(fd);
+  if (!f) {
+    errno = EBADF;
+    return -1;
+  }
+  auto [pos, err] = f->Seek(offset, whence);
+  if (err) {
+    errno = f->IsTerminal() ? ESPIPE : EINVAL;
+    return -1;
+  }
+  return pos;
+}
+
+int fstat(int fd, struct stat* buf) {
+  auto f = GetFD(fd);
+  if (!f) {
+    errno = EBADF;
+    return -1;
+  }
+  memset(buf, 0, sizeof(*buf));
+  buf->st_mode = f->IsTerminal() ? S_IFCHR : S_IFREG;
+  buf->st_size = f->Size();
+  /* newlib は st_blksize を stdio のバッファサイズに使う．
+     大きくしておくと fread / fwrite が 1 回の read / write で多くを運ぶ． */
+  buf->st_blksize = f->IsTerminal() ? 128 : 64 * 1024;
+  return 0;
+}
+
+int isatty(int fd) {
+  auto f = GetFD(fd);
+  return f && f->IsTerminal();
+}
+
+}  // extern "C"
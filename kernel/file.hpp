@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "error.hpp"
+
+/*
+  ファイル記述子が指す対象．newlib の read / write / lseek などは
+  現在のタスクの記述子表を引いてここに行き着く．
+*/
+class FileDescriptor {
+ public:
+  virtual ~FileDescriptor() = default;
+  virtual size_t Read(void* buf, size_t len) = 0;
+  virtual size_t Write(const void* buf, size_t len) = 0;
+  // whence は SEEK_SET / SEEK_CUR / SEEK_END．新しい位置を返す
+  virtual WithError<size_t> Seek(int64_t offset, int whence) = 0;
+  virtual size_t Size() const = 0;
+  virtual Error Flush() { return MAKE_ERROR(Error::kSuccess); }
+  virtual bool IsTerminal() const { return false; }
+};
+
+// 標準入出力．出力はコンソールに書き，入力は常に空
+class ConsoleFileDescriptor : public FileDescriptor {
+ public:
+  size_t Read(void* buf, size_t len) override { return 0; }
+  size_t Write(const void* buf, size_t len) override;
+  WithError<size_t> Seek(int64_t offset, int whence) override {
+    return {0, MAKE_ERROR(Error::kNotImplemented)};
+  }
+  size_t Size() const override { return 0; }
+  bool IsTerminal() const override { return true; }
+};
+
+using FileTable = std::vector<std::shared_ptr<FileDescriptor>>;
+
+// 現在のタスクの記述子表．0 から 2 は最初からコンソールを指す
+FileTable& CurrentFileTable();
@@ -4,21 +4,65 @@ extern const uint8_t _binary_hankaku_bin_start;
 extern const uint8_t _binary_hankaku_bin_end;
 extern const uint8_t _binary_hankaku_bin_size;
 
-void WriteAscii(PixelWriter &writer, int x, int y, const PixelColor &color,
-                char c) {
-  const uint8_t *font = GetFont(c);
+namespace {
+/*
+  グリフを横方向に連続する点の区間（スパン）の列に展開したもの．
+  1 行 8 ドットなので 1 行あたり高々 4 スパンになる．
+*/
+struct GlyphSpans {
+  struct Span {
+    uint8_t x, y, width;
+  };
+
+  bool ready;
+  uint8_t count;
+  Span spans[16 * 4];
+};
+
+GlyphSpans glyph_cache[256];
 
+const GlyphSpans *GetGlyphSpans(char c) {
+  auto &glyph = glyph_cache[static_cast<uint8_t>(c)];
+  if (glyph.ready) {
+    return &glyph;
+  }
+
+  const uint8_t *font = GetFont(c);
   if (font == nullptr) {
-    return;
+    return nullptr;
   }
 
+  glyph.count = 0;
   for (int dy = 0; dy < 16; ++dy) {
-    for (int dx = 0; dx < 8; ++dx) {
-      if (font[dy] << dx & 0x80u) {
-        writer.Write(color, dx + x, dy + y);
+    int dx = 0;
+    while (dx < 8) {
+      while (dx < 8 && (font[dy] << dx & 0x80u) == 0) ++dx;
+      const int begin = dx;
+      while (dx < 8 && (font[dy] << dx & 0x80u) != 0) ++dx;
+      if (begin < dx) {
+        glyph.spans[glyph.count++] = {static_cast<uint8_t>(begin),
+                                      static_cast<uint8_t>(dy),
+                                      static_cast<uint8_t>(dx - begin)};
       }
     }
   }
+  glyph.ready = true;
+  return &glyph;
+}
+}  // namespace
+
+void WriteAscii(PixelWriter &writer, int x, int y, const PixelColor &color,
+                char c) {
+  const GlyphSpans *glyph = GetGlyphSpans(c);
+
+  if (glyph == nullptr) {
+    return;
+  }
+
+  for (int i = 0; i < glyph->count; ++i) {
+    const auto &span = glyph->spans[i];
+    writer.WriteSpan(color, x + span.x, y + span.y, span.width);
+  }
 }
 
 void WriteAscii(PixelWriter &writer, Vector2D<int> pos, const PixelColor &color,
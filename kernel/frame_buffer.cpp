@@ -95,6 +95,11 @@ Error FrameBuffer::CopyFrom(const FrameBuffer& src, Vector2D<int> pos,
 }
 
 void FrameBuffer::Move(Vector2D<int> dest_pos, const Rectangle<int>& src) {
+  MoveFrameBufferArea(config, dest_pos, src);
+}
+
+void MoveFrameBufferArea(const FrameBufferConfig& config,
+                         Vector2D<int> dest_pos, const Rectangle<int>& src) {
   const auto bytes_per_pixel = BytesPerPixel(config.pixel_format);
   const auto bytes_per_scan_line = BytesPerScanLine(config);
 
@@ -24,3 +24,6 @@ class FrameBuffer {
 };
 
 int BitsPerPixel(PixelFormat format);
+
+void MoveFrameBufferArea(const FrameBufferConfig& config, Vector2D<int> dst_pos,
+                         const Rectangle<int>& src);
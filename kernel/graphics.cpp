@@ -16,12 +16,28 @@ void BGRResv8BitPerColorPixelWriter::Write(const PixelColor& color, int x,
   p[2] = color.r;
 }
 
+void RGBResv8BitPerColorPixelWriter::WriteSpan(const PixelColor& color, int x,
+                                               int y, int width) {
+  const uint32_t value = color.r | (color.g << 8) | (color.b << 16);
+  auto p = GetPixel32(x, y);
+  for (int i = 0; i < width; ++i) {
+    p[i] = value;
+  }
+}
+
+void BGRResv8BitPerColorPixelWriter::WriteSpan(const PixelColor& color, int x,
+                                               int y, int width) {
+  const uint32_t value = color.b | (color.g << 8) | (color.r << 16);
+  auto p = GetPixel32(x, y);
+  for (int i = 0; i < width; ++i) {
+    p[i] = value;
+  }
+}
+
 void DrawRect(PixelWriter& writer, const Vector2D<int>& pos,
               const Vector2D<int>& size, const PixelColor& color) {
-  for (int dx = 0; dx < size.x; ++dx) {
-    writer.Write(color, pos.x + dx, pos.y);
-    writer.Write(color, pos.x + dx, pos.y + size.y - 1);
-  }
+  writer.WriteSpan(color, pos.x, pos.y, size.x);
+  writer.WriteSpan(color, pos.x, pos.y + size.y - 1, size.x);
   for (int dy = 1; dy < size.y - 1; ++dy) {
     writer.Write(color, pos.x, pos.y + dy);
     writer.Write(color, pos.x + size.x - 1, pos.y + dy);
@@ -31,9 +47,7 @@ void DrawRect(PixelWriter& writer, const Vector2D<int>& pos,
 void FillRect(PixelWriter& writer, const Vector2D<int>& pos,
               const Vector2D<int>& size, const PixelColor& color) {
   for (int dy = 0; dy < size.y; ++dy) {
-    for (int dx = 0; dx < size.x; ++dx) {
-      writer.Write(color, dx + pos.x, dy + pos.y);
-    }
+    writer.WriteSpan(color, pos.x, dy + pos.y, size.x);
   }
 }
 
@@ -103,6 +103,12 @@ class PixelWriter {
   void Write(const PixelColor &color, Vector2D<int> pos) {
     Write(color, pos.x, pos.y);
   }
+  // (x, y) から右へ width ピクセルを同じ色で塗る
+  virtual void WriteSpan(const PixelColor &color, int x, int y, int width) {
+    for (int i = 0; i < width; ++i) {
+      Write(color, x + i, y);
+    }
+  }
   virtual int Width() const = 0;
   virtual int Height() const = 0;
 };
@@ -115,6 +121,9 @@ class FrameBufferWriter : public PixelWriter {
   virtual int Height() const override { return fbConfig.vertical_resolution; }
 
  protected:
+  uint32_t *GetPixel32(int x, int y) {
+    return reinterpret_cast<uint32_t *>(GetPixel(x, y));
+  }
   uint8_t *GetPixel(int x, int y) {
     return fbConfig.frame_buffer + 4 * (fbConfig.pixels_per_scan_line * y + x);
   }
@@ -127,12 +136,16 @@ class RGBResv8BitPerColorPixelWriter : public FrameBufferWriter {
  public:
   using FrameBufferWriter::FrameBufferWriter;
   virtual void Write(const PixelColor &color, int x, int y) override;
+  virtual void WriteSpan(const PixelColor &color, int x, int y,
+                         int width) override;
 };
 
 class BGRResv8BitPerColorPixelWriter : public FrameBufferWriter {
  public:
   using FrameBufferWriter::FrameBufferWriter;
   virtual void Write(const PixelColor &color, int x, int y) override;
+  virtual void WriteSpan(const PixelColor &color, int x, int y,
+                         int width) override;
 };
 
 void FillRect(PixelWriter &writer, const Vector2D<int> &pos,
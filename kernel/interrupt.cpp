@@ -1,9 +1,14 @@
 #include "interrupt.hpp"
 
 #include "asmfunc.h"
+#include "backtrace.hpp"
+#include "console.hpp"
+#include "profiler.hpp"
 #include "segment.hpp"
+#include "serial.hpp"
 #include "task.hpp"
 #include "timer.hpp"
+#include "virtio_blk.hpp"
 
 std::array<InterruptDescriptor, 256> idt;
 
@@ -28,19 +33,112 @@ __attribute__((interrupt)) void IntHandlerXHCI(InterruptFrame* frame) {
 }
 
 __attribute__((interrupt)) void IntHandlerTimer(InterruptFrame* frame) {
+  RecordProfileSample(frame->rip);
   // msg_queue->emplace_back(Message{Message::kTimerTimeout});
   LAPICTimerOnInterrupt();
   NotifyEndOfInterrupt();
 }
 
+__attribute__((interrupt)) void IntHandlerVirtioBlock(InterruptFrame* frame) {
+  if (virtio::block_driver) {
+    virtio::block_driver->ProcessCompletions();
+  }
+  NotifyEndOfInterrupt();
+}
+
+__attribute__((interrupt)) void IntHandlerSerial(InterruptFrame* frame) {
+  serial::OnInterrupt();
+  NotifyEndOfInterrupt();
+}
+
+/* CPU 例外の内容とバックトレースを書き出して止まる．
+   rbp は例外が起きたときの rbp で，ハンドラのフレームの [rbp] に入っている */
+[[noreturn]] void KillOnException(const char* name, const InterruptFrame* frame,
+                                  uint64_t error_code, uint64_t rbp) {
+  printk("\n%s: error 0x%lx at rip 0x%016lx rsp 0x%016lx\n", name,
+         error_code, frame->rip, frame->rsp);
+  PrintBacktrace(frame->rip, rbp);
+  while (true) {
+    asm("cli; hlt");
+  }
+}
+
+uint64_t InterruptedRBP(void* handler_frame) {
+  return *reinterpret_cast<const uint64_t*>(handler_frame);
+}
+
+__attribute__((interrupt)) void IntHandlerDE(InterruptFrame* frame) {
+  KillOnException("#DE divide error", frame, 0,
+                  InterruptedRBP(__builtin_frame_address(0)));
+}
+
+__attribute__((interrupt)) void IntHandlerUD(InterruptFrame* frame) {
+  KillOnException("#UD invalid opcode", frame, 0,
+                  InterruptedRBP(__builtin_frame_address(0)));
+}
+
+__attribute__((interrupt)) void IntHandlerDF(InterruptFrame* frame,
+                                             uint64_t error_code) {
+  KillOnException("#DF double fault", frame, error_code,
+                  InterruptedRBP(__builtin_frame_address(0)));
+}
+
+__attribute__((interrupt)) void IntHandlerGP(InterruptFrame* frame,
+                                             uint64_t error_code) {
+  KillOnException("#GP general protection", frame, error_code,
+                  InterruptedRBP(__builtin_frame_address(0)));
+}
+
+__attribute__((interrupt)) void IntHandlerPF(InterruptFrame* frame,
+                                             uint64_t error_code) {
+  printk("\n#PF at address 0x%016lx\n", GetCR2());
+  KillOnException("#PF page fault", frame, error_code,
+                  InterruptedRBP(__builtin_frame_address(0)));
+}
+
+/* IO APIC はたいていこのアドレスにある．ISA の IRQ 番号はそのまま
+   入力ピン番号になっているものとし，MADT の割り込み上書きは見ない． */
+volatile uint32_t& ioapic_index = *reinterpret_cast<uint32_t*>(0xfec00000);
+volatile uint32_t& ioapic_data = *reinterpret_cast<uint32_t*>(0xfec00010);
+
+void WriteIOAPIC(uint32_t index, uint32_t value) {
+  ioapic_index = index;
+  ioapic_data = value;
+}
+
 }  // namespace
 
+void RouteISAInterrupt(int irq, InterruptVector::Number vector) {
+  const uint32_t bsp_local_apic_id =
+      *reinterpret_cast<const uint32_t*>(0xfee00020) >> 24;
+  // 1 エントリは 2 レジスタ．下位を書くとマスクが外れる
+  WriteIOAPIC(0x10 + 2 * irq + 1, bsp_local_apic_id << 24);
+  WriteIOAPIC(0x10 + 2 * irq, vector);
+}
+
 void InitializeInterrupt() {
+  auto set_exception = [](int vector, auto handler) {
+    SetIDTEntry(idt[vector],
+                MakeIDTAttr(InterruptDescriptorType::kInterruptGate, 0),
+                reinterpret_cast<uint64_t>(handler), kKernelCS);
+  };
+  set_exception(InterruptVector::kDivideError, IntHandlerDE);
+  set_exception(InterruptVector::kInvalidOpcode, IntHandlerUD);
+  set_exception(InterruptVector::kDoubleFault, IntHandlerDF);
+  set_exception(InterruptVector::kGeneralProtection, IntHandlerGP);
+  set_exception(InterruptVector::kPageFault, IntHandlerPF);
+
   SetIDTEntry(idt[InterruptVector::kXHCI],
               MakeIDTAttr(InterruptDescriptorType::kInterruptGate, 0),
               reinterpret_cast<uint64_t>(IntHandlerXHCI), kKernelCS);
   SetIDTEntry(idt[InterruptVector::kLAPICTimer],
               MakeIDTAttr(InterruptDescriptorType::kInterruptGate, 0),
               reinterpret_cast<uint64_t>(IntHandlerTimer), kKernelCS);
+  SetIDTEntry(idt[InterruptVector::kVirtioBlock],
+              MakeIDTAttr(InterruptDescriptorType::kInterruptGate, 0),
+              reinterpret_cast<uint64_t>(IntHandlerVirtioBlock), kKernelCS);
+  SetIDTEntry(idt[InterruptVector::kSerial],
+              MakeIDTAttr(InterruptDescriptorType::kInterruptGate, 0),
+              reinterpret_cast<uint64_t>(IntHandlerSerial), kKernelCS);
   LoadIDT(sizeof(idt) - 1, reinterpret_cast<uintptr_t>(&idt[0]));
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <cstdio>
 #include <deque>
 
@@ -57,8 +58,15 @@ void SetIDTEntry(InterruptDescriptor& desc, InterruptDesriptorAttribute attr,
 class InterruptVector {
  public:
   enum Number {
+    kDivideError = 0x00,
+    kInvalidOpcode = 0x06,
+    kDoubleFault = 0x08,
+    kGeneralProtection = 0x0d,
+    kPageFault = 0x0e,
     kXHCI = 0x40,
     kLAPICTimer = 0x41,
+    kVirtioBlock = 0x42,
+    kSerial = 0x43,
   };
 };
 
@@ -68,3 +76,20 @@ struct InterruptFrame {
 
 void NotifyEndOfInterrupt();
 void InitializeInterrupt();
+
+/* 割り込みを禁止し，それまでの RFLAGS を返す．
+   割り込みハンドラの中からも呼ばれる処理で cli / sti の代わりに使う． */
+inline uint64_t SaveAndDisableInterrupts() {
+  uint64_t rflags;
+  __asm__ volatile("pushfq; pop %0; cli" : "=r"(rflags) : : "memory");
+  return rflags;
+}
+
+inline void RestoreInterrupts(uint64_t rflags) {
+  if (rflags & 0x200) {
+    __asm__ volatile("sti" : : : "memory");
+  }
+}
+
+// ISA の IRQ を IO APIC で BSP の vector へ届ける（エッジ，アクティブ High）
+void RouteISAInterrupt(int irq, InterruptVector::Number vector);
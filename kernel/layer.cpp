@@ -1,10 +1,16 @@
 #include "layer.hpp"
 
 #include <algorithm>
+#include <limits>
 
 #include "console.hpp"
 #include "error.hpp"
 #include "logger.hpp"
+#include "perf.hpp"
+
+namespace {
+PerfRegion draw_perf{"LayerManager::Draw"};
+}  // namespace
 
 Layer::Layer(unsigned int id_) : id(id_) {}
 
@@ -20,6 +26,7 @@ Layer& Layer::MoveRelative(Vector2D<int> pos_diff) {
 
 void Layer::DrawTo(FrameBuffer& screen, const Rectangle<int>& area) const {
   if (window) {
+    drawn_move_count = window->MoveCount();
     window->DrawTo(screen, pos, area);
   }
 }
@@ -35,13 +42,16 @@ void LayerManager::SetFrameBuffer(FrameBuffer* screen) {
 }
 
 void LayerManager::Draw(const Rectangle<int>& area) const {
+  ScopedPerfCounter perf{draw_perf};
   for (auto layer : layer_stack) {
     layer->DrawTo(back_buffer, area);
   }
   screen->CopyFrom(back_buffer, area.pos, area);
+  DrawCursor(area);
 }
 
 void LayerManager::Draw(unsigned int id) const {
+  ScopedPerfCounter perf{draw_perf};
   bool draw = false;
   Rectangle<int> window_area;
 
@@ -58,9 +68,11 @@ void LayerManager::Draw(unsigned int id) const {
   }
 
   screen->CopyFrom(back_buffer, window_area.pos, window_area);
+  DrawCursor(window_area);
 }
 
 void LayerManager::Draw(unsigned int id, Rectangle<int> area) const {
+  ScopedPerfCounter perf{draw_perf};
   bool draw = false;
   Rectangle<int> window_area;
   for (auto layer : layer_stack) {
@@ -79,6 +91,7 @@ void LayerManager::Draw(unsigned int id, Rectangle<int> area) const {
   }
 
   screen->CopyFrom(back_buffer, window_area.pos, window_area);
+  DrawCursor(window_area);
 }
 
 void LayerManager::Move(unsigned int id, Vector2D<int> new_pos) {
@@ -99,6 +112,85 @@ void LayerManager::MoveRelative(unsigned int id, Vector2D<int> pos_diff) {
   Draw(id);
 }
 
+/*
+  ウィンドウ内の area（ウィンドウ座標）を dy ピクセル上（負なら下）へずらす．
+  ウィンドウ自身は Window::Move で既にずらしてある前提で，back_buffer と
+  画面も FrameBuffer::Move で同じだけずらし，新たに見えるようになった行だけを
+  再描画する．上に別のレイヤが重なっている場合は通常の再描画にする．
+
+  ターミナルはウィンドウをずらしてからメッセージを送るので，その間に
+  カーソルの点滅や他のウィンドウの移動でこのレイヤが描かれていると，
+  back_buffer は既にずれた内容になっている．そこをさらにずらすと二重に
+  スクロールしてしまうので，その場合も通常の再描画にする．
+*/
+void LayerManager::Scroll(unsigned int id, const Rectangle<int>& area, int dy) {
+  auto layer = FindLayer(id);
+  if (!layer || !layer->GetWindow()) {
+    return;
+  }
+
+  const bool drawn_after_move =
+      layer->DrawnMoveCount() > layer->ScrolledMoveCount();
+  layer->SetScrolledMoveCount(layer->GetWindow()->MoveCount());
+
+  const auto window_pos = layer->GetPosition();
+  const Rectangle<int> screen_area{{0, 0}, ScreenSize()};
+  const auto visible =
+      screen_area & Rectangle<int>{window_pos + area.pos, area.size};
+  const int shift = dy < 0 ? -dy : dy;
+  if (dy == 0 || shift >= visible.size.y || drawn_after_move ||
+      layer->GetWindow()->HasTransparentColor() || IsCovered(layer, visible)) {
+    Draw(id, area);
+    return;
+  }
+
+  Rectangle<int> move_src{visible.pos,
+                          {visible.size.x, visible.size.y - shift}};
+  Vector2D<int> move_dst = visible.pos;
+  Rectangle<int> exposed{visible.pos, {visible.size.x, shift}};
+  if (dy > 0) {
+    move_src.pos.y += shift;
+    exposed.pos.y += visible.size.y - shift;
+  } else {
+    move_dst.y += shift;
+  }
+
+  back_buffer.Move(move_dst, move_src);
+  screen->Move(move_dst, move_src);
+
+  if (cursor) {
+    // 画面に描かれていたカーソルも一緒に動いてしまうので消しておく
+    const auto ghost =
+        visible &
+        Rectangle<int>{cursor_pos - Vector2D<int>{0, dy}, cursor->Size()};
+    screen->CopyFrom(back_buffer, ghost.pos, ghost);
+  }
+
+  Draw(id, {exposed.pos - window_pos, exposed.size});
+  DrawCursor(visible);
+}
+
+bool LayerManager::IsCovered(const Layer* layer,
+                             const Rectangle<int>& area) const {
+  auto it = std::find(layer_stack.begin(), layer_stack.end(), layer);
+  if (it == layer_stack.end()) {
+    return true;
+  }
+
+  for (++it; it != layer_stack.end(); ++it) {
+    const auto& win = (*it)->GetWindow();
+    if (!win) {
+      continue;
+    }
+    const auto overlap =
+        area & Rectangle<int>{(*it)->GetPosition(), win->Size()};
+    if (overlap.size.x > 0 && overlap.size.y > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void LayerManager::UpDown(unsigned int id, int new_height) {
   if (new_height < 0) {
     Hide(id);
@@ -126,6 +218,34 @@ void LayerManager::UpDown(unsigned int id, int new_height) {
   layer_stack.insert(new_pos, layer);
 }
 
+void LayerManager::SetCursor(const std::shared_ptr<Window>& cursor) {
+  this->cursor = cursor;
+}
+
+/*
+  マウスカーソルはレイヤスタックに含めず，画面へのコピー後に直接上書きする．
+  back_buffer はカーソルを含まない合成結果なので，カーソルの下に隠れていた
+  画素の退避先（save-under バッファ）としてそのまま使える．
+  移動時は古い位置を back_buffer から復元して新しい位置に描き直すだけで，
+  レイヤの再描画は行わない．
+*/
+void LayerManager::MoveCursor(Vector2D<int> new_position) {
+  if (!cursor) {
+    return;
+  }
+
+  const Rectangle<int> old_area{cursor_pos, cursor->Size()};
+  cursor_pos = new_position;
+  screen->CopyFrom(back_buffer, old_area.pos, old_area);
+  DrawCursor({cursor_pos, cursor->Size()});
+}
+
+void LayerManager::DrawCursor(const Rectangle<int>& area) const {
+  if (cursor) {
+    cursor->DrawTo(*screen, cursor_pos, area);
+  }
+}
+
 void LayerManager::Hide(unsigned int id) {
   auto layer = FindLayer(id);
   auto pos = std::find(layer_stack.begin(), layer_stack.end(), layer);
@@ -188,10 +308,6 @@ std::map<unsigned int, uint64_t>* layer_task_map;
 
 ActiveLayer::ActiveLayer(LayerManager& manager_) : manager(manager_) {}
 
-void ActiveLayer::SetMouseLayer(unsigned int mouse_layer) {
-  this->mouse_layer = mouse_layer;
-}
-
 void ActiveLayer::Activate(unsigned int layer_id) {
   if (active_layer == layer_id) {
     return;
@@ -207,7 +323,7 @@ void ActiveLayer::Activate(unsigned int layer_id) {
   if (active_layer > 0) {
     Layer* layer = manager.FindLayer(active_layer);
     layer->GetWindow()->Activate();
-    manager.UpDown(active_layer, manager.GetHeight(mouse_layer) - 1);
+    manager.UpDown(active_layer, std::numeric_limits<int>::max());
     manager.Draw(active_layer);
   }
 }
@@ -220,7 +336,7 @@ void InitializeLayer() {
 
   screen = new FrameBuffer();
   if (auto err = screen->Initialize(screen_config)) {
-    Log(kError,
+    Log(kError, "%s",
         CreateErrorMessage("failed to initialize frame_buffer", err).c_str());
     exit(1);
   }
@@ -254,5 +370,9 @@ void ProcessLayerMessage(const Message& msg) {
     case LayerOperation::DrawArea:
       layer_manager->Draw(arg.layer_id, {{arg.x, arg.y}, {arg.w, arg.h}});
       break;
+    case LayerOperation::Scroll:
+      layer_manager->Scroll(arg.layer_id, {{arg.x, arg.y}, {arg.w, arg.h}},
+                            arg.dy);
+      break;
   }
 }
@@ -32,11 +32,19 @@ class Layer {
 
   Vector2D<int> GetPosition() const { return pos; }
 
+  // 最後に DrawTo したときと，最後にスクロールを反映したときの
+  // Window::MoveCount()
+  uint64_t DrawnMoveCount() const { return drawn_move_count; }
+  uint64_t ScrolledMoveCount() const { return scrolled_move_count; }
+  void SetScrolledMoveCount(uint64_t count) { scrolled_move_count = count; }
+
  private:
   unsigned int id;
   Vector2D<int> pos;
   std::shared_ptr<Window> window;
   bool draggable = false;
+  mutable uint64_t drawn_move_count = 0;
+  uint64_t scrolled_move_count = 0;
 };
 
 class LayerManager {
@@ -55,8 +63,13 @@ class LayerManager {
   void Move(unsigned int id, Vector2D<int> new_position);
   void MoveRelative(unsigned int id, Vector2D<int> pos_diff);
 
+  void Scroll(unsigned int id, const Rectangle<int>& area, int dy);
+
   void UpDown(unsigned int id, int new_height);
 
+  void SetCursor(const std::shared_ptr<Window>& cursor);
+  void MoveCursor(Vector2D<int> new_position);
+
   void Hide(unsigned int id);
   Layer* FindLayerByPosition(Vector2D<int> pos, uint exclude_id) const;
   Layer* FindLayer(unsigned int id);
@@ -78,19 +91,22 @@ class LayerManager {
   std::vector<std::unique_ptr<Layer>> layers{};
   std::vector<Layer*> layer_stack{};
   unsigned int latest_id{0};
+
+  std::shared_ptr<Window> cursor{};
+  Vector2D<int> cursor_pos{0, 0};
+  void DrawCursor(const Rectangle<int>& area) const;
+  bool IsCovered(const Layer* layer, const Rectangle<int>& area) const;
 };
 
 class ActiveLayer {
  public:
   ActiveLayer(LayerManager& manager);
-  void SetMouseLayer(unsigned int mouse_layer);
   void Activate(unsigned int layer_id);
   unsigned int GetActive() const { return active_layer; }
 
  private:
   LayerManager& manager;
   unsigned int active_layer{0};
-  unsigned int mouse_layer{0};
 };
 
 extern ActiveLayer* active_layer;
@@ -111,5 +127,15 @@ constexpr Message MakeLayerMessage(uint64_t task_id, unsigned int layer_id,
   msg.arg.layer.y = area.pos.y;
   msg.arg.layer.w = area.size.x;
   msg.arg.layer.h = area.size.y;
+  msg.arg.layer.dy = 0;
+  return msg;
+}
+
+constexpr Message MakeLayerScrollMessage(uint64_t task_id,
+                                         unsigned int layer_id,
+                                         const Rectangle<int>& area, int dy) {
+  Message msg =
+      MakeLayerMessage(task_id, layer_id, LayerOperation::Scroll, area);
+  msg.arg.layer.dy = dy;
   return msg;
 }
@@ -2,15 +2,32 @@
 
 #include <cstddef>
 #include <cstdio>
+#include <cstring>
 
 #include "console.hpp"
+#include "serial.hpp"
+#include "trace.hpp"
 
 namespace {
 LogLevel log_level = kDebug;
+int log_sinks = kLogSinkConsole | kLogSinkSerial;
 }
 
 void SetLogLevel(LogLevel level) { log_level = level; }
 
+void SetLogSinks(int sinks) { log_sinks = sinks; }
+
+int LogSinks() { return log_sinks; }
+
+void WriteLogSinks(const char* s, size_t len) {
+  if (log_sinks & kLogSinkSerial) {
+    serial::Write(s, len);
+  }
+  if ((log_sinks & kLogSinkConsole) && console) {
+    console->PutString(s);
+  }
+}
+
 int Log(LogLevel level, const char* format, ...) {
   if (level > log_level) {
     return 0;
@@ -20,11 +37,21 @@ int Log(LogLevel level, const char* format, ...) {
   int result;
   char s[1024];
 
+  /* 整形せずにトレースバッファへ記録する．表示用のタスクが動いていれば，
+     整形と表示はそのタスクに任せる．ここでは整形しないので長さは分からず，
+     0 を返す． */
+  va_start(ap, format);
+  TraceV(kTraceLog, level, format, ap);
+  va_end(ap);
+  if (TraceLogRunning()) {
+    return 0;
+  }
+
   va_start(ap, format);
   result = vsprintf(s, format, ap);
   va_end(ap);
 
-  console->PutString(s);
+  WriteLogSinks(s, strlen(s));
 
   return result;
 }
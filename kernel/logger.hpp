@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 enum LogLevel {
   kError = 3,
   kWarn = 4,
@@ -7,7 +9,21 @@ enum LogLevel {
   kDebug = 7,
 };
 
+// Log() の出力先．ビットの組み合わせで指定する
+enum LogSink {
+  kLogSinkConsole = 1,
+  kLogSinkSerial = 2,
+};
+
 void SetLogLevel(LogLevel level);
+void SetLogSinks(int sinks);
+int LogSinks();
+// 整形済みの文字列を出力先に書く
+void WriteLogSinks(const char *s, size_t len);
 
+/*
+  ログを出力し，書いた文字数を返す．ログを表示するタスクが動いている間は
+  呼び出し元では整形せずにトレースバッファへ記録するだけなので，0 を返す．
+*/
 int Log(LogLevel level, const char *format, ...);
 int printk(const char *format, ...);
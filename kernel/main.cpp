@@ -11,6 +11,9 @@
 
 #include "acpi.hpp"
 #include "asmfunc.h"
+#include "benchmark.hpp"
+#include "boot_config.hpp"
+#include "boot_timeline.hpp"
 #include "console.hpp"
 #include "fat.hpp"
 #include "font.hpp"
@@ -26,12 +29,17 @@
 #include "mouse.hpp"
 #include "paging.hpp"
 #include "pci.hpp"
+#include "perf.hpp"
 #include "queue.hpp"
 #include "segment.hpp"
+#include "serial.hpp"
 #include "task.hpp"
 #include "terminal.hpp"
 #include "timer.hpp"
+#include "trace.hpp"
+#include "truetype.hpp"
 #include "usb/xhci/xhci.hpp"
+#include "virtio_blk.hpp"
 #include "window.hpp"
 
 class ScopedLock {
@@ -272,12 +280,51 @@ void UpdateLifeGame(uint64_t task_id, int64_t data) {
   }
 }
 
+/*
+  BOOT.CFG に deferred_init があるとき，最初の画面を出した後に残りの
+  ウィンドウと USB を初期化するタスク．data はライフゲームのタスク ID．
+  メインタスクが同時にレイヤーやイベントリングを触らないよう，
+  初期化は割り込みを禁止して行う．
+*/
+void TaskDeferredInit(uint64_t task_id, int64_t data) {
+  asm("cli");
+  Task &task = task_manager->CurrentTask();
+  InitializeTextWindow();
+  InitializeLifeGame(65, 40);
+  active_layer->Activate(lifegame_window_layer_id);
+  task_manager->Wakeup(data);
+  asm("sti");
+  StampBootPhase("deferred_windows");
+
+  // レイヤとオブザーバを先に用意しておけば，メインタスクが USB のイベントを
+  // 処理し始めても困らない
+  asm("cli");
+  InitializeKeyboard();
+  InitializeMouse();
+  asm("sti");
+
+  // xHC のリセットは時間がかかるので割り込みを許したまま行う．
+  // メインタスクと共有するポートの状態は Initialize の中で守る
+  usb::xhci::Initialize();
+  StampBootPhase("deferred_usb");
+
+  ReportBootTimeline();
+
+  while (true) {
+    asm("cli");
+    task.Sleep();
+    asm("sti");
+  }
+}
+
 alignas(16) uint8_t kernel_main_stack[1024 * 1024];
 
 extern "C" void KernelMainNewStack(const FrameBufferConfig &config_ref,
                                    const MemoryMap &memmap_ref,
                                    const acpi::RSDP &acpi_table,
-                                   void *volume_image) {
+                                   void *volume_image,
+                                   const BootInfo *boot_info) {
+  InitializeBootTimeline(boot_info);
   const FrameBufferConfig config{config_ref};
   const MemoryMap memmap{memmap_ref};
 
@@ -285,6 +332,9 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig &config_ref,
 
   InitializeGraphics(config);
   InitializeDirectConsole();
+  // 画面がなくてもログを取れるよう，COM1 をなるべく早く使えるようにする
+  serial::Initialize();
+  StampBootPhase("graphics");
 
   /*
     ログレベルの設定
@@ -300,22 +350,58 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig &config_ref,
 
   InitializeSegmentation();
   InitializePaging();
+  StampBootPhase("segmentation_paging");
   InitializeMemoryManager(memmap);
+  StampBootPhase("memory_manager");
   InitializeInterrupt();
-
-  fat::Initialize(volume_image);
+  serial::EnableInterrupt();
+  if (!InitializePerf()) {
+    printk("PMU is not available; perf counts TSC only\n");
+  }
+  StampBootPhase("interrupt_perf");
+
+  // 古いローダは読み込んだ量を伝えないが，16MiB より多くは読み込まない
+  const uint64_t volume_loaded_bytes = VolumeLoadedBytes();
+  fat::Initialize(volume_image, volume_loaded_bytes ? volume_loaded_bytes
+                                                    : 16 * 1024 * 1024);
+  if (auto err = InitializeTrueTypeFont("nihongo.ttf")) {
+    printk("TrueType font is not available: %s\n", err.Name());
+  }
+  StampBootPhase("fat_font");
   InitializePCI();
+  StampBootPhase("pci");
+
+  // virtio-blk に FAT ボリュームがあれば，ブートボリュームの代わりに使う
+  if (auto err = virtio::InitializeBlock()) {
+    printk("virtio-blk is not available: %s\n", err.Name());
+  } else if (auto err = fat::Initialize(*virtio::block_driver)) {
+    printk("virtio-blk has no FAT volume: %s\n", err.Name());
+  } else {
+    printk("mounted virtio-blk (%lu sectors)\n",
+           virtio::block_driver->SectorCount());
+  }
+
+  LoadBootConfig("boot.cfg");
+  StampBootPhase("virtio_boot_config");
+
+  // 最初の画面を早く出すため，急がないウィンドウと USB を後回しにする
+  const bool deferred_init = BootConfig("deferred_init") != nullptr;
 
   InitializeLayer();
   InitializeMainWindow();
-  InitializeTextWindow();
-  InitializeLifeGame(65, 40);
+  if (!deferred_init) {
+    InitializeTextWindow();
+    InitializeLifeGame(65, 40);
+  }
+  StampBootPhase("layer");
 
   layer_manager->Draw({{0, 0}, screen_size});
   layer_manager->Draw(1);
+  StampBootPhase("first_frame");
 
   acpi::Initialize(acpi_table);
   InitializeLAPICTimer();
+  StampBootPhase("acpi_lapic_timer");
 
   const int kTextBoxCursorTimer = 1;
   const int kTimer1Sec = static_cast<int>(kTimerFreq * 1);
@@ -328,20 +414,38 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig &config_ref,
 
   auto &main_task = task_manager->CurrentTask();
 
-  const auto lifegame_taskid =
-      task_manager->NewTask(0)
-          .InitContext(UpdateLifeGame, 0xdeadbeefc0ffee)
-          .Wakeup()
-          .ID();
+  // 後回しにするときは，ウィンドウを作ったタスクが起こす
+  auto &lifegame_task =
+      task_manager->NewTask(0).InitContext(UpdateLifeGame, 0xdeadbeefc0ffee);
+  const auto lifegame_taskid = lifegame_task.ID();
+  if (!deferred_init) {
+    lifegame_task.Wakeup();
+  }
 
   const auto terminal_taskid =
       task_manager->NewTask().InitContext(TaskTerminal, 0).Wakeup().ID();
 
-  usb::xhci::Initialize();
-  InitializeKeyboard();
-  InitializeMouse();
+  // ここから Log() はトレースバッファに記録され，表示は優先度の低いタスクが行う
+  task_manager->NewTask(0).InitContext(TaskTraceLog, 0).Wakeup();
 
-  active_layer->Activate(lifegame_window_layer_id);
+  // BOOT.CFG に bench=all などとあれば，起動後にベンチマークを流す
+  if (BootConfig("bench")) {
+    task_manager->NewTask().InitContext(TaskBenchmarkSuite, 0).Wakeup();
+  }
+
+  if (deferred_init) {
+    task_manager->NewTask()
+        .InitContext(TaskDeferredInit, lifegame_taskid)
+        .Wakeup();
+  } else {
+    usb::xhci::Initialize();
+    InitializeKeyboard();
+    InitializeMouse();
+    StampBootPhase("usb");
+
+    active_layer->Activate(lifegame_window_layer_id);
+    ReportBootTimeline();
+  }
 
   char str[128];
 
@@ -397,8 +501,11 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig &config_ref,
                                           kTextBoxCursorTimer});
           }
           textbox_cursor_visible = !textbox_cursor_visible;
-          DrawTextCursor(textbox_cursor_visible);
-          layer_manager->Draw(text_window_layer_id);
+          // 後回しにした初期化が終わるまではテキストボックスがない
+          if (text_window) {
+            DrawTextCursor(textbox_cursor_visible);
+            layer_manager->Draw(text_window_layer_id);
+          }
           {
             ScopedLock lock;
             task_manager->SendMessage(terminal_taskid, *msg);
@@ -442,6 +549,12 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig &config_ref,
                                     Message{Message::kLayerFinish});
         }
         break;
+      case Message::kConsoleLog:
+        // ログ表示タスクが整形した行．描画し終えたら文字列を返す
+        console->PutString(msg->arg.console.text);
+        task_manager->SendMessage(msg->src_task,
+                                  Message{Message::kLayerFinish});
+        break;
 
       default:
         Log(kError, "Unknown message type: %d\n", msg->type);
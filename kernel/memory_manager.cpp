@@ -12,7 +12,7 @@ WithError<FrameID> BitmapMemoryManager::Allocate(size_t num_frames) {
   while (true) {
     size_t i = 0;
     for (; i < num_frames; ++i) {
-      if (start_frame_id + 1 >= range_end.ID()) {
+      if (start_frame_id + i >= range_end.ID()) {
         return {kNullFrame, MAKE_ERROR(Error::kNoEnoughMemory)};
       }
       if (GetBit(FrameID{start_frame_id + i})) {
@@ -29,7 +29,7 @@ WithError<FrameID> BitmapMemoryManager::Allocate(size_t num_frames) {
 
 Error BitmapMemoryManager::Free(FrameID start_frame, size_t num_frames) {
   for (size_t i = 0; i < num_frames; ++i) {
-    SetBit(FrameID{start_frame.ID() + 1}, false);
+    SetBit(FrameID{start_frame.ID() + i}, false);
   }
 
   return MAKE_ERROR(Error::kSuccess);
@@ -68,9 +68,9 @@ void BitmapMemoryManager::SetBit(FrameID frame, bool allocated) {
 }
 
 extern "C" caddr_t program_break, program_break_end;
+BitmapMemoryManager* memory_manager;
 namespace {
 char memory_manager_buf[sizeof(BitmapMemoryManager)];
-BitmapMemoryManager* memory_manager;
 
 Error InitializeHeap(BitmapMemoryManager& memory_manager) {
   const int kHeapFreams = 64 * 512;
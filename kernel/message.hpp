@@ -1,7 +1,8 @@
 #pragma once
+#include <cstdint>
 #include <deque>
 
-enum class LayerOperation { Move, MoveRelative, Draw, DrawArea };
+enum class LayerOperation { Move, MoveRelative, Draw, DrawArea, Scroll };
 
 struct Message {
   enum Type {
@@ -10,6 +11,10 @@ struct Message {
     kKeyPush,
     kLayer,
     kLayerFinish,
+    kBlockIOComplete,
+    kBenchPing,
+    kBenchPong,
+    kConsoleLog,
   } type;
 
   uint64_t src_task;
@@ -31,7 +36,21 @@ struct Message {
       unsigned int layer_id;
       int x, y;
       int w, h;
+      int dy;
     } layer;
+
+    struct {
+      uint32_t request_id;
+      uint8_t status;  // 0 なら成功
+    } block_io;
+
+    struct {
+      uint64_t switches;  // 応答する前にタスクを切り替える回数
+    } bench;
+
+    struct {
+      const char* text;  // 表示し終えるまで書き換えてはならない
+    } console;
   } arg;
 };
 
@@ -42,7 +42,7 @@ std::shared_ptr<Mouse> mouse;
 
 void Mouse::SetPosition(Vector2D<int> position) {
   this->position = position;
-  layer_manager->Move(layer_id, position);
+  layer_manager->MoveCursor(position);
 }
 
 void Mouse::OnInterrupt(uint8_t buttons, int8_t displacement_x,
@@ -54,7 +54,7 @@ void Mouse::OnInterrupt(uint8_t buttons, int8_t displacement_x,
 
   const auto pos_diff = position - old_pos;
 
-  layer_manager->Move(layer_id, position);
+  layer_manager->MoveCursor(position);
 
   Log(kDebug, "MouseObserver: (%d,%d)\n", displacement_x, displacement_y);
 
@@ -62,7 +62,7 @@ void Mouse::OnInterrupt(uint8_t buttons, int8_t displacement_x,
   const bool left_pressed = buttons & 0x01;
 
   if (!previous_left_pressed && left_pressed) {
-    auto layer = layer_manager->FindLayerByPosition(position, layer_id);
+    auto layer = layer_manager->FindLayerByPosition(position, 0);
     if (layer && layer->IsDraggable()) {
       drag_layer_id = layer->ID();
       active_layer->Activate(layer->ID());
@@ -100,16 +100,13 @@ void InitializeMouse() {
 
   mouse_window->SetTrasparentColor(kMouseTransparentColor);
   DrawMouseCursor(*mouse_window, {0, 0});
-  auto mouse_layer_id = layer_manager->NewLayer().SetWindow(mouse_window).ID();
-  auto mouse = std::make_shared<Mouse>(mouse_layer_id);
+  layer_manager->SetCursor(mouse_window);
 
+  auto mouse = std::make_shared<Mouse>();
   mouse->SetPosition({200, 200});
-  layer_manager->UpDown(mouse->LayerID(), std::numeric_limits<int>::max());
 
   usb::HIDMouseDriver::default_observer =
       [mouse](uint8_t buttons, int8_t displacement_x, int8_t displacement_y) {
         mouse->OnInterrupt(buttons, displacement_x, displacement_y);
       };
-
-  active_layer->SetMouseLayer(mouse_layer_id);
 }
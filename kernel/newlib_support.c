@@ -1,7 +1,12 @@
 #include <errno.h>
 #include <sys/types.h>
 
+// backtrace.cpp にある
+void PrintBacktraceHere(void);
+
+// exit() から呼ばれる．どこで終わったのか分かるようにバックトレースを出す
 void _exit(void) {
+  PrintBacktraceHere();
   while (1) __asm__("hlt");
 }
 
@@ -25,13 +30,7 @@ int kill(int pid, int sig) {
   return -1;
 }
 
-int isatty(int fd) { return 0; }
-int close(int fd) { return 0; }
-off_t lseek(int fd, off_t offset, int whence) { return 0; }
-
-ssize_t read(int fd, void *buf, size_t count) { return 0; }
-
-ssize_t write(int fd, const void *buf, size_t count) { return 0; }
-int fstat(int fd, struct stat *buf) { return 0; }
+/* open, close, read, write, lseek, fstat, isatty はファイル記述子を扱うので
+   file.cpp に置く */
 
 int *__errno_location() { return 0; }
@@ -15,6 +15,33 @@ alignas(kPageSize4K) std::array<uint64_t, 512> pdp_table;
 alignas(kPageSize4K)
     std::array<std::array<uint64_t, 512>, kPageDirectoryCount> page_directory;
 
+/* ファイルマップ用の領域．PML4 の 2 番目のエントリが指す 1GiB を使う．
+   マップは 2MiB 単位の区画に先頭をそろえて置き，使う区画ごとに
+   ページテーブルをプールから割り当てる．PDE が 0 の区画は空いている．
+   Unmap すると区画とページテーブルを返すので，どちらも使い回される． */
+const uint64_t kMapWindowBase = 512 * kPageSize1G;
+const size_t kMapPageTableCount = 256;
+
+using PageTable = std::array<uint64_t, 512>;
+
+alignas(kPageSize4K) std::array<uint64_t, 512> map_pdp_table;
+alignas(kPageSize4K) std::array<uint64_t, 512> map_page_directory;
+alignas(kPageSize4K) std::array<PageTable, kMapPageTableCount> map_page_tables;
+std::array<PageTable*, kMapPageTableCount> free_map_page_tables;
+size_t num_free_map_page_tables;
+
+// phys から bytes バイトを覆う 4KiB ページの範囲 [begin, end)
+void PageRange(uintptr_t phys, size_t bytes, uint64_t& begin, uint64_t& end) {
+  begin = phys & ~(kPageSize4K - 1);
+  end = (phys + (bytes > 0 ? bytes : 1) + kPageSize4K - 1) &
+        ~(kPageSize4K - 1);
+}
+
+PageTable* MapPageTable(uint64_t virt) {
+  const auto pde = map_page_directory[(virt - kMapWindowBase) / kPageSize2M];
+  return reinterpret_cast<PageTable*>(pde & ~0xfffull);
+}
+
 }  // namespace
 
 void SetupIdentityPageTable() {
@@ -28,7 +55,91 @@ void SetupIdentityPageTable() {
     }
   }
 
+  pml4_table[1] = reinterpret_cast<uint64_t>(&map_pdp_table[0]) | 0x003;
+  map_pdp_table[0] = reinterpret_cast<uint64_t>(&map_page_directory[0]) | 0x003;
+  map_page_directory.fill(0);
+  for (size_t i = 0; i < kMapPageTableCount; ++i) {
+    free_map_page_tables[i] = &map_page_tables[i];
+  }
+  num_free_map_page_tables = kMapPageTableCount;
+
   SetCR3(reinterpret_cast<uint64_t>(&pml4_table[0]));
 }
 
-void InitializePaging() { SetupIdentityPageTable(); }
\ No newline at end of file
+void InitializePaging() {
+  SetupIdentityPageTable();
+  // CR0.WP をセットし，カーネルからも読み込み専用ページに書けないようにする
+  SetCR0(GetCR0() | (1u << 16));
+}
+
+WithError<uintptr_t> MapReadOnly(uintptr_t phys, size_t bytes) {
+  uint64_t phys_begin, phys_end;
+  PageRange(phys, bytes, phys_begin, phys_end);
+  const size_t num_slots =
+      (phys_end - phys_begin + kPageSize2M - 1) / kPageSize2M;
+  if (num_slots > num_free_map_page_tables) {
+    return {0, MAKE_ERROR(Error::kNoEnoughMemory)};
+  }
+
+  // 連続して空いている区画を前から探す
+  size_t first_slot = 0, free_slots = 0;
+  for (size_t i = 0; i < map_page_directory.size(); ++i) {
+    if (map_page_directory[i] != 0) {
+      first_slot = i + 1;
+      free_slots = 0;
+    } else if (++free_slots == num_slots) {
+      break;
+    }
+  }
+  if (free_slots < num_slots) {
+    return {0, MAKE_ERROR(Error::kNoEnoughMemory)};
+  }
+
+  for (size_t i = first_slot; i < first_slot + num_slots; ++i) {
+    auto pt = free_map_page_tables[--num_free_map_page_tables];
+    pt->fill(0);
+    map_page_directory[i] = reinterpret_cast<uint64_t>(&(*pt)[0]) | 0x003;
+  }
+
+  const uint64_t virt_begin = kMapWindowBase + first_slot * kPageSize2M;
+  for (uint64_t p = phys_begin; p < phys_end; p += kPageSize4K) {
+    const uint64_t virt = virt_begin + (p - phys_begin);
+    // Present のみ．R/W ビットを立てないので読み込み専用になる
+    (*MapPageTable(virt))[(virt / kPageSize4K) % 512] = p | 0x001;
+  }
+
+  return {virt_begin + (phys - phys_begin), MAKE_ERROR(Error::kSuccess)};
+}
+
+void Remap(uintptr_t virt, uintptr_t phys, size_t bytes) {
+  uint64_t begin, end;
+  PageRange(virt, bytes, begin, end);
+  const uint64_t phys_begin = phys & ~(kPageSize4K - 1);
+  for (uint64_t v = begin; v < end; v += kPageSize4K) {
+    auto pt = MapPageTable(v);
+    if (!pt) {
+      continue;
+    }
+    (*pt)[(v / kPageSize4K) % 512] = (phys_begin + (v - begin)) | 0x001;
+    asm volatile("invlpg (%0)" : : "r"(v) : "memory");
+  }
+}
+
+void Unmap(uintptr_t virt, size_t bytes) {
+  uint64_t begin, end;
+  PageRange(virt, bytes, begin, end);
+  // マップは区画の先頭から始まるので，区画ごと空ける
+  for (uint64_t slot = begin & ~(kPageSize2M - 1); slot < end;
+       slot += kPageSize2M) {
+    auto& pde = map_page_directory[(slot - kMapWindowBase) / kPageSize2M];
+    if (pde == 0) {
+      continue;
+    }
+    free_map_page_tables[num_free_map_page_tables++] =
+        reinterpret_cast<PageTable*>(pde & ~0xfffull);
+    pde = 0;
+  }
+  for (uint64_t v = begin; v < end; v += kPageSize4K) {
+    asm volatile("invlpg (%0)" : : "r"(v) : "memory");
+  }
+}
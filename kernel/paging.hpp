@@ -1,8 +1,26 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+
+#include "error.hpp"
 
 const size_t kPageDirectoryCount = 64;
 
 void SetupIdentityPageTable();
 void InitializePaging();
+
+/*
+  物理アドレス phys から bytes バイトを，ファイルマップ用の仮想アドレス領域に
+  4KiB ページ単位で読み込み専用としてマップし，phys に対応する仮想アドレスを
+  返す．全タスクが同じページテーブルを使うので，どのタスクからも見える．
+  Unmap で解除した仮想アドレスとページテーブルは次のマップで使い回す．
+*/
+WithError<uintptr_t> MapReadOnly(uintptr_t phys, size_t bytes);
+/*
+  MapReadOnly で得た virt からの bytes バイトを，別の物理アドレス phys に
+  向け直す．仮想アドレスは変わらない．phys はページ内の位置が virt と
+  同じでなければならない．
+*/
+void Remap(uintptr_t virt, uintptr_t phys, size_t bytes);
+void Unmap(uintptr_t virt, size_t bytes);
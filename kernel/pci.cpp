@@ -143,7 +143,31 @@ Error ConfigureMSIRegister(const Device& dev, uint8_t cap_addr,
 Error ConfigureMSIXRegister(const Device& dev, uint8_t cap_addr,
                             uint32_t msg_addr, uint32_t msg_data,
                             unsigned int num_vector_exponent) {
-  return MAKE_ERROR(Error::kNotImplemented);
+  auto header = ReadCapabilityHeader(dev, cap_addr);
+  const uint32_t table_reg = ReadConfReg(dev, cap_addr + 4);
+
+  Device bar_dev = dev;
+  const auto bar = ReadBar(bar_dev, table_reg & 0x7u);
+  if (bar.error) {
+    return bar.error;
+  }
+
+  // MSI-X テーブルは BAR が指すメモリ空間にあり，1 エントリ 16 バイト
+  auto table = reinterpret_cast<volatile uint32_t*>(
+      (bar.value & ~static_cast<uint64_t>(0xf)) + (table_reg & ~0x7u));
+  const unsigned int table_size = (header.bits.cap & 0x7ffu) + 1;
+  const unsigned int num_vectors = 1u << num_vector_exponent;
+  for (unsigned int i = 0; i < table_size && i < num_vectors; ++i) {
+    table[4 * i + 0] = msg_addr;
+    table[4 * i + 1] = 0;
+    table[4 * i + 2] = msg_data;
+    table[4 * i + 3] = 0;  // マスクを解除する
+  }
+
+  // Message Control の MSI-X Enable をセットし，Function Mask をクリアする
+  header.data = (header.data | (1u << 31)) & ~(1u << 30);
+  WriteConfReg(dev, cap_addr, header.data);
+  return MAKE_ERROR(Error::kSuccess);
 }
 
 }  // namespace
@@ -263,7 +287,7 @@ Error ConfigureMSI(const Device& dev, uint32_t msg_addr, uint32_t msg_data,
     return ConfigureMSIRegister(dev, msi_cap_addr, msg_addr, msg_data,
                                 num_vector_exponent);
   } else if (msix_cap_addr) {
-    return ConfigureMSIXRegister(dev, msi_cap_addr, msg_addr, msg_data,
+    return ConfigureMSIXRegister(dev, msix_cap_addr, msg_addr, msg_data,
                                  num_vector_exponent);
   }
 
@@ -275,7 +299,7 @@ Error ConfigureMSIFixedDestination(const Device& dev, uint8_t apic_id,
                                    MSIDeliveryMode delivery_mode,
                                    uint8_t vector,
                                    unsigned int num_vector_exponent) {
-  uint32_t msg_addr = 0xfee00000u | (apic_id < 12);
+  uint32_t msg_addr = 0xfee00000u | (apic_id << 12);
   uint32_t msg_data = (static_cast<uint32_t>(delivery_mode) << 8) | vector;
   if (trigger_mode == MSITriggerMode::kLevel) {
     msg_data |= 0xc000;
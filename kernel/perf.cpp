@@ -0,0 +1,168 @@
+#include "perf.hpp"
+
+#include <cstdio>
+
+#include "asmfunc.h"
+#include "interrupt.hpp"
+#include "timer.hpp"
+
+namespace {
+
+const uint32_t kIA32PerfEvtSel0 = 0x186;
+const uint32_t kIA32FixedCtrCtrl = 0x38d;
+const uint32_t kIA32PerfGlobalCtrl = 0x38f;
+
+const uint64_t kEvtSelUser = 1u << 16;
+const uint64_t kEvtSelOS = 1u << 17;
+const uint64_t kEvtSelEnable = 1u << 22;
+
+// rdpmc の ecx でこのビットを立てると固定カウンタを読む
+const uint32_t kFixedCounter = 1u << 30;
+
+struct CounterConfig {
+  bool available;
+  bool fixed;
+  uint32_t index;  // rdpmc に渡す番号（kFixedCounter を除く）
+  uint64_t mask;   // カウンタの幅
+};
+
+CounterConfig counters[kPerfEventCount];
+PerfRegion* regions;
+
+const char* const kEventNames[kPerfEventCount] = {
+    "ns", "cycles", "instructions", "llc-misses", "tlb-misses",
+};
+
+void SetupGeneralCounter(PerfEvent event, uint32_t index, uint8_t event_select,
+                         uint8_t umask, uint64_t mask) {
+  WriteMSR(kIA32PerfEvtSel0 + index, event_select | (umask << 8) |
+                                         kEvtSelUser | kEvtSelOS |
+                                         kEvtSelEnable);
+  counters[event] = {true, false, index, mask};
+}
+
+}  // namespace
+
+bool InitializePerf() {
+  counters[kPerfTSC] = {true, false, 0, ~static_cast<uint64_t>(0)};
+
+  uint32_t eax, ebx, ecx, edx;
+  CPUID(0, 0, &eax, &ebx, &ecx, &edx);
+  if (eax < 0x0a) {
+    return false;
+  }
+  CPUID(0x0a, 0, &eax, &ebx, &ecx, &edx);
+
+  const uint32_t version = eax & 0xff;
+  const uint32_t num_general = (eax >> 8) & 0xff;
+  const uint32_t general_width = (eax >> 16) & 0xff;
+  const uint32_t num_fixed = edx & 0x1f;
+  const uint32_t fixed_width = (edx >> 5) & 0xff;
+  if (version == 0 || num_general == 0) {
+    return false;
+  }
+
+  auto width_mask = [](uint32_t width) {
+    return width >= 64 ? ~static_cast<uint64_t>(0)
+                       : (static_cast<uint64_t>(1) << width) - 1;
+  };
+
+  uint64_t global_ctrl = 0;
+  // 固定カウンタ 0 は命令数，1 はコアサイクル．バージョン 2 から使える
+  if (version >= 2 && num_fixed >= 2) {
+    WriteMSR(kIA32FixedCtrCtrl, 0x33);  // OS と USR の両方で数える
+    counters[kPerfInstructions] = {true, true, 0, width_mask(fixed_width)};
+    counters[kPerfCycles] = {true, true, 1, width_mask(fixed_width)};
+    global_ctrl |= static_cast<uint64_t>(0x3) << 32;
+  }
+
+  // EBX のビットが立っているアーキテクチャイベントは使えない
+  const bool llc_miss_available = (ebx & (1u << 4)) == 0;
+  uint32_t next_general = 0;
+  if (llc_miss_available && next_general < num_general) {
+    SetupGeneralCounter(kPerfLLCMisses, next_general++, 0x2e, 0x41,
+                        width_mask(general_width));
+  }
+  // TLB ミスはアーキテクチャイベントにないので，Nehalem 以降の
+  // DTLB_LOAD_MISSES.MISS_CAUSES_A_WALK を使う
+  if (next_general < num_general) {
+    SetupGeneralCounter(kPerfTLBMisses, next_general++, 0x08, 0x01,
+                        width_mask(general_width));
+  }
+  global_ctrl |= (static_cast<uint64_t>(1) << next_general) - 1;
+
+  if (version >= 2) {
+    WriteMSR(kIA32PerfGlobalCtrl, global_ctrl);
+  }
+  return true;
+}
+
+bool PerfEventAvailable(PerfEvent event) { return counters[event].available; }
+
+const char* PerfEventName(PerfEvent event) { return kEventNames[event]; }
+
+PerfCounts ReadPerfCounters() {
+  PerfCounts counts{};
+  counts.value[kPerfTSC] = ReadTSC();
+  for (int i = kPerfTSC + 1; i < kPerfEventCount; ++i) {
+    const auto& c = counters[i];
+    if (c.available) {
+      counts.value[i] = ReadPMC(c.fixed ? kFixedCounter | c.index : c.index);
+    }
+  }
+  return counts;
+}
+
+PerfCounts PerfDelta(const PerfCounts& start, const PerfCounts& end) {
+  PerfCounts delta{};
+  for (int i = 0; i < kPerfEventCount; ++i) {
+    if (counters[i].available) {
+      delta.value[i] = (end.value[i] - start.value[i]) & counters[i].mask;
+    }
+  }
+  return delta;
+}
+
+ScopedPerfCounter::ScopedPerfCounter(PerfRegion& region)
+    : region_{region}, start_{ReadPerfCounters()} {}
+
+ScopedPerfCounter::~ScopedPerfCounter() {
+  const auto delta = PerfDelta(start_, ReadPerfCounters());
+  const auto rflags = SaveAndDisableInterrupts();
+  if (!region_.registered) {
+    region_.registered = true;
+    region_.next = regions;
+    regions = &region_;
+  }
+  ++region_.calls;
+  region_.total += delta;
+  RestoreInterrupts(rflags);
+}
+
+PerfRegion* PerfRegions() { return regions; }
+
+void ResetPerfRegions() {
+  asm("cli");
+  for (auto r = regions; r; r = r->next) {
+    r->calls = 0;
+    r->total = {};
+  }
+  asm("sti");
+}
+
+size_t FormatPerfCounts(const char* name, uint64_t calls,
+                        const PerfCounts& counts, char* buf, size_t size) {
+  size_t len = snprintf(buf, size, "%s calls=%lu", name, calls);
+  for (int i = 0; i < kPerfEventCount && len < size; ++i) {
+    if (!counters[i].available) {
+      continue;
+    }
+    const auto value = i == kPerfTSC ? TSCToNanoseconds(counts.value[i])
+                                     : counts.value[i];
+    len += snprintf(&buf[len], size - len, " %s=%lu", kEventNames[i], value);
+  }
+  if (len < size) {
+    len += snprintf(&buf[len], size - len, "\n");
+  }
+  return len < size ? len : size - 1;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum PerfEvent {
+  kPerfTSC,  // 常に使える
+  kPerfCycles,
+  kPerfInstructions,
+  kPerfLLCMisses,
+  kPerfTLBMisses,
+  kPerfEventCount,
+};
+
+struct PerfCounts {
+  uint64_t value[kPerfEventCount];
+
+  PerfCounts& operator+=(const PerfCounts& rhs) {
+    for (int i = 0; i < kPerfEventCount; ++i) {
+      value[i] += rhs.value[i];
+    }
+    return *this;
+  }
+};
+
+/*
+  アーキテクチャ性能監視（CPUID 0x0A）のカウンタを設定する．
+  サイクルと命令数は固定カウンタ，LLC ミスと TLB ミスは汎用カウンタで数える．
+  PMU がない環境（QEMU の TCG など）では TSC だけを数え，false を返す．
+*/
+bool InitializePerf();
+bool PerfEventAvailable(PerfEvent event);
+const char* PerfEventName(PerfEvent event);
+
+// カウンタは止めずに回し続けるので，2 回読んだ差を使う
+PerfCounts ReadPerfCounters();
+// カウンタの幅を考慮して end - start を求める
+PerfCounts PerfDelta(const PerfCounts& start, const PerfCounts& end);
+
+/*
+  ScopedPerfCounter で計測するコード領域．初期化子だけで作れるので，
+  名前空間スコープに置けば大域コンストラクタを必要としない．
+    PerfRegion draw_perf{"LayerManager::Draw"};
+*/
+struct PerfRegion {
+  const char* name;
+  uint64_t calls;
+  PerfCounts total;
+  PerfRegion* next;  // 計測した領域の一覧
+  bool registered;
+};
+
+// 生成から破棄までの間のカウンタの増分を region に足す
+class ScopedPerfCounter {
+ public:
+  explicit ScopedPerfCounter(PerfRegion& region);
+  ~ScopedPerfCounter();
+
+ private:
+  PerfRegion& region_;
+  PerfCounts start_;
+};
+
+// 一度でも計測した領域を，最後に計測を始めたものから順にたどる
+PerfRegion* PerfRegions();
+void ResetPerfRegions();
+
+/* region や task の計測値を 1 行にまとめる．
+   TSC はナノ秒に直し，使えないイベントは表示しない． */
+size_t FormatPerfCounts(const char* name, uint64_t calls,
+                        const PerfCounts& counts, char* buf, size_t size);
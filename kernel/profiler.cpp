@@ -0,0 +1,43 @@
+#include "profiler.hpp"
+
+#include "task.hpp"
+
+namespace {
+
+// kTimerFreq = 100Hz で 160 秒余り記録できる
+const size_t kMaxSamples = 16384;
+ProfileSample samples[kMaxSamples];
+size_t num_samples;
+uint64_t dropped;
+volatile bool running;
+
+}  // namespace
+
+void StartProfiler() {
+  asm("cli");
+  num_samples = 0;
+  dropped = 0;
+  running = true;
+  asm("sti");
+}
+
+void StopProfiler() { running = false; }
+
+bool ProfilerRunning() { return running; }
+
+void RecordProfileSample(uint64_t rip) {
+  if (!running) {
+    return;
+  }
+  if (num_samples == kMaxSamples) {
+    ++dropped;
+    return;
+  }
+  samples[num_samples++] = {rip, task_manager->CurrentTask().ID()};
+}
+
+size_t ProfileSampleCount() { return num_samples; }
+
+const ProfileSample* ProfileSamples() { return samples; }
+
+uint64_t ProfileDropped() { return dropped; }
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct ProfileSample {
+  uint64_t rip;
+  uint64_t task_id;
+};
+
+/*
+  タイマ割り込みのたびに，割り込まれた場所とタスクを記録する
+  サンプリングプロファイラ．
+  CPU は 1 つしか使っていないので，バッファも 1 つだけ持つ．
+
+  サンプルはタイマ割り込み（kTimerFreq = 100Hz）からしか取らない．
+  性能カウンタのオーバーフロー割り込み（PMI）は使っていないので，
+  10ms より細かい分布は見えない．また cli してから sti するまでの間に
+  来た割り込みは sti の直後で処理されるので，割り込み禁止中に動いていた
+  コード（割り込みハンドラや cli で守った区間）は記録されず，その時間は
+  sti した場所に数えられる．
+*/
+void StartProfiler();
+void StopProfiler();
+bool ProfilerRunning();
+
+// タイマ割り込みハンドラから呼ぶ
+void RecordProfileSample(uint64_t rip);
+
+size_t ProfileSampleCount();
+const ProfileSample* ProfileSamples();
+// バッファが一杯で捨てたサンプルの数
+uint64_t ProfileDropped();
@@ -0,0 +1,21 @@
+#include "qemu.hpp"
+
+#include "asmfunc.h"
+#include "serial.hpp"
+
+namespace {
+
+const uint16_t kDebugExitPort = 0xf4;
+
+}  // namespace
+
+void ExitQemu(uint32_t status) {
+  // 書き込んだ直後に QEMU が終わるので，シリアルに積んだ分を先に出し切る
+  serial::Flush();
+  IoOut32(kDebugExitPort, status);
+
+  asm("cli");
+  while (true) {
+    asm("hlt");
+  }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+  QEMU の isa-debug-exit デバイスに status を書いて QEMU を終了させる．
+  QEMU の終了コードは (status << 1) | 1 になる．
+    -device isa-debug-exit,iobase=0xf4,iosize=0x04
+  デバイスがなければ何も起きないので，そのまま CPU を止める．
+*/
+[[noreturn]] void ExitQemu(uint32_t status);
@@ -0,0 +1,138 @@
+#include "serial.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "asmfunc.h"
+#include "interrupt.hpp"
+
+namespace {
+
+const uint16_t kCOM1 = 0x3f8;
+const int kIRQCOM1 = 4;
+
+// ベースアドレスからのオフセット
+const uint16_t kData = 0;             // DLAB=1 のときは除数の下位
+const uint16_t kInterruptEnable = 1;  // DLAB=1 のときは除数の上位
+const uint16_t kFIFOControl = 2;      // 読むと割り込み識別レジスタ
+const uint16_t kLineControl = 3;
+const uint16_t kModemControl = 4;
+const uint16_t kLineStatus = 5;
+const uint16_t kScratch = 7;
+
+const uint8_t kEnableTransmitEmpty = 0x02;
+const uint8_t kTransmitEmpty = 0x20;  // 送信 FIFO が空
+const size_t kFIFOBytes = 16;
+
+// 2 のべき乗にしておく
+const size_t kBufferBytes = 16 * 1024;
+char tx_buffer[kBufferBytes];
+size_t tx_read, tx_count;
+bool available;
+
+// 送信 FIFO が空なら，リングから最大 16 バイトを移す
+void FillFIFO() {
+  if ((IoIn8(kCOM1 + kLineStatus) & kTransmitEmpty) == 0) {
+    return;
+  }
+  for (size_t i = 0; i < kFIFOBytes && tx_count > 0; ++i) {
+    IoOut8(kCOM1 + kData, tx_buffer[tx_read]);
+    tx_read = (tx_read + 1) % kBufferBytes;
+    --tx_count;
+  }
+  // 送ることがなくなったら送信割り込みを止める
+  IoOut8(kCOM1 + kInterruptEnable, tx_count > 0 ? kEnableTransmitEmpty : 0);
+}
+
+}  // namespace
+
+namespace serial {
+
+bool Initialize() {
+  // スクラッチレジスタに書いた値が読めなければ UART はない
+  IoOut8(kCOM1 + kScratch, 0xae);
+  if (IoIn8(kCOM1 + kScratch) != 0xae) {
+    return false;
+  }
+
+  IoOut8(kCOM1 + kInterruptEnable, 0);
+  IoOut8(kCOM1 + kLineControl, 0x80);  // 除数を設定するため DLAB を立てる
+  IoOut8(kCOM1 + kData, 1);            // 115200 bps
+  IoOut8(kCOM1 + kInterruptEnable, 0);
+  IoOut8(kCOM1 + kLineControl, 0x03);  // 8N1
+  IoOut8(kCOM1 + kFIFOControl, 0xc7);  // FIFO を有効にしてクリアする
+  // DTR, RTS と，割り込みを CPU へ通すための OUT2
+  IoOut8(kCOM1 + kModemControl, 0x0b);
+
+  tx_read = tx_count = 0;
+  available = true;
+  return true;
+}
+
+void EnableInterrupt() {
+  if (available) {
+    RouteISAInterrupt(kIRQCOM1, InterruptVector::kSerial);
+  }
+}
+
+bool Available() { return available; }
+
+void Write(const char* buf, size_t len) {
+  if (!available) {
+    return;
+  }
+
+  while (len > 0) {
+    const auto rflags = SaveAndDisableInterrupts();
+    while (tx_count == kBufferBytes) {
+      // 一杯なので，割り込みを待たずに送信を進める
+      FillFIFO();
+      __asm__("pause");
+    }
+
+    const size_t write = (tx_read + tx_count) % kBufferBytes;
+    const size_t n =
+        std::min({len, kBufferBytes - tx_count, kBufferBytes - write});
+    memcpy(&tx_buffer[write], buf, n);
+    tx_count += n;
+    buf += n;
+    len -= n;
+
+    // FIFO が空いていればここで送り始め，残りは送信割り込みに任せる
+    FillFIFO();
+    RestoreInterrupts(rflags);
+  }
+}
+
+void Write(const char* s) { Write(s, strlen(s)); }
+
+void Flush() {
+  if (!available) {
+    return;
+  }
+  while (true) {
+    const auto rflags = SaveAndDisableInterrupts();
+    FillFIFO();
+    const bool empty = tx_count == 0;
+    RestoreInterrupts(rflags);
+    if (empty) {
+      break;
+    }
+    __asm__("pause");
+  }
+}
+
+void OnInterrupt() {
+  // 割り込み識別レジスタを読んで送信割り込みを解除する
+  IoIn8(kCOM1 + kFIFOControl);
+  FillFIFO();
+}
+
+void Poll() {
+  if (available && tx_count > 0) {
+    FillFIFO();
+  }
+}
+
+}  // namespace serial
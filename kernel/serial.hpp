@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+namespace serial {
+
+/*
+  COM1 の 16550 互換 UART ドライバ．
+  Write は送信リングに積んですぐに戻り，FIFO への書き込みは送信割り込みで行う．
+  割り込みが来ない環境でも，タイマ割り込みから呼ばれる Poll で送信が進む．
+*/
+
+// ポートが見つかれば true．これだけでポーリングによる送信はできる
+bool Initialize();
+// IO APIC 経由で IRQ4 を受け取るようにする．InitializeInterrupt の後に呼ぶ
+void EnableInterrupt();
+bool Available();
+
+/* buf の内容を送信リングに積む．リングが一杯のときは空くまで
+   UART を直接ポーリングするので，出力が失われることはない． */
+void Write(const char* buf, size_t len);
+void Write(const char* s);
+
+// 送信リングが空になるまで待つ
+void Flush();
+
+// 割り込みハンドラとタイマ割り込みから呼ぶ．割り込みを禁止した状態で呼ぶこと
+void OnInterrupt();
+void Poll();
+
+}  // namespace serial
@@ -0,0 +1,250 @@
+#include "symbol.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "elf.hpp"
+#include "fat.hpp"
+
+// 外部リンケージにして，書き込まれる前の中身をコンパイラに畳み込ませない
+alignas(8) __attribute__((section(".ksymtab"), used))
+uint8_t kernel_symtab[kEmbeddedSymtabBytes] = {'K', 'S', 'Y', 'M'};
+
+namespace {
+
+SymbolTable* kernel_symbols;
+bool kernel_symbols_loaded;
+
+// p が指す <長さ><名前> を読み，p を進める
+bool ReadSourceName(const char*& p, std::string& out) {
+  if (!isdigit(*p)) {
+    return false;
+  }
+  size_t len = 0;
+  while (isdigit(*p)) {
+    len = len * 10 + (*p++ - '0');
+  }
+  if (strnlen(p, len) < len) {
+    return false;
+  }
+  out.assign(p, len);
+  p += len;
+  if (out.compare(0, 10, "_GLOBAL__N") == 0) {
+    out = "(anonymous)";
+  }
+  return true;
+}
+
+const EmbeddedSymtabHeader* EmbeddedHeader() {
+  auto header = reinterpret_cast<const EmbeddedSymtabHeader*>(kernel_symtab);
+  const size_t table_end =
+      sizeof(EmbeddedSymtabHeader) + header->count * sizeof(EmbeddedSymbol);
+  if (memcmp(header->magic, "KSYM", 4) != 0 || header->count == 0 ||
+      table_end > header->strings_offset ||
+      header->strings_offset >= kEmbeddedSymtabBytes) {
+    return nullptr;
+  }
+  return header;
+}
+
+const EmbeddedSymbol* EmbeddedSymbols(const EmbeddedSymtabHeader* header) {
+  return reinterpret_cast<const EmbeddedSymbol*>(header + 1);
+}
+
+const char* EmbeddedName(const EmbeddedSymtabHeader* header,
+                         const EmbeddedSymbol& sym) {
+  const size_t offset = header->strings_offset + sym.name_offset;
+  if (offset >= kEmbeddedSymtabBytes) {
+    return "?";
+  }
+  return reinterpret_cast<const char*>(kernel_symtab + offset);
+}
+
+// テンプレート引数 I...E を読み飛ばす
+void SkipTemplateArgs(const char*& p) {
+  int depth = 0;
+  do {
+    if (*p == 'I') {
+      ++depth;
+    } else if (*p == 'E') {
+      --depth;
+    }
+    ++p;
+  } while (*p && depth > 0);
+}
+
+}  // namespace
+
+std::string SimplifySymbolName(const char* mangled) {
+  if (strncmp(mangled, "_Z", 2) != 0) {
+    return mangled;
+  }
+
+  const char* p = mangled + 2;
+  if (*p == 'L') {
+    ++p;
+  }
+
+  std::string name, component;
+  if (*p != 'N') {
+    return ReadSourceName(p, name) ? name : mangled;
+  }
+
+  ++p;
+  while (*p == 'r' || *p == 'V' || *p == 'K') {
+    ++p;
+  }
+  std::string last;
+  while (*p && *p != 'E') {
+    if (*p == 'I') {
+      SkipTemplateArgs(p);
+      continue;
+    }
+    if (!name.empty()) {
+      name += "::";
+    }
+    if (*p == 'S' && p[1] == 't') {
+      component = "std";
+      p += 2;
+    } else if (*p == 'C' && isdigit(p[1])) {
+      // コンストラクタ
+      component = last;
+      p += 2;
+    } else if (*p == 'D' && isdigit(p[1])) {
+      component = "~" + last;
+      p += 2;
+    } else if (!ReadSourceName(p, component)) {
+      // 演算子などは解釈しない
+      return mangled;
+    }
+    name += component;
+    last = component;
+  }
+  return name;
+}
+
+Error SymbolTable::LoadELF(const char* path) {
+  auto entry = fat::FindFile(path);
+  if (!entry) {
+    return MAKE_ERROR(Error::kNoSuchFile);
+  }
+  auto [image, err] = fat::MapFile(*entry);
+  if (err) {
+    return err;
+  }
+  // 名前は読みやすくした写しを持つので，読み終えたらマップは要らない
+  err = LoadELFImage(image, entry->file_size);
+  fat::UnmapFile(image);
+  return err;
+}
+
+Error SymbolTable::LoadELFImage(const uint8_t* image, size_t image_size) {
+  auto ehdr = reinterpret_cast<const Elf64_Ehdr*>(image);
+  if (image_size < sizeof(Elf64_Ehdr) ||
+      memcmp(ehdr->e_ident, "\x7f" "ELF", 4) != 0 ||
+      ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > image_size) {
+    return MAKE_ERROR(Error::kInvalidFormat);
+  }
+
+  auto shdrs = reinterpret_cast<const Elf64_Shdr*>(image + ehdr->e_shoff);
+  for (int i = 0; i < ehdr->e_shnum; ++i) {
+    const auto& symtab = shdrs[i];
+    if (symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= ehdr->e_shnum) {
+      continue;
+    }
+    const auto& strtab = shdrs[symtab.sh_link];
+    if (symtab.sh_offset + symtab.sh_size > image_size ||
+        strtab.sh_offset + strtab.sh_size > image_size) {
+      return MAKE_ERROR(Error::kInvalidFormat);
+    }
+
+    auto syms = reinterpret_cast<const Elf64_Sym*>(image + symtab.sh_offset);
+    auto names = reinterpret_cast<const char*>(image + strtab.sh_offset);
+    const size_t num_syms = symtab.sh_size / sizeof(Elf64_Sym);
+    for (size_t j = 0; j < num_syms; ++j) {
+      const auto& sym = syms[j];
+      if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_value == 0 ||
+          sym.st_name >= strtab.sh_size) {
+        continue;
+      }
+      symbols_.push_back(KernelSymbol{sym.st_value, sym.st_size,
+                                      SimplifySymbolName(&names[sym.st_name])});
+    }
+  }
+
+  std::sort(symbols_.begin(), symbols_.end(),
+            [](const KernelSymbol& a, const KernelSymbol& b) {
+              return a.address < b.address;
+            });
+  return MAKE_ERROR(symbols_.empty() ? Error::kEmpty : Error::kSuccess);
+}
+
+Error SymbolTable::LoadEmbedded() {
+  auto header = EmbeddedHeader();
+  if (!header) {
+    return MAKE_ERROR(Error::kEmpty);
+  }
+  auto syms = EmbeddedSymbols(header);
+  for (uint32_t i = 0; i < header->count; ++i) {
+    symbols_.push_back(KernelSymbol{syms[i].address, syms[i].size,
+                                    EmbeddedName(header, syms[i])});
+  }
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+const KernelSymbol* SymbolTable::Find(uint64_t address) const {
+  auto it = std::upper_bound(symbols_.begin(), symbols_.end(), address,
+                             [](uint64_t addr, const KernelSymbol& sym) {
+                               return addr < sym.address;
+                             });
+  if (it == symbols_.begin()) {
+    return nullptr;
+  }
+  --it;
+  // 大きさが分からないシンボルは次のシンボルの手前までとみなす
+  if (it->size != 0 && address >= it->address + it->size) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+const SymbolTable* KernelSymbols() {
+  if (!kernel_symbols_loaded) {
+    kernel_symbols_loaded = true;
+    auto table = new SymbolTable;
+    if (table->LoadEmbedded() && table->LoadELF("kernel.elf")) {
+      return nullptr;
+    }
+    kernel_symbols = table;
+  }
+  return kernel_symbols;
+}
+
+const char* FindEmbeddedSymbol(uint64_t address, uint64_t* start) {
+  auto header = EmbeddedHeader();
+  if (!header) {
+    return nullptr;
+  }
+  auto syms = EmbeddedSymbols(header);
+
+  // address 以下で最大の先頭アドレスを持つシンボルを二分探索する
+  uint32_t lo = 0, hi = header->count;
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    if (syms[mid].address <= address) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    return nullptr;
+  }
+  const auto& sym = syms[lo - 1];
+  if (sym.size != 0 && address >= sym.address + sym.size) {
+    return nullptr;
+  }
+  *start = sym.address;
+  return EmbeddedName(header, sym);
+}
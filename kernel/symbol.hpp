@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "error.hpp"
+
+struct KernelSymbol {
+  uint64_t address;
+  uint64_t size;
+  std::string name;  // 読みやすくした名前（引数の型は付かない）
+};
+
+/*
+  カーネルの関数シンボル表．アドレス順に並べておき，二分探索で引く．
+*/
+class SymbolTable {
+ public:
+  // FAT ボリューム上の ELF ファイルの .symtab から関数シンボルを読む
+  Error LoadELF(const char* path);
+  // カーネルに埋め込まれたシンボル表から読む
+  Error LoadEmbedded();
+
+  // address を含む関数を返す．見つからなければ nullptr
+  const KernelSymbol* Find(uint64_t address) const;
+  size_t Size() const { return symbols_.size(); }
+  const KernelSymbol& operator[](size_t i) const { return symbols_[i]; }
+
+ private:
+  Error LoadELFImage(const uint8_t* image, size_t image_size);
+
+  std::vector<KernelSymbol> symbols_{};
+};
+
+/* 初めて使うときに，埋め込みのシンボル表か，なければ kernel.elf から読む．
+   読めなければ nullptr */
+const SymbolTable* KernelSymbols();
+
+/*
+  リンクの後で tools/mksymtab.py が .ksymtab セクションへ書き込むシンボル表．
+  ヘッダ，アドレス順に並べた EmbeddedSymbol の配列，名前の並びの順に置く．
+  名前は引数の型を除いて読みやすくしたもの．
+*/
+struct EmbeddedSymtabHeader {
+  char magic[4];            // "KSYM"
+  uint32_t count;           // 書き込まれる前は 0
+  uint32_t strings_offset;  // 表の先頭から名前の並びまで
+  uint32_t reserved;
+};
+
+struct EmbeddedSymbol {
+  uint64_t address;
+  uint32_t size;
+  uint32_t name_offset;  // 名前の並びの先頭から
+};
+
+const size_t kEmbeddedSymtabBytes = 512 * 1024;
+
+/* 埋め込みのシンボル表から address を含む関数の名前を返し，start に
+   その先頭アドレスを入れる．見つからなければ nullptr．
+   ヒープを使わないので，例外ハンドラからも呼べる． */
+const char* FindEmbeddedSymbol(uint64_t address, uint64_t* start);
+
+// _Z で始まる C++ の名前から，名前空間とクラスを含む関数名だけを取り出す
+std::string SimplifySymbolName(const char* mangled);
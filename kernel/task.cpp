@@ -104,6 +104,11 @@ void TaskManager::SwitchTask(bool current_sleep) {
     }
   }
 
+  // 切り替えまでのカウンタの増分を，それまで動いていたタスクに付ける
+  const auto now = ReadPerfCounters();
+  current_task->perf += PerfDelta(last_switch_counts, now);
+  last_switch_counts = now;
+
   Task* next_task = running[current_level].front();
   SwitchContext(&next_task->Context(), &current_task->Context());
   ++counter;
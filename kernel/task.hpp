@@ -8,7 +8,9 @@
 #include <vector>
 
 #include "error.hpp"
+#include "file.hpp"
 #include "message.hpp"
+#include "perf.hpp"
 
 struct TaskContext {
   uint64_t cr3, rip, rflags, reserved1;
@@ -47,11 +49,17 @@ class Task {
   void SendMessage(const Message& msg);
   std::optional<Message> ReceiveMessage();
 
+  FileTable& Files() { return files; }
+  // このタスクが CPU を使っていた間のカウンタの合計
+  const PerfCounts& Perf() const { return perf; }
+
  private:
   uint64_t id;
   std::vector<uint64_t> stack;
   alignas(16) TaskContext context;
   std::deque<Message> msgs{};
+  FileTable files{};
+  PerfCounts perf{};
   level_t level{kDefaultLevel};
   bool running{false};
 
@@ -84,6 +92,7 @@ class TaskManager {
   Error SendMessage(uint64_t id, const Message& msg);
 
   Task& CurrentTask();
+  const std::vector<std::unique_ptr<Task>>& Tasks() const { return tasks; }
 
   unsigned int Counter() const { return counter; }
   void SetCounter(unsigned int count) { counter = count; }
@@ -96,6 +105,7 @@ class TaskManager {
   bool level_changed{false};
 
   unsigned int counter;
+  PerfCounts last_switch_counts{};
 
   void ChangeLevelRunning(Task* task, level_t level);
 };
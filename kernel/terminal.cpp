@@ -2,12 +2,33 @@
 
 #include <string.h>
 
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+#include "benchmark.hpp"
 #include "fat.hpp"
 #include "layer.hpp"
 #include "pci.hpp"
+#include "perf.hpp"
+#include "profiler.hpp"
+#include "serial.hpp"
+#include "symbol.hpp"
 #include "task.hpp"
-
-Terminal::Terminal() {
+#include "timer.hpp"
+#include "trace.hpp"
+
+namespace {
+const PixelColor kPalette[8] = {
+    {0, 0, 0},     {0, 0, 170},   {0, 170, 0},   {0, 170, 170},
+    {170, 0, 0},   {170, 0, 170}, {170, 85, 0},  {255, 255, 255},
+};
+}  // namespace
+
+Terminal::Terminal(int scrollback_rows)
+    : cells(static_cast<size_t>(kRows + scrollback_rows) * kColumns),
+      ring_rows{kRows + scrollback_rows} {
+  dirty.fill({kColumns, 0});
   window = std::make_shared<ToplevelWindow>(
       kColumns * 8 + ToplevelWindow::kMarginX,
       kRows * 16 + 8 + ToplevelWindow::kMarginY, screen_config.pixel_format,
@@ -25,9 +46,23 @@ Terminal::Terminal() {
 Rectangle<int> Terminal::InputKey(uint8_t modifier, uint8_t keycode,
                                   char ascii) {
   DrawCursor(false);
+  scroll_lines = 0;
+  redraw_all = false;
+
+  if (keycode == 0x4b) {  // PageUp
+    auto area = ScrollView(kRows / 2);
+    DrawCursor(true);
+    return area;
+  } else if (keycode == 0x4e) {  // PageDown
+    auto area = ScrollView(-kRows / 2);
+    DrawCursor(true);
+    return area;
+  }
+  SnapToLive();
 
   Rectangle<int> draw_area{CalcCursorPos(), {8 * 2, 16}};
   if (ascii == '\n') {
+    const int first_row = cursor.y;
     line_buf[linebuf_index] = 0;
     if (linebuf_index > 0) {
       cmd_history.pop_back();
@@ -44,13 +79,26 @@ Rectangle<int> Terminal::InputKey(uint8_t modifier, uint8_t keycode,
     }
     ExecuteLine();
     Print(">");
-    draw_area.pos = ToplevelWindow::kTopLeftMargin;
-    draw_area.size = window->InnerSize();
+    RenderDirtyRows();
+    if (redraw_all || scroll_lines >= kRows) {
+      draw_area.pos = ToplevelWindow::kTopLeftMargin;
+      draw_area.size = window->InnerSize();
+    } else {
+      // スクロール分は LayerOperation::Scroll で画面をずらすので，
+      // ここでは書き換えた行だけを再描画する
+      const int top = std::max(first_row - scroll_lines, 0);
+      draw_area.pos = TextArea().pos + Vector2D<int>{0, 16 * top};
+      draw_area.size = {8 * kColumns, 16 * (cursor.y - top + 1)};
+    }
   } else if (ascii == '\b') {
     if (cursor.x > 0) {
       --cursor.x;
-      FillRect(*window, CalcCursorPos(), {8, 16}, {0, 0, 0});
-      draw_area.pos = CalcCursorPos();
+      CellAt(cursor.y, cursor.x) = {0, current_attr};
+      MarkDirty(cursor.y, cursor.x, cursor.x + 1);
+      RenderDirtyRows();
+      if (!redraw_all) {
+        draw_area.pos = CalcCursorPos();
+      }
 
       if (linebuf_index > 0) {
         --linebuf_index;
@@ -60,60 +108,87 @@ Rectangle<int> Terminal::InputKey(uint8_t modifier, uint8_t keycode,
     if (cursor.x < kColumns - 1 && linebuf_index < kLineMax - 1) {
       line_buf[linebuf_index] = ascii;
       ++linebuf_index;
-      auto pos = CalcCursorPos();
-      WriteAscii(*window, pos.x, pos.y, {255, 255, 255}, ascii);
+      PutCell(ascii);
       ++cursor.x;
+      RenderDirtyRows();
     }
   } else if (keycode == 0x51) {
     draw_area = HistoryUpDown(-1);
   } else if (keycode == 0x52) {
     draw_area = HistoryUpDown(1);
   }
+  if (redraw_all) {
+    draw_area = {ToplevelWindow::kTopLeftMargin, window->InnerSize()};
+  }
 
   DrawCursor(true);
 
   return draw_area;
 }
 
-void Terminal::Print(char c) {
-  auto newline = [this]() {
-    cursor.x = 0;
-    if (cursor.y < kRows - 1) {
-      ++cursor.y;
-    } else {
-      Scroll();
+void Terminal::Print(char c) { Print(&c, 1); }
+
+void Terminal::Print(const char* str) { Print(str, strlen(str)); }
+
+void Terminal::Print(const char* buf, size_t len) {
+  DrawCursor(false);
+  SnapToLive();
+
+  // NewLine と同じ規則で，改行と折り返しの回数を数える
+  auto count_newlines = [&](size_t end, size_t limit) {
+    int x = cursor.x;
+    size_t newlines = 0;
+    size_t i = 0;
+    for (; i < end && newlines < limit; ++i) {
+      if (buf[i] == '\n' || x == kColumns - 1) {
+        x = 0;
+        ++newlines;
+      } else {
+        ++x;
+      }
     }
+    return std::make_pair(newlines, i);
   };
 
-  if (c == '\n') {
-    newline();
-  } else {
-    WriteAscii(*window, CalcCursorPos(), {255, 255, 255}, c);
-    if (cursor.x == kColumns - 1) {
-      newline();
-    } else {
-      ++cursor.x;
+  const size_t newlines = count_newlines(len, len + 1).first;
+  size_t start = 0;
+  if (newlines >= ring_rows) {
+    // スクロールバックにも残らない行は，セルにも書かない
+    start = count_newlines(len, newlines - (ring_rows - 1)).second;
+    for (int row = 0; row < ring_rows; ++row) {
+      ClearRow(row);
     }
+    top = 0;
+    history_rows = 0;
+    cursor = {0, 0};
   }
-}
 
-void Terminal::Print(const char* str) {
-  DrawCursor(false);
+  if (newlines >= kRows) {
+    // 画面全体が入れ替わるので，ウィンドウはまとめて描き直す
+    scroll_lines += newlines;
+    redraw_all = true;
+    for (int row = 0; row < kRows; ++row) {
+      MarkDirty(row, 0, kColumns);
+    }
+  } else if (const int overflow =
+                 cursor.y + static_cast<int>(newlines) - (kRows - 1);
+             overflow > 0) {
+    Scroll(overflow);
+    cursor.y -= overflow;
+  }
 
-  auto newline = [this]() {
-    cursor.x = 0;
-    if (cursor.y < kRows - 1) {
-      ++cursor.y;
+  for (size_t i = start; i < len; ++i) {
+    if (buf[i] != '\n') {
+      PutCell(buf[i]);
+    }
+    if (buf[i] == '\n' || cursor.x == kColumns - 1) {
+      NewLine();
     } else {
-      Scroll();
+      ++cursor.x;
     }
-  };
-
-  while (*str) {
-    Print(*str);
-    ++str;
   }
 
+  RenderDirtyRows();
   DrawCursor(true);
 }
 
@@ -129,14 +204,42 @@ void Terminal::ExecuteLine() {
   std::string command(command_ptr);
 
   if (command == "echo") {
+    char* redirect = first_arg ? strstr(first_arg, ">>") : nullptr;
+    if (redirect) {
+      // echo text >> file でファイルの末尾に追記する
+      *redirect = 0;
+      char* path = redirect + 2;
+      while (*path == ' ') {
+        ++path;
+      }
+      auto [file, err] = fat::CreateFile(path);
+      if (err) {
+        Print("cannot open ");
+        Print(path);
+        Print(": ");
+        Print(err.Name());
+        Print("\n");
+        return;
+      }
+      std::string line(first_arg);
+      while (!line.empty() && line.back() == ' ') {
+        line.pop_back();
+      }
+      line += '\n';
+      fat::WriteFile(*file, file->entry.file_size, line.data(), line.size());
+      return;
+    }
     if (first_arg) {
       Print(first_arg);
     }
     Print("\n");
   } else if (command == "clear") {
-    FillRect(window->InnerWriter(), {4, 4}, {8 * kColumns, 16 * kRows},
-             {0, 0, 0});
+    for (int row = 0; row < kRows; ++row) {
+      ClearRow((top + row) % ring_rows);
+      MarkDirty(row, 0, kColumns);
+    }
     cursor.y = 0;
+    redraw_all = true;
   } else if (command == "lspci") {
     char s[64];
     for (int i = 0; i < pci::num_devices; ++i) {
@@ -149,29 +252,116 @@ void Terminal::ExecuteLine() {
       Print(s);
     }
   } else if (command == "ls") {
-    auto root_dir_entries = fat::GetSectorByCluster<fat::DirectoryEntry>(
-        fat::boot_volume_image->root_cluster);
-    auto entries_per_cluster = fat::boot_volume_image->sectors_per_cluster;
-    char s[64];
+    unsigned long dir_cluster = 0;
+    if (first_arg && first_arg[0]) {
+      auto dir_entry = fat::FindFile(first_arg);
+      if (!dir_entry) {
+        Print("no such file: ");
+        Print(first_arg);
+        Print("\n");
+        return;
+      } else if (!fat::IsDirectory(*dir_entry)) {
+        Print(first_arg);
+        Print("\n");
+        return;
+      }
+      dir_cluster = dir_entry->FirstCluster();
+    }
 
-    for (int i = 0; i < entries_per_cluster; ++i) {
-      auto file_names = fat::ReadName(root_dir_entries[i]);
-      auto base = std::get<0>(file_names);
-      auto ext = std::get<1>(file_names);
-      if (base[0] == 0x00) {
-        break;
-      } else if (static_cast<uint8_t>(base[0]) == 0xe5) {
+    for (const auto& e : fat::GetDirectoryIndex(dir_cluster).entries) {
+      if (e.entry.name[0] == 0xe5) {
         continue;
-      } else if (root_dir_entries[i].attr == fat::Attribute::kLongName) {
+      }
+      Print(e.Name().c_str());
+      Print(fat::IsDirectory(e.entry) ? "/\n" : "\n");
+    }
+  } else if (command == "touch" || command == "rm") {
+    if (!first_arg || first_arg[0] == 0) {
+      Print("usage: ");
+      Print(command.c_str());
+      Print(" <file>\n");
+      return;
+    }
+    auto err = command == "touch" ? fat::CreateFile(first_arg).error
+                                  : fat::DeleteFile(first_arg);
+    if (err) {
+      Print(command.c_str());
+      Print(": ");
+      Print(err.Name());
+      Print("\n");
+    }
+  } else if (command == "sync") {
+    if (auto err = fat::Sync()) {
+      Print("sync: ");
+      Print(err.Name());
+      Print("\n");
+    }
+  } else if (command == "blkstat") {
+    const auto& stats = fat::volume_cache->Stats();
+    const auto lookups = stats.hits + stats.misses;
+    char s[64];
+    sprintf(s, "hits=%lu misses=%lu hit rate=%lu%%\n", stats.hits,
+            stats.misses, lookups ? stats.hits * 100 / lookups : 0);
+    Print(s);
+    sprintf(s, "read-ahead lines=%lu used=%lu\n", stats.read_ahead_lines,
+            stats.read_ahead_hits);
+    Print(s);
+    sprintf(s, "bypass bytes=%lu write-backs=%lu\n", stats.bypass_bytes,
+            stats.write_backs);
+    Print(s);
+  } else if (command == "dmesg") {
+    // 行の先頭にだけ記録時刻を付ける
+    TraceEntry entry;
+    char s[256];
+    bool line_start = true;
+    const auto head = TraceHead();
+    for (auto i = TraceTail(); i < head; ++i) {
+      if (!ReadTrace(i, entry) || entry.event != kTraceLog) {
         continue;
       }
-
-      if (ext[0]) {
-        sprintf(s, "%s.%s\n", base.c_str(), ext.c_str());
-      } else {
-        sprintf(s, "%s\n", base.c_str());
+      if (line_start) {
+        const auto ns = TSCToNanoseconds(entry.tsc);
+        sprintf(s, "[%5lu.%06lu] ", ns / 1000000000, ns / 1000 % 1000000);
+        Print(s);
       }
+      const auto len = FormatTrace(entry, s, sizeof(s));
+      Print(s, len);
+      line_start = len > 0 && s[len - 1] == '\n';
+    }
+    if (!line_start) {
+      Print("\n");
+    }
+    sprintf(s, "%lu entries, %lu dropped before display, %lu truncated\n",
+            head, TraceOverflows(), TraceTruncations());
+    Print(s);
+  } else if (command == "prof") {
+    if (first_arg && strcmp(first_arg, "start") == 0) {
+      StartProfiler();
+      Print("profiler started\n");
+    } else if (first_arg && strcmp(first_arg, "stop") == 0) {
+      StopProfiler();
+      char s[64];
+      sprintf(s, "profiler stopped: %lu samples\n", ProfileSampleCount());
       Print(s);
+    } else if (first_arg && strcmp(first_arg, "report") == 0) {
+      PrintProfile();
+    } else {
+      Print("usage: prof start|stop|report\n");
+    }
+  } else if (command == "perf") {
+    if (first_arg && strcmp(first_arg, "reset") == 0) {
+      ResetPerfRegions();
+    } else {
+      PrintPerf();
+    }
+  } else if (command == "bench") {
+    char s[128];
+    const auto results = RunBenchmarks(first_arg ? first_arg : "all");
+    if (results.empty()) {
+      Print("no such benchmark\n");
+    }
+    for (const auto& result : results) {
+      Print(s, FormatBenchResult(result, s, sizeof(s)));
     }
   } else if (command == "cat") {
     char s[64];
@@ -180,21 +370,16 @@ void Terminal::ExecuteLine() {
       sprintf(s, "no such file: %s\n", first_arg);
       Print(s);
     } else {
-      auto cluster = file_entry->FirstCluster();
-      auto remain_bytes = file_entry->file_size;
-
-      DrawCursor(false);
-      while (cluster != 0 && cluster != fat::kEndOfClusterchain) {
-        char* p = fat::GetSectorByCluster<char>(cluster);
-        int i = 0;
-        for (; i < fat::bytes_per_cluster && i < remain_bytes; ++i) {
-          Print(*p);
-          ++p;
-        }
-        remain_bytes -= i;
-        cluster = fat::NextCluster(cluster);
+      auto [data, err] = fat::MapFile(*file_entry);
+      if (err) {
+        Print("cannot map file: ");
+        Print(err.Name());
+        Print("\n");
+        return;
       }
-      DrawCursor(true);
+
+      Print(reinterpret_cast<const char*>(data), file_entry->file_size);
+      fat::UnmapFile(data);
     }
   } else if (command.length() == 0) {
     Print('\n');
@@ -211,37 +396,114 @@ void Terminal::ExecuteLine() {
 }
 
 void Terminal::ExecuteFile(const fat::DirectoryEntry& file_entry) {
-  auto cluster = file_entry.FirstCluster();
-  auto remain_bytes = file_entry.file_size;
+  std::vector<uint8_t> file_buf(file_entry.file_size);
+  fat::ReadFile(file_entry, 0, &file_buf[0], file_buf.size());
 
-  std::vector<uint8_t> file_buf(remain_bytes);
-  auto p = &file_buf[0];
+  using Func = void();
+  auto f = reinterpret_cast<Func*>(&file_buf[0]);
+  f();
+}
 
-  while (cluster != 0 && cluster != fat::kEndOfClusterchain) {
-    const auto copy_bytes = fat::bytes_per_cluster < remain_bytes
-                                ? fat::bytes_per_cluster
-                                : remain_bytes;
-    memcpy(p, fat::GetSectorByCluster<uint8_t>(cluster), copy_bytes);
+void Terminal::PrintProfile() {
+  if (ProfilerRunning()) {
+    Print("profiler is running; stop it first\n");
+    return;
+  }
+  const auto symbols = KernelSymbols();
+  if (!symbols) {
+    Print("no kernel symbols; addresses are not resolved\n");
+  }
 
-    remain_bytes -= copy_bytes;
-    p += copy_bytes;
-    cluster = fat::NextCluster(cluster);
+  // 関数ごと（解決できなければアドレスごと）と，タスクごとに数える
+  std::unordered_map<uint64_t, uint64_t> by_function;
+  std::map<uint64_t, uint64_t> by_task;
+  const auto total = ProfileSampleCount();
+  const auto samples = ProfileSamples();
+  for (size_t i = 0; i < total; ++i) {
+    const KernelSymbol* sym = symbols ? symbols->Find(samples[i].rip) : nullptr;
+    ++by_function[sym ? sym->address : samples[i].rip];
+    ++by_task[samples[i].task_id];
   }
 
-  using Func = void();
-  auto f = reinterpret_cast<Func*>(&file_buf[0]);
-  f();
+  std::vector<std::pair<uint64_t, uint64_t>> ranking(by_function.begin(),
+                                                     by_function.end());
+  std::sort(ranking.begin(), ranking.end(),
+            [](const auto& a, const auto& b) { return a.second > b.second; });
+
+  char s[128];
+  sprintf(s, "%lu samples (%lu dropped), %d Hz timer\n", total,
+          ProfileDropped(), kTimerFreq);
+  Print(s);
+  Print("code running with interrupts disabled is not sampled\n");
+  const size_t kTopFunctions = 15;
+  for (size_t i = 0; i < ranking.size() && i < kTopFunctions; ++i) {
+    const auto [address, count] = ranking[i];
+    const KernelSymbol* sym = symbols ? symbols->Find(address) : nullptr;
+    const auto permille = count * 1000 / total;
+    sprintf(s, "%3lu.%lu%% %6lu  ", permille / 10, permille % 10, count);
+    Print(s);
+    if (sym) {
+      Print(sym->name.c_str());
+    } else {
+      sprintf(s, "0x%016lx", address);
+      Print(s);
+    }
+    Print("\n");
+  }
+  for (const auto [task_id, count] : by_task) {
+    sprintf(s, "task %lu: %lu samples\n", task_id, count);
+    Print(s);
+  }
+}
+
+void Terminal::PrintPerf() {
+  // ホスト側で集計できるよう，同じ内容をシリアルにも出す
+  char s[256];
+  auto print = [this](const char* s, size_t len) {
+    Print(s, len);
+    serial::Write(s, len);
+  };
+
+  for (auto region = PerfRegions(); region; region = region->next) {
+    const auto len = FormatPerfCounts(region->name, region->calls,
+                                      region->total, s, sizeof(s));
+    print(s, len);
+  }
+
+  asm("cli");
+  std::vector<std::pair<uint64_t, PerfCounts>> tasks;
+  for (const auto& task : task_manager->Tasks()) {
+    tasks.emplace_back(task->ID(), task->Perf());
+  }
+  asm("sti");
+  for (const auto& [id, counts] : tasks) {
+    char name[16];
+    sprintf(name, "task%lu", id);
+    const auto len = FormatPerfCounts(name, 1, counts, s, sizeof(s));
+    print(s, len);
+  }
 }
 
 void Terminal::BlinkCursor() {
+  if (view_offset > 0) {
+    return;
+  }
   cursor_visible = !cursor_visible;
   DrawCursor(cursor_visible);
 }
 
 void Terminal::DrawCursor(bool visible) {
-  const auto color = visible ? ToColor(0xffffff) : ToColor(0);
-  const auto pos = Vector2D<int>{4 + 8 * cursor.x, 5 + 16 * cursor.y};
-  FillRect(window->InnerWriter(), pos, {7, 15}, color);
+  if (view_offset > 0) {
+    return;
+  }
+  if (visible) {
+    const auto pos = Vector2D<int>{4 + 8 * cursor.x, 5 + 16 * cursor.y};
+    FillRect(window->InnerWriter(), pos, {7, 15}, ToColor(0xffffff));
+  } else {
+    // カーソルの下にあった文字をセルから描き直す
+    MarkDirty(cursor.y, cursor.x, cursor.x + 1);
+    RenderDirtyRows();
+  }
 }
 
 Vector2D<int> Terminal::CalcCursorPos() const {
@@ -249,11 +511,15 @@ Vector2D<int> Terminal::CalcCursorPos() const {
          Vector2D<int>{4 + 8 * cursor.x, 4 + 16 * cursor.y};
 }
 
-void Terminal::Scroll() {
-  Rectangle<int> move_src{{4, 4 + 16}, {8 * kColumns, 16 * (kRows - 1)}};
+void Terminal::Scroll(int lines) {
+  RenderDirtyRows();
+  ScrollRing(lines);
+  scroll_lines += lines;
+  Rectangle<int> move_src{{4, 4 + 16 * lines},
+                          {8 * kColumns, 16 * (kRows - lines)}};
   window->Move({4, 4}, move_src);
-  FillRect(window->InnerWriter(), {4, 4 + 16 * cursor.y}, {8 * kColumns, 16},
-           {0, 0, 0});
+  FillRect(window->InnerWriter(), {4, 4 + 16 * (kRows - lines)},
+           {8 * kColumns, 16 * lines}, {0, 0, 0});
 }
 
 Rectangle<int> Terminal::HistoryUpDown(int direction) {
@@ -266,7 +532,6 @@ Rectangle<int> Terminal::HistoryUpDown(int direction) {
   cursor.x = 1;
   const auto first_pos = CalcCursorPos();
   Rectangle<int> draw_area{first_pos, {8 * (kColumns - 1), 16}};
-  FillRect(*window, draw_area.pos, draw_area.size, {0, 0, 0});
 
   const char* history = "";
   if (cmd_history_index >= 0) {
@@ -276,11 +541,101 @@ Rectangle<int> Terminal::HistoryUpDown(int direction) {
   strcpy(&line_buf[0], history);
   linebuf_index = strlen(history);
 
-  WriteString(*window, first_pos, {255, 255, 255}, history);
+  for (int x = 1; x < kColumns; ++x) {
+    CellAt(cursor.y, x) = {x <= linebuf_index ? history[x - 1] : '\0',
+                           current_attr};
+  }
+  MarkDirty(cursor.y, 1, kColumns);
+  RenderDirtyRows();
+
   cursor.x = linebuf_index + 1;
   return draw_area;
 }
 
+TerminalCell& Terminal::CellAt(int row, int column) {
+  const int ring_row = (top + ring_rows - view_offset + row) % ring_rows;
+  return cells[ring_row * kColumns + column];
+}
+
+void Terminal::PutCell(char ch) {
+  CellAt(cursor.y, cursor.x) = {ch, current_attr};
+  MarkDirty(cursor.y, cursor.x, cursor.x + 1);
+}
+
+void Terminal::ClearRow(int ring_row) {
+  std::fill_n(&cells[ring_row * kColumns], kColumns, TerminalCell{0, 0});
+}
+
+void Terminal::MarkDirty(int row, int begin, int end) {
+  dirty[row].first = std::min(dirty[row].first, begin);
+  dirty[row].second = std::max(dirty[row].second, end);
+}
+
+// リングの上では画面を lines 行ずらすだけで，ウィンドウには触れない
+void Terminal::ScrollRing(int lines) {
+  for (int i = 0; i < lines; ++i) {
+    top = (top + 1) % ring_rows;
+    ClearRow((top + kRows - 1) % ring_rows);
+    history_rows = std::min(history_rows + 1, ring_rows - kRows);
+  }
+}
+
+void Terminal::NewLine() {
+  cursor.x = 0;
+  if (cursor.y < kRows - 1) {
+    ++cursor.y;
+  } else {
+    // 画面全体を描き直すことが決まっているので，ウィンドウは動かさない
+    ScrollRing(1);
+    for (int row = 0; row < kRows; ++row) {
+      MarkDirty(row, 0, kColumns);
+    }
+  }
+}
+
+void Terminal::RenderDirtyRows() {
+  for (int row = 0; row < kRows; ++row) {
+    auto [begin, end] = dirty[row];
+    if (begin >= end) {
+      continue;
+    }
+    dirty[row] = {kColumns, 0};
+
+    FillRect(window->InnerWriter(), {4 + 8 * begin, 4 + 16 * row},
+             {8 * (end - begin), 16}, {0, 0, 0});
+    for (int x = begin; x < end; ++x) {
+      const auto& cell = CellAt(row, x);
+      if (cell.ch != 0 && cell.ch != ' ') {
+        WriteAscii(window->InnerWriter(), {4 + 8 * x, 4 + 16 * row},
+                   kPalette[cell.attr % 8], cell.ch);
+      }
+    }
+  }
+}
+
+void Terminal::SnapToLive() {
+  if (view_offset != 0) {
+    view_offset = 0;
+    for (int row = 0; row < kRows; ++row) {
+      MarkDirty(row, 0, kColumns);
+    }
+    RenderDirtyRows();
+    redraw_all = true;
+  }
+}
+
+Rectangle<int> Terminal::ScrollView(int lines) {
+  const int new_offset = std::clamp(view_offset + lines, 0, history_rows);
+  if (new_offset != view_offset) {
+    view_offset = new_offset;
+    for (int row = 0; row < kRows; ++row) {
+      MarkDirty(row, 0, kColumns);
+    }
+    RenderDirtyRows();
+  }
+  return TextArea();
+}
+
 void TaskTerminal(uint64_t task_id, int64_t data) {
   asm("cli");
   Task& task = task_manager->CurrentTask();
@@ -290,39 +645,89 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
   layer_task_map->emplace(std::make_pair(terminal->LayerID(), task_id));
   asm("sti");
 
-  while (true) {
+  // 描画要求の完了待ちの間に届いたメッセージ
+  std::deque<Message> deferred_msgs;
+  int layer_msgs_in_flight = 0;
+
+  auto send_layer_message = [&](const Message& msg) {
+    ++layer_msgs_in_flight;
+    __asm__("cli");
+    task_manager->SendMessage(1, msg);
+    __asm__("sti");
+  };
+
+  auto receive_message = [&]() -> std::optional<Message> {
+    if (!deferred_msgs.empty()) {
+      auto msg = deferred_msgs.front();
+      deferred_msgs.pop_front();
+      return msg;
+    }
     asm("cli");
     auto msg = task.ReceiveMessage();
     if (!msg) {
       task.Sleep();
+    }
+    asm("sti");
+    return msg;
+  };
+
+  // スクロール要求はウィンドウの現在の内容を前提にするので，
+  // 処理されるまでウィンドウを書き換えないよう完了を待つ
+  auto wait_layer_finish = [&]() {
+    while (layer_msgs_in_flight > 0) {
+      asm("cli");
+      auto msg = task.ReceiveMessage();
+      if (!msg) {
+        task.Sleep();
+        asm("sti");
+        continue;
+      }
       asm("sti");
-      continue;
+
+      if (msg->type == Message::kLayerFinish) {
+        --layer_msgs_in_flight;
+      } else {
+        deferred_msgs.push_back(*msg);
+      }
     }
+  };
 
-    asm("sti");
+  while (true) {
+    auto msg = receive_message();
+    if (!msg) {
+      continue;
+    }
 
     switch (msg->type) {
       case Message::kKeyPush: {
         const auto area = terminal->InputKey(msg->arg.keyboard.modifier,
                                              msg->arg.keyboard.keycode,
                                              msg->arg.keyboard.ascii);
-        Message msg = MakeLayerMessage(task_id, terminal->LayerID(),
-                                       LayerOperation::DrawArea, area);
-        __asm__("cli");
-        task_manager->SendMessage(1, msg);
-        __asm__("sti");
+        const int scroll_lines = terminal->ScrollLines();
+        if (0 < scroll_lines && scroll_lines < Terminal::kRows) {
+          send_layer_message(MakeLayerScrollMessage(task_id,
+                                                    terminal->LayerID(),
+                                                    terminal->TextArea(),
+                                                    16 * scroll_lines));
+        }
+        send_layer_message(MakeLayerMessage(task_id, terminal->LayerID(),
+                                            LayerOperation::DrawArea, area));
+        if (scroll_lines > 0) {
+          wait_layer_finish();
+        }
         break;
       }
 
+      case Message::kLayerFinish:
+        --layer_msgs_in_flight;
+        break;
+
       case Message::kTimerTimeout:
         terminal->BlinkCursor();
         {
           auto area = terminal->CursorArea();
-          auto msg = MakeLayerMessage(task_id, terminal->LayerID(),
-                                      LayerOperation::DrawArea, area);
-          asm("cli");
-          task_manager->SendMessage(1, msg);
-          asm("sti");
+          send_layer_message(MakeLayerMessage(task_id, terminal->LayerID(),
+                                              LayerOperation::DrawArea, area));
         }
         break;
       default:
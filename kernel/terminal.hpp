@@ -1,16 +1,30 @@
 #pragma once
+#include <array>
 #include <deque>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "fat.hpp"
 #include "graphics.hpp"
 #include "window.hpp"
 
+/*
+  端末の 1 文字分．attr は文字色のパレット番号．
+  ch が 0 のセルは空白として扱う．
+*/
+struct TerminalCell {
+  char ch;
+  uint8_t attr;
+};
+
 class Terminal {
  public:
   static const int kRows = 15, kColumns = 60;
   static const int kLineMax = 128;
-  Terminal();
+  static const int kDefaultScrollbackRows = 500;
+  static const uint8_t kDefaultAttr = 7;
+  Terminal(int scrollback_rows = kDefaultScrollbackRows);
   unsigned int LayerID() const { return layer_id; }
   void BlinkCursor();
   Rectangle<int> CursorArea() const {
@@ -19,13 +33,23 @@ class Terminal {
             {7, 15}};
   }
 
+  Rectangle<int> TextArea() const {
+    return {ToplevelWindow::kTopLeftMargin + Vector2D<int>{4, 4},
+            {8 * kColumns, 16 * kRows}};
+  }
+  int ScrollLines() const { return scroll_lines; }
+
   Rectangle<int> InputKey(uint8_t modifier, uint8_t keycode, char ascii);
 
   void ExecuteLine();
   void ExecuteFile(const fat::DirectoryEntry& file_entry);
+  void PrintProfile();
+  void PrintPerf();
 
   void Print(char c);
   void Print(const char* str);
+  // まとめて出力する．画面に残らない行は描画せず，スクロールも 1 回で済ませる
+  void Print(const char* buf, size_t len);
 
  private:
   std::shared_ptr<ToplevelWindow> window;
@@ -41,7 +65,35 @@ class Terminal {
   std::deque<std::array<char, kLineMax>> cmd_history{};
   int cmd_history_index{-1};
   Rectangle<int> HistoryUpDown(int direction);
-  void Scroll();
+  void Scroll(int lines = 1);
+
+  // 直前の InputKey の間にスクロールした行数
+  int scroll_lines{0};
+  bool redraw_all{false};
+
+  /* 文字の内容はセルのリングバッファに持ち，ウィンドウへはここから描く．
+     リングは画面の kRows 行とスクロールバック分の行からなり，
+     top は画面の一番上の行にあたるリング上の行．
+     view_offset はページアップでさかのぼっている行数． */
+  std::vector<TerminalCell> cells;
+  int ring_rows;
+  int top{0};
+  int history_rows{0};
+  int view_offset{0};
+  uint8_t current_attr{kDefaultAttr};
+
+  // 画面の各行で，まだウィンドウに描いていない桁の範囲 [begin, end)
+  std::array<std::pair<int, int>, kRows> dirty;
+
+  TerminalCell& CellAt(int row, int column);
+  void PutCell(char ch);
+  void ClearRow(int ring_row);
+  void MarkDirty(int row, int begin, int end);
+  void ScrollRing(int lines);
+  void NewLine();
+  void RenderDirtyRows();
+  void SnapToLive();
+  Rectangle<int> ScrollView(int lines);
 };
 
 void TaskTerminal(uint64_t task_id, int64_t data);
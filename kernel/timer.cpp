@@ -1,9 +1,11 @@
 #include "timer.hpp"
 
 #include "acpi.hpp"
+#include "asmfunc.h"
 #include "interrupt.hpp"
 #include "logger.hpp"
 #include "message.hpp"
+#include "serial.hpp"
 #include "task.hpp"
 
 namespace {
@@ -51,6 +53,7 @@ bool TimerManager::Tick() {
 void TimerManager::AddTimer(const Timer& timer) { timers.emplace(timer); }
 
 unsigned long lapic_timer_freq;
+uint64_t tsc_freq;
 TimerManager* timer_manager;
 
 void InitializeLAPICTimer() {
@@ -58,20 +61,33 @@ void InitializeLAPICTimer() {
   divide_config = 0b1011;
   lvt_timer = 0b001 << 16;
 
+  const uint64_t tsc_start = ReadTSC();
   StartLAPICTimer();
   acpi::WaitMilliseconds(100);
   const auto elapsed = LAPICTimerElapsed();
   StopLAPICTimer();
+  const uint64_t tsc_end = ReadTSC();
 
   lapic_timer_freq = static_cast<unsigned long>(elapsed) * 10;
+  tsc_freq = (tsc_end - tsc_start) * 10;
 
   divide_config = 0b1011;
   lvt_timer = (0b010 << 16) | InterruptVector::kLAPICTimer;
   initial_count = lapic_timer_freq / kTimerFreq;
 }
 
+uint64_t TSCToNanoseconds(uint64_t tsc) {
+  if (tsc_freq == 0) {
+    return 0;
+  }
+  // 整数部と余りに分けて，途中の掛け算があふれないようにする
+  return tsc / tsc_freq * 1000000000 + tsc % tsc_freq * 1000000000 / tsc_freq;
+}
+
 void LAPICTimerOnInterrupt() {
   const bool task_timer_timeout = timer_manager->Tick();
+  // 送信割り込みを取りこぼしても，シリアル出力が止まらないようにする
+  serial::Poll();
 
   NotifyEndOfInterrupt();
 
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <deque>
+#include <limits>
 #include <queue>
 
 #include "message.hpp"
@@ -35,6 +36,8 @@ inline bool operator<(const Timer& lhs, const Timer& rhs) {
 
 extern TimerManager* timer_manager;
 extern unsigned long lapic_timer_freq;
+// InitializeLAPICTimer で測ったタイムスタンプカウンタの周波数（Hz）
+extern uint64_t tsc_freq;
 const int kTimerFreq = 100;
 
 const int kTaskTimerPeriod = static_cast<int>(kTimerFreq * 0.02);
@@ -45,3 +48,6 @@ void LAPICTimerOnInterrupt();
 void StartLAPICTimer();
 uint32_t LAPICTimerElapsed();
 void StopLAPICTimer();
+
+// ReadTSC の値をナノ秒に直す．周波数を測る前は 0 を返す
+uint64_t TSCToNanoseconds(uint64_t tsc);
@@ -0,0 +1,371 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "asmfunc.h"
+#include "console.hpp"
+#include "serial.hpp"
+#include "task.hpp"
+
+namespace {
+
+// 2 のべき乗にしておくと剰余が安い
+const uint64_t kTraceEntries = 1024;
+TraceEntry ring[kTraceEntries];
+
+uint64_t head;
+uint64_t overflows;
+uint64_t truncations;
+bool log_running;
+
+// 書式文字列中の 1 つの変換指定
+struct ConversionSpec {
+  const char* begin;
+  const char* end;  // 変換文字の次
+  char conversion;
+  bool is_long;  // l, ll, z, j, t のいずれかが付いている
+  int stars;     // 幅や精度に使われる * の数
+};
+
+// p は '%' を指していること
+ConversionSpec ParseSpec(const char* p) {
+  ConversionSpec spec{p, p + 1, 0, false, 0};
+  const char* q = p + 1;
+  while (*q && strchr("-+ #0123456789.*", *q)) {
+    if (*q == '*') {
+      ++spec.stars;
+    }
+    ++q;
+  }
+  while (*q && strchr("hlzjtL", *q)) {
+    if (strchr("lzjt", *q)) {
+      spec.is_long = true;
+    }
+    ++q;
+  }
+  spec.conversion = *q;
+  spec.end = *q ? q + 1 : q;
+  return spec;
+}
+
+// 引数や文字列を切り詰めたら true を返す
+bool CaptureArgs(TraceEntry& e, const char* format, va_list ap) {
+  size_t string_used = 0;
+  bool truncated = false;
+  e.strings[kTraceStringBytes - 1] = '\0';
+
+  auto push = [&e, &truncated](uint64_t value) {
+    if (e.num_args < kTraceMaxArgs) {
+      e.args[e.num_args++] = value;
+    } else {
+      truncated = true;
+    }
+  };
+
+  for (const char* p = format; *p;) {
+    if (*p != '%') {
+      ++p;
+      continue;
+    }
+    const auto spec = ParseSpec(p);
+    p = spec.end;
+    for (int i = 0; i < spec.stars; ++i) {
+      push(static_cast<int64_t>(va_arg(ap, int)));
+    }
+
+    switch (spec.conversion) {
+      case 'd':
+      case 'i':
+      case 'c':
+        push(spec.is_long ? va_arg(ap, long) : va_arg(ap, int));
+        break;
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+        push(spec.is_long ? va_arg(ap, unsigned long)
+                          : va_arg(ap, unsigned int));
+        break;
+      case 'p':
+      case 'n':
+        push(reinterpret_cast<uint64_t>(va_arg(ap, void*)));
+        break;
+      case 's': {
+        const char* s = va_arg(ap, const char*);
+        if (!s) {
+          s = "(null)";
+        }
+        if (string_used >= kTraceStringBytes) {
+          // 入りきらない文字列は空文字列として扱う
+          push(kTraceStringBytes - 1);
+          truncated |= *s != '\0';
+          break;
+        }
+        const size_t len = strlen(s);
+        const size_t n = std::min(len, kTraceStringBytes - string_used - 1);
+        truncated |= n < len;
+        memcpy(&e.strings[string_used], s, n);
+        e.strings[string_used + n] = '\0';
+        push(string_used);
+        string_used += n + 1;
+        break;
+      }
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A': {
+        const double d = va_arg(ap, double);
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        push(bits);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return truncated;
+}
+
+}  // namespace
+
+void TraceV(TraceEvent event, LogLevel level, const char* format, va_list ap) {
+  // 割り込みハンドラが割り込んでも別のエントリを取るよう，番号は不可分に取る
+  const uint64_t index = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+  auto& e = ring[index % kTraceEntries];
+
+  __atomic_store_n(&e.seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  e.tsc = ReadTSC();
+  e.event = event;
+  e.level = level;
+  e.num_args = 0;
+  // 書式は全体を見て引数を取り出すが，記録するのは収まる分だけ
+  const size_t format_len = strnlen(format, kTraceFormatBytes);
+  const size_t n = std::min(format_len, kTraceFormatBytes - 1);
+  memcpy(e.format, format, n);
+  e.format[n] = '\0';
+  bool truncated = format_len > n;
+  truncated |= CaptureArgs(e, format, ap);
+  if (truncated) {
+    __atomic_fetch_add(&truncations, 1, __ATOMIC_RELAXED);
+  }
+
+  __atomic_store_n(&e.seq, index + 1, __ATOMIC_RELEASE);
+}
+
+void Trace(TraceEvent event, LogLevel level, const char* format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  TraceV(event, level, format, ap);
+  va_end(ap);
+}
+
+uint64_t TraceHead() { return __atomic_load_n(&head, __ATOMIC_ACQUIRE); }
+
+uint64_t TraceTail() {
+  const auto h = TraceHead();
+  return h > kTraceEntries ? h - kTraceEntries : 0;
+}
+
+uint64_t TraceOverflows() {
+  return __atomic_load_n(&overflows, __ATOMIC_RELAXED);
+}
+
+uint64_t TraceTruncations() {
+  return __atomic_load_n(&truncations, __ATOMIC_RELAXED);
+}
+
+bool ReadTrace(uint64_t index, TraceEntry& entry) {
+  const auto& e = ring[index % kTraceEntries];
+  if (__atomic_load_n(&e.seq, __ATOMIC_ACQUIRE) != index + 1) {
+    return false;
+  }
+  memcpy(&entry, &e, sizeof(entry));
+  // コピー中に上書きされていたら，番号が変わっているので捨てる
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&e.seq, __ATOMIC_RELAXED) == index + 1;
+}
+
+size_t FormatTrace(const TraceEntry& entry, char* buf, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+
+  size_t len = 0;
+  int next_arg = 0;
+  auto arg = [&]() -> uint64_t {
+    return next_arg < entry.num_args ? entry.args[next_arg++] : 0;
+  };
+  auto advance = [&](int n) {
+    if (n > 0) {
+      len = std::min(len + n, size - 1);
+    }
+  };
+
+  for (const char* p = entry.format; *p && len + 1 < size;) {
+    if (*p != '%') {
+      buf[len++] = *p++;
+      continue;
+    }
+    const auto spec = ParseSpec(p);
+    p = spec.end;
+    if (spec.conversion == '%') {
+      buf[len++] = '%';
+      continue;
+    }
+
+    // 変換指定を 1 つずつ取り出し，* は保存した値に置き換えて snprintf に渡す
+    char conv[32];
+    size_t n = 0;
+    for (const char* q = spec.begin; q != spec.end && n + 12 < sizeof(conv);
+         ++q) {
+      if (*q == '*') {
+        n += sprintf(&conv[n], "%d", static_cast<int>(arg()));
+      } else {
+        conv[n++] = *q;
+      }
+    }
+    conv[n] = '\0';
+
+    char* out = &buf[len];
+    const size_t rest = size - len;
+    switch (spec.conversion) {
+      case 'd':
+      case 'i':
+      case 'c':
+        if (spec.is_long) {
+          advance(snprintf(out, rest, conv, static_cast<long>(arg())));
+        } else {
+          advance(snprintf(out, rest, conv, static_cast<int>(arg())));
+        }
+        break;
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+        if (spec.is_long) {
+          advance(snprintf(out, rest, conv, static_cast<unsigned long>(arg())));
+        } else {
+          advance(snprintf(out, rest, conv, static_cast<unsigned int>(arg())));
+        }
+        break;
+      case 'p':
+        advance(snprintf(out, rest, conv, reinterpret_cast<void*>(arg())));
+        break;
+      case 's':
+        advance(snprintf(out, rest, conv,
+                         &entry.strings[std::min<uint64_t>(
+                             arg(), kTraceStringBytes - 1)]));
+        break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A': {
+        const uint64_t bits = arg();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        advance(snprintf(out, rest, conv, d));
+        break;
+      }
+      case 'n':
+        arg();
+        break;
+      default:
+        break;
+    }
+  }
+
+  buf[len] = '\0';
+  return len;
+}
+
+bool TraceLogRunning() {
+  return __atomic_load_n(&log_running, __ATOMIC_ACQUIRE);
+}
+
+namespace {
+/*
+  コンソールへの描画はメインタスクの描画と混ざらないよう，メインタスクに
+  任せる．s を使い回すので，表示し終えた知らせが来るまで待つ．
+*/
+void PutConsoleOnMainTask(uint64_t task_id, const char* s) {
+  Message msg{Message::kConsoleLog, task_id};
+  msg.arg.console.text = s;
+  __asm__("cli");
+  auto& task = task_manager->CurrentTask();
+  task_manager->SendMessage(1, msg);
+  __asm__("sti");
+
+  while (true) {
+    __asm__("cli");
+    auto reply = task.ReceiveMessage();
+    if (!reply) {
+      task.Sleep();
+      __asm__("sti");
+      continue;
+    }
+    __asm__("sti");
+    if (reply->type == Message::kLayerFinish) {
+      return;
+    }
+  }
+}
+}  // namespace
+
+void TaskTraceLog(uint64_t task_id, int64_t data) {
+  uint64_t next = TraceHead();
+  __atomic_store_n(&log_running, true, __ATOMIC_RELEASE);
+
+  TraceEntry entry;
+  char s[1024];
+  while (true) {
+    const auto h = TraceHead();
+    if (next == h) {
+      // 次の割り込みまで待つ．新しいエントリはたいてい割り込みの後に増える
+      __asm__("hlt");
+      continue;
+    }
+
+    if (h - next > kTraceEntries) {
+      __atomic_fetch_add(&overflows, h - kTraceEntries - next,
+                         __ATOMIC_RELAXED);
+      next = h - kTraceEntries;
+    }
+
+    if (!ReadTrace(next, entry)) {
+      if (TraceTail() > next) {
+        // 読んでいる間に上書きされた
+        __atomic_fetch_add(&overflows, 1, __ATOMIC_RELAXED);
+        ++next;
+      } else {
+        // 書き込み中なので，書き手が戻ってくるまで譲る
+        __asm__("hlt");
+      }
+      continue;
+    }
+    ++next;
+
+    if (entry.event != kTraceLog) {
+      continue;
+    }
+    const auto len = FormatTrace(entry, s, sizeof(s));
+    if (LogSinks() & kLogSinkSerial) {
+      serial::Write(s, len);
+    }
+    if (LogSinks() & kLogSinkConsole) {
+      PutConsoleOnMainTask(task_id, s);
+    }
+  }
+}
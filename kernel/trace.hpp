@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+
+#include "logger.hpp"
+
+// トレースエントリが表すイベント
+enum TraceEvent : uint16_t {
+  kTraceLog,  // Log() の呼び出し
+};
+
+const int kTraceMaxArgs = 8;
+const size_t kTraceFormatBytes = 128;
+const size_t kTraceStringBytes = 64;
+
+/*
+  トレースバッファの 1 エントリ．
+  書式文字列は整形せずにそのまま format にコピーし，引数は 64 ビット値として
+  保存する．呼び出し元の文字列は表示する頃には消えているかもしれないので，
+  %s の文字列も strings にコピーし，args にはその先頭位置を入れる．
+  書式が kTraceFormatBytes を超えるか，引数が kTraceMaxArgs を超えるか，
+  文字列が strings に入りきらないときは切り詰め，TraceTruncations に数える．
+*/
+struct TraceEntry {
+  uint64_t seq;  // 書き込み中は 0，書き終わったら通し番号 + 1
+  uint64_t tsc;
+  uint16_t event;
+  uint8_t level;
+  uint8_t num_args;
+  char format[kTraceFormatBytes];
+  uint64_t args[kTraceMaxArgs];
+  char strings[kTraceStringBytes];
+};
+
+/*
+  リングバッファにエントリを 1 つ記録する．ロックを取らないので割り込みハンドラ
+  からも呼べる．リングが一周したら古いエントリから上書きする．
+*/
+void TraceV(TraceEvent event, LogLevel level, const char* format, va_list ap);
+void Trace(TraceEvent event, LogLevel level, const char* format, ...);
+
+// これまでに予約されたエントリの数（次に書き込む通し番号）
+uint64_t TraceHead();
+// まだリングに残っている最も古いエントリの通し番号
+uint64_t TraceTail();
+// 表示される前に上書きされたエントリの数
+uint64_t TraceOverflows();
+// 書式，引数，文字列のいずれかを切り詰めて記録したエントリの数
+uint64_t TraceTruncations();
+
+/* 通し番号 index のエントリを entry にコピーする．
+   書き込み中か，すでに上書きされていれば false を返す． */
+bool ReadTrace(uint64_t index, TraceEntry& entry);
+
+/* エントリの書式文字列を引数で展開して buf に書き，その長さを返す．
+   buf に収まらない部分は切り捨てる． */
+size_t FormatTrace(const TraceEntry& entry, char* buf, size_t size);
+
+// TaskTraceLog が動き出していれば true．それまで Log() は直接コンソールに書く
+bool TraceLogRunning();
+
+// リングからエントリを取り出してコンソールに表示するタスク
+void TaskTraceLog(uint64_t task_id, int64_t data);
@@ -0,0 +1,212 @@
+#include "truetype.hpp"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <cstring>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "fat.hpp"
+#include "logger.hpp"
+
+namespace {
+
+const int kAtlasCellSize = 48;
+const int kAtlasCells = 512;
+
+struct GlyphSlot {
+  uint64_t key;
+  int width, rows;
+  int left, top;
+  int advance;
+};
+
+FT_Library ft_library;
+FT_Face ft_face;
+int current_pixel_size;
+
+/*
+  グリフのアトラス．kAtlasCellSize 四方のセルを kAtlasCells 個並べた
+  アルファ値のビットマップで，セルは LRU で使い回す．
+*/
+std::vector<uint8_t> atlas;
+std::vector<GlyphSlot> slots;
+std::list<int> lru;  // 先頭ほど最近使ったセル
+std::unordered_map<uint64_t, std::list<int>::iterator> slot_index;
+
+uint64_t MakeKey(unsigned int glyph_index, int pixel_size) {
+  return (static_cast<uint64_t>(pixel_size) << 32) | glyph_index;
+}
+
+uint8_t* CellAt(int cell) {
+  return &atlas[static_cast<size_t>(cell) * kAtlasCellSize * kAtlasCellSize];
+}
+
+const GlyphSlot* Rasterize(unsigned int glyph_index, int pixel_size,
+                           int cell) {
+  if (current_pixel_size != pixel_size) {
+    if (FT_Set_Pixel_Sizes(ft_face, 0, pixel_size)) {
+      return nullptr;
+    }
+    current_pixel_size = pixel_size;
+  }
+  if (FT_Load_Glyph(ft_face, glyph_index, FT_LOAD_RENDER)) {
+    return nullptr;
+  }
+
+  const auto glyph = ft_face->glyph;
+  const auto& bitmap = glyph->bitmap;
+  auto& slot = slots[cell];
+  slot.key = MakeKey(glyph_index, pixel_size);
+  slot.width = std::min<int>(bitmap.width, kAtlasCellSize);
+  slot.rows = std::min<int>(bitmap.rows, kAtlasCellSize);
+  slot.left = glyph->bitmap_left;
+  slot.top = glyph->bitmap_top;
+  slot.advance = glyph->advance.x >> 6;
+
+  uint8_t* dst = CellAt(cell);
+  for (int y = 0; y < slot.rows; ++y) {
+    memcpy(dst + y * kAtlasCellSize, bitmap.buffer + y * bitmap.pitch,
+           slot.width);
+  }
+  return &slot;
+}
+
+const GlyphSlot* FindGlyph(unsigned int glyph_index, int pixel_size) {
+  const auto key = MakeKey(glyph_index, pixel_size);
+  if (auto it = slot_index.find(key); it != slot_index.end()) {
+    lru.splice(lru.begin(), lru, it->second);
+    return &slots[*it->second];
+  }
+
+  // 最も長く使われていないセルを追い出して使う
+  const int cell = lru.back();
+  slot_index.erase(slots[cell].key);
+  lru.splice(lru.begin(), lru, std::prev(lru.end()));
+
+  const auto slot = Rasterize(glyph_index, pixel_size, cell);
+  if (slot == nullptr) {
+    slots[cell].key = ~static_cast<uint64_t>(0);
+    lru.splice(lru.end(), lru, lru.begin());
+    return nullptr;
+  }
+  slot_index[key] = lru.begin();
+  return slot;
+}
+
+// UTF-8 の 1 文字を読み，コードポイントを返して str を進める
+uint32_t NextCodePoint(const char*& str) {
+  const auto c = static_cast<uint8_t>(*str++);
+  int follow = 0;
+  uint32_t code = c;
+  if (c >= 0xf0) {
+    follow = 3;
+    code = c & 0x07;
+  } else if (c >= 0xe0) {
+    follow = 2;
+    code = c & 0x0f;
+  } else if (c >= 0xc0) {
+    follow = 1;
+    code = c & 0x1f;
+  }
+  for (; follow > 0 && (*str & 0xc0) == 0x80; --follow) {
+    code = (code << 6) | (*str++ & 0x3f);
+  }
+  return code;
+}
+
+PixelColor Blend(const PixelColor& fg, const PixelColor& bg, int alpha) {
+  auto mix = [alpha](int f, int b) {
+    return static_cast<uint8_t>(b + (f - b) * alpha / 255);
+  };
+  return {mix(fg.r, bg.r), mix(fg.g, bg.g), mix(fg.b, bg.b)};
+}
+
+void DrawGlyph(PixelWriter& writer, Vector2D<int> origin, const GlyphSlot& slot,
+               const uint8_t* alpha, const PixelColor& fg,
+               const PixelColor& bg) {
+  for (int y = 0; y < slot.rows; ++y) {
+    const uint8_t* row = alpha + y * kAtlasCellSize;
+    const int dy = origin.y - slot.top + y;
+    int x = 0;
+    while (x < slot.width) {
+      if (row[x] == 0) {
+        ++x;
+        continue;
+      }
+      if (row[x] == 0xff) {
+        const int begin = x;
+        while (x < slot.width && row[x] == 0xff) ++x;
+        writer.WriteSpan(fg, origin.x + slot.left + begin, dy, x - begin);
+        continue;
+      }
+      writer.Write(Blend(fg, bg, row[x]), origin.x + slot.left + x, dy);
+      ++x;
+    }
+  }
+}
+
+}  // namespace
+
+Error InitializeTrueTypeFont(const char* file_name) {
+  auto entry = fat::FindFile(file_name);
+  if (!entry) {
+    return MAKE_ERROR(Error::kNoSuchFile);
+  }
+
+  // FreeType はフォントを読むだけなので，コピーせずにマップして渡す．
+  // FreeType が使い続けるので UnmapFile はしない
+  auto [font_data, err] = fat::MapFile(*entry);
+  if (err) {
+    return err;
+  }
+
+  if (FT_Init_FreeType(&ft_library)) {
+    return MAKE_ERROR(Error::kFreeTypeError);
+  }
+  if (FT_New_Memory_Face(ft_library, font_data, entry->file_size, 0,
+                         &ft_face)) {
+    return MAKE_ERROR(Error::kFreeTypeError);
+  }
+
+  atlas.resize(static_cast<size_t>(kAtlasCells) * kAtlasCellSize *
+               kAtlasCellSize);
+  slots.resize(kAtlasCells);
+  for (int cell = 0; cell < kAtlasCells; ++cell) {
+    slots[cell].key = ~static_cast<uint64_t>(0);
+    lru.push_back(cell);
+  }
+
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+bool TrueTypeFontAvailable() { return ft_face != nullptr; }
+
+int WriteStringTT(PixelWriter& writer, Vector2D<int> pos,
+                  const PixelColor& fg, const PixelColor& bg, const char* str,
+                  int pixel_size) {
+  if (!ft_face) {
+    return 0;
+  }
+
+  if (current_pixel_size != pixel_size) {
+    FT_Set_Pixel_Sizes(ft_face, 0, pixel_size);
+    current_pixel_size = pixel_size;
+  }
+  const int ascender = ft_face->size->metrics.ascender >> 6;
+
+  Vector2D<int> origin{pos.x, pos.y + ascender};
+  while (*str) {
+    const auto code = NextCodePoint(str);
+    const auto glyph_index = FT_Get_Char_Index(ft_face, code);
+    const auto slot = FindGlyph(glyph_index, pixel_size);
+    if (slot == nullptr) {
+      continue;
+    }
+    DrawGlyph(writer, origin, *slot, CellAt(&*slot - &slots[0]), fg, bg);
+    origin.x += slot->advance;
+  }
+  return origin.x - pos.x;
+}
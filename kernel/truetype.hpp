@@ -0,0 +1,18 @@
+#pragma once
+
+#include "error.hpp"
+#include "graphics.hpp"
+
+/*
+  FreeType による TrueType/OpenType フォントの描画．
+  ラスタライズしたグリフはアトラスに (グリフ番号, サイズ) をキーとして
+  保持し，同じグリフを描くときは再ラスタライズせずにアトラスから転送する．
+*/
+
+Error InitializeTrueTypeFont(const char* file_name);
+bool TrueTypeFontAvailable();
+
+// 背景色 bg の上に UTF-8 文字列 str を描き，描画した幅（ピクセル）を返す
+int WriteStringTT(PixelWriter& writer, Vector2D<int> pos,
+                  const PixelColor& fg, const PixelColor& bg, const char* str,
+                  int pixel_size = 16);
@@ -7,6 +7,7 @@
 #include "interrupt.hpp"
 #include "logger.hpp"
 #include "pci.hpp"
+#include "perf.hpp"
 #include "usb/descriptor.hpp"
 #include "usb/device.hpp"
 #include "usb/setupdata.hpp"
@@ -15,6 +16,8 @@
 namespace {
 using namespace usb::xhci;
 
+PerfRegion process_events_perf{"xhci::ProcessEvents"};
+
 Error RegisterCommandRing(Ring* ring, MemMapRegister<CRCR_Bitmap>* crcr) {
   CRCR_Bitmap value = crcr->Read();
   value.bits.ring_cycle_state = true;
@@ -588,6 +591,9 @@ void Initialize() {
     Log(kInfo, "xhc.Initialize: %s\n", err.Name());
   }
 
+  /* 動き出すと割り込みからメインタスクがイベントを処理するので，
+     ポートの設定を終えるまでは割り込みを止めておく */
+  const auto rflags = SaveAndDisableInterrupts();
   Log(kInfo, "xHC starting\n");
   xhc.Run();
 
@@ -602,9 +608,11 @@ void Initialize() {
       }
     }
   }
+  RestoreInterrupts(rflags);
 }
 
 void ProcessEvents() {
+  ScopedPerfCounter perf{process_events_perf};
   while (controller->PrimaryEventRing()->HasFront()) {
     if (auto err = ProcessEvent(*controller)) {
       Log(kError, "Error while ProcessEvent: %s at %s:%d\n", err.Name(),
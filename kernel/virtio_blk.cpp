@@ -0,0 +1,279 @@
+#include "virtio_blk.hpp"
+
+#include <cstring>
+
+#include "asmfunc.h"
+#include "interrupt.hpp"
+#include "task.hpp"
+
+namespace {
+// レガシーインタフェースの I/O レジスタ（BAR0 からのオフセット）
+const uint16_t kDeviceFeatures = 0x00;
+const uint16_t kGuestFeatures = 0x04;
+const uint16_t kQueueAddress = 0x08;
+const uint16_t kQueueSize = 0x0c;
+const uint16_t kQueueSelect = 0x0e;
+const uint16_t kQueueNotify = 0x10;
+const uint16_t kDeviceStatus = 0x12;
+const uint16_t kConfigMSIXVector = 0x14;
+const uint16_t kQueueMSIXVector = 0x16;
+// デバイス固有の設定領域は MSI-X が有効なときだけ 4 バイト後ろにずれる
+const uint16_t kDeviceConfig = 0x14;
+const uint16_t kDeviceConfigMSIX = 0x18;
+
+const uint8_t kStatusAcknowledge = 1;
+const uint8_t kStatusDriver = 2;
+const uint8_t kStatusDriverOK = 4;
+const uint8_t kStatusFailed = 128;
+
+const uint16_t kNoVector = 0xffff;
+
+const uint16_t kDescNext = 1;
+const uint16_t kDescWrite = 2;
+
+const uint32_t kRequestIn = 0;
+const uint32_t kRequestOut = 1;
+
+/* 仮想キューは 4KiB 境界に置く必要がある．
+   キューサイズ 256 でディスクリプタとアベイラブルリングが 2 ページ，
+   ユーズドリングが 1 ページを使う． */
+const uint16_t kMaxQueueSize = 256;
+alignas(4096) uint8_t queue_memory[4096 * 4];
+
+size_t AlignUp(size_t value, size_t align) {
+  return (value + align - 1) & ~(align - 1);
+}
+
+template <class T>
+uint64_t PhysAddr(T* p) {
+  // カーネルはアイデンティティマップされている
+  return reinterpret_cast<uint64_t>(p);
+}
+}  // namespace
+
+namespace virtio {
+
+BlockDriver* block_driver;
+
+BlockDriver::BlockDriver(const pci::Device& dev) : dev_{dev} {}
+
+Error BlockDriver::Initialize() {
+  // I/O 空間，メモリ空間，バスマスタを有効にする
+  pci::WriteConfReg(dev_, 0x04, pci::ReadConfReg(dev_, 0x04) | 0x07u);
+
+  const auto bar = pci::ReadBar(dev_, 0);
+  if (bar.error) {
+    return bar.error;
+  }
+  io_base_ = bar.value & ~static_cast<uint64_t>(0x3);
+
+  IoOut8(io_base_ + kDeviceStatus, 0);
+  IoOut8(io_base_ + kDeviceStatus, kStatusAcknowledge);
+  IoOut8(io_base_ + kDeviceStatus, kStatusAcknowledge | kStatusDriver);
+
+  // 追加機能は使わない
+  IoIn32(io_base_ + kDeviceFeatures);
+  IoOut32(io_base_ + kGuestFeatures, 0);
+
+  const uint8_t bsp_local_apic_id =
+      *reinterpret_cast<const uint32_t*>(0xfee00020) >> 24;
+  msix_enabled_ = !pci::ConfigureMSIFixedDestination(
+      dev_, bsp_local_apic_id, pci::MSITriggerMode::kEdge,
+      pci::MSIDeliveryMode::kFixed, InterruptVector::kVirtioBlock, 0);
+  if (msix_enabled_) {
+    IoOut16(io_base_ + kConfigMSIXVector, kNoVector);
+  }
+
+  IoOut16(io_base_ + kQueueSelect, 0);
+  queue_size_ = IoIn16(io_base_ + kQueueSize);
+  if (queue_size_ == 0 || queue_size_ > kMaxQueueSize) {
+    IoOut8(io_base_ + kDeviceStatus, kStatusFailed);
+    return MAKE_ERROR(Error::kBufferTooSmall);
+  }
+
+  memset(queue_memory, 0, sizeof(queue_memory));
+  const size_t avail_offset = sizeof(VirtqDesc) * queue_size_;
+  const size_t used_offset =
+      AlignUp(avail_offset + sizeof(uint16_t) * (3 + queue_size_), 4096);
+  desc_ = reinterpret_cast<VirtqDesc*>(queue_memory);
+  avail_ = reinterpret_cast<VirtqAvail*>(queue_memory + avail_offset);
+  used_ = reinterpret_cast<VirtqUsed*>(queue_memory + used_offset);
+  last_used_idx_ = 0;
+  IoOut32(io_base_ + kQueueAddress, PhysAddr(queue_memory) >> 12);
+
+  if (msix_enabled_) {
+    IoOut16(io_base_ + kQueueMSIXVector, 0);
+    if (IoIn16(io_base_ + kQueueMSIXVector) == kNoVector) {
+      msix_enabled_ = false;
+    }
+  }
+
+  const uint16_t config =
+      io_base_ + (msix_enabled_ ? kDeviceConfigMSIX : kDeviceConfig);
+  capacity_ = IoIn32(config) | static_cast<uint64_t>(IoIn32(config + 4)) << 32;
+
+  IoOut8(io_base_ + kDeviceStatus,
+         kStatusAcknowledge | kStatusDriver | kStatusDriverOK);
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+WithError<uint32_t> BlockDriver::ReadAsync(void* buf, size_t lba, size_t count,
+                                           uint64_t task_id) {
+  if (!msix_enabled_) {
+    return {0, MAKE_ERROR(Error::kNoPCIMSI)};
+  }
+  asm("cli");
+  auto [slot, err] = Submit(kRequestIn, buf, lba, count, task_id);
+  const uint32_t id = err ? 0 : requests_[slot].id;
+  asm("sti");
+  return {id, err};
+}
+
+WithError<uint32_t> BlockDriver::WriteAsync(const void* buf, size_t lba,
+                                            size_t count, uint64_t task_id) {
+  if (!msix_enabled_) {
+    return {0, MAKE_ERROR(Error::kNoPCIMSI)};
+  }
+  asm("cli");
+  auto [slot, err] =
+      Submit(kRequestOut, const_cast<void*>(buf), lba, count, task_id);
+  const uint32_t id = err ? 0 : requests_[slot].id;
+  asm("sti");
+  return {id, err};
+}
+
+void BlockDriver::ProcessCompletions() {
+  while (last_used_idx_ != used_->idx) {
+    const auto head = used_->ring[last_used_idx_ % queue_size_].id;
+    auto& req = requests_[head / 3];
+    req.done = true;
+
+    if (req.task_id != 0) {
+      Message msg{Message::kBlockIOComplete};
+      msg.arg.block_io.request_id = req.id;
+      msg.arg.block_io.status = req.status;
+      task_manager->SendMessage(req.task_id, msg);
+      req.in_use = false;
+    } else if (req.waiter != 0) {
+      task_manager->Wakeup(req.waiter);
+    }
+    ++last_used_idx_;
+  }
+}
+
+Error BlockDriver::Read(void* buf, size_t lba, size_t count) {
+  asm("cli");
+  auto [slot, err] = Submit(kRequestIn, buf, lba, count, 0);
+  asm("sti");
+  if (err) {
+    return err;
+  }
+  return Wait(slot);
+}
+
+Error BlockDriver::Write(const void* buf, size_t lba, size_t count) {
+  asm("cli");
+  auto [slot, err] = Submit(kRequestOut, const_cast<void*>(buf), lba, count, 0);
+  asm("sti");
+  if (err) {
+    return err;
+  }
+  return Wait(slot);
+}
+
+WithError<int> BlockDriver::Submit(uint32_t type, void* buf, size_t lba,
+                                   size_t count, uint64_t task_id) {
+  if (lba + count > capacity_) {
+    return {-1, MAKE_ERROR(Error::kIndexOutOfRange)};
+  }
+
+  int slot = -1;
+  for (int i = 0; i < kMaxRequests && i * 3 + 2 < queue_size_; ++i) {
+    if (!requests_[i].in_use) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    return {-1, MAKE_ERROR(Error::kFull)};
+  }
+
+  auto& req = requests_[slot];
+  req.header = {type, 0, lba};
+  req.status = 0xff;
+  req.in_use = true;
+  req.done = false;
+  req.id = next_id_++;
+  req.task_id = task_id;
+  req.waiter = 0;
+
+  // 1 つの要求はヘッダ，データ，ステータスの 3 つのディスクリプタからなる
+  const uint16_t head = slot * 3;
+  desc_[head] = {PhysAddr(&req.header), sizeof(req.header), kDescNext,
+                 static_cast<uint16_t>(head + 1)};
+  desc_[head + 1] = {
+      PhysAddr(buf), static_cast<uint32_t>(count * kSectorSize),
+      static_cast<uint16_t>(kDescNext | (type == kRequestIn ? kDescWrite : 0)),
+      static_cast<uint16_t>(head + 2)};
+  desc_[head + 2] = {PhysAddr(&req.status), 1, kDescWrite, 0};
+
+  avail_->ring[avail_->idx % queue_size_] = head;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  ++avail_->idx;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  IoOut16(io_base_ + kQueueNotify, 0);
+
+  return {slot, MAKE_ERROR(Error::kSuccess)};
+}
+
+Error BlockDriver::Wait(int slot) {
+  auto& req = requests_[slot];
+  /* 割り込みで完了を知れるなら，ProcessCompletions に起こしてもらうまで眠る．
+     タスク管理の初期化前や MSI-X がないときはユーズドリングを自分で確かめる．
+     完了の確認から眠るまで割り込みを禁止しているので，起こされ損ねない． */
+  const bool sleep = msix_enabled_ && task_manager;
+  while (true) {
+    asm("cli");
+    ProcessCompletions();
+    const bool done = req.done;
+    if (!done && sleep) {
+      req.waiter = task_manager->CurrentTask().ID();
+      task_manager->CurrentTask().Sleep();
+    }
+    asm("sti");
+    if (done) {
+      break;
+    }
+    if (!sleep) {
+      asm("pause");
+    }
+  }
+
+  const bool ok = req.status == 0;
+  req.in_use = false;
+  return MAKE_ERROR(ok ? Error::kSuccess : Error::kIOError);
+}
+
+Error InitializeBlock() {
+  pci::Device* blk_dev = nullptr;
+  for (int i = 0; i < pci::num_devices; ++i) {
+    auto& dev = pci::devices[i];
+    if (pci::ReadVendorId(dev) == 0x1af4 &&
+        pci::ReadDeviceId(dev.bus, dev.device, dev.function) == 0x1001) {
+      blk_dev = &dev;
+      break;
+    }
+  }
+  if (!blk_dev) {
+    return MAKE_ERROR(Error::kUnknownDevice);
+  }
+
+  auto driver = new BlockDriver{*blk_dev};
+  if (auto err = driver->Initialize()) {
+    return err;
+  }
+  block_driver = driver;
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+}  // namespace virtio
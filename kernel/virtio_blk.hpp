@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "block.hpp"
+#include "error.hpp"
+#include "pci.hpp"
+
+namespace virtio {
+
+struct VirtqDesc {
+  uint64_t addr;
+  uint32_t len;
+  uint16_t flags;
+  uint16_t next;
+} __attribute__((packed));
+
+struct VirtqAvail {
+  uint16_t flags;
+  uint16_t idx;
+  uint16_t ring[];
+} __attribute__((packed));
+
+struct VirtqUsedElem {
+  uint32_t id;
+  uint32_t len;
+} __attribute__((packed));
+
+struct VirtqUsed {
+  uint16_t flags;
+  uint16_t idx;
+  VirtqUsedElem ring[];
+} __attribute__((packed));
+
+struct BlockRequestHeader {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t sector;
+} __attribute__((packed));
+
+/*
+  レガシーインタフェースの virtio-blk ドライバ．
+  ReadAsync / WriteAsync は要求を発行してすぐに戻り，完了すると task_id の
+  タスクへ Message::kBlockIOComplete が届く．同時に kMaxRequests 個まで
+  要求を発行できる．完了は MSI-X の割り込みで知るので，MSI-X が使えない
+  ときは kNoPCIMSI を返して発行しない．
+  BlockDevice としての Read / Write は完了するまで待つ．割り込みが届く
+  状態でタスク管理が動いていれば眠り，そうでなければユーズドリングを
+  自分で確かめ続ける．
+*/
+class BlockDriver : public BlockDevice {
+ public:
+  static const int kMaxRequests = 32;
+  static const size_t kSectorSize = 512;
+
+  BlockDriver(const pci::Device& dev);
+  Error Initialize();
+
+  WithError<uint32_t> ReadAsync(void* buf, size_t lba, size_t count,
+                                uint64_t task_id);
+  WithError<uint32_t> WriteAsync(const void* buf, size_t lba, size_t count,
+                                 uint64_t task_id);
+
+  // 完了した要求を回収する．割り込みを禁止した状態で呼ぶ
+  void ProcessCompletions();
+  bool AsyncAvailable() const { return msix_enabled_; }
+
+  Error Read(void* buf, size_t lba, size_t count) override;
+  Error Write(const void* buf, size_t lba, size_t count) override;
+  size_t SectorSize() const override { return kSectorSize; }
+  size_t SectorCount() const override { return capacity_; }
+
+ private:
+  struct Request {
+    BlockRequestHeader header;
+    volatile uint8_t status;
+    bool in_use;
+    volatile bool done;
+    uint32_t id;
+    uint64_t task_id;  // 0 なら完了を知らせない（Read / Write が待つ）
+    uint64_t waiter;   // Read / Write で完了を待って眠っているタスク
+  };
+
+  pci::Device dev_;
+  uint16_t io_base_{0};
+  bool msix_enabled_{false};
+  uint64_t capacity_{0};
+
+  uint16_t queue_size_{0};
+  VirtqDesc* desc_{nullptr};
+  VirtqAvail* avail_{nullptr};
+  volatile VirtqUsed* used_{nullptr};
+  uint16_t last_used_idx_{0};
+
+  Request requests_[kMaxRequests]{};
+  uint32_t next_id_{1};
+
+  WithError<int> Submit(uint32_t type, void* buf, size_t lba, size_t count,
+                        uint64_t task_id);
+  Error Wait(int slot);
+};
+
+// virtio-blk デバイスが見つからなければ nullptr
+extern BlockDriver* block_driver;
+
+Error InitializeBlock();
+
+}  // namespace virtio
@@ -2,6 +2,7 @@
 
 #include "font.hpp"
 #include "logger.hpp"
+#include "truetype.hpp"
 
 namespace {
 void DrawTextBox(PixelWriter& writer, Vector2D<int> pos, Vector2D<int> size,
@@ -42,26 +43,56 @@ Window::Window(int width_, int height_, PixelFormat shadow_format)
 
 void Window::DrawTo(FrameBuffer& dest, Vector2D<int> pos,
                     const Rectangle<int>& area) {
+  Rectangle<int> window_area{pos, Size()};
+  Rectangle<int> intersection = area & window_area;
+
   if (!transparent_color) {
-    Rectangle<int> window_area{pos, Size()};
-    Rectangle<int> intersection = area & window_area;
     dest.CopyFrom(shadow_buffer, intersection.pos,
                   {intersection.pos - pos, intersection.size});
     return;
   }
 
+  if (opaque_spans_dirty) {
+    UpdateOpaqueSpans();
+  }
+
+  const auto begin = intersection.pos - pos;
+  const auto end = begin + intersection.size;
+  for (int y = begin.y; y < end.y; ++y) {
+    for (const auto& span : opaque_spans[y]) {
+      const int x0 = std::max(span.x, begin.x);
+      const int x1 = std::min(span.x + span.width, end.x);
+      if (x0 >= x1) {
+        continue;
+      }
+      dest.CopyFrom(shadow_buffer, pos + Vector2D<int>{x0, y},
+                    {{x0, y}, {x1 - x0, 1}});
+    }
+  }
+}
+
+void Window::UpdateOpaqueSpans() {
+  opaque_spans.resize(height);
+  if (!transparent_color) {
+    opaque_spans_dirty = false;
+    return;
+  }
+
   const auto tc = transparent_color.value();
-  auto& writer = dest.Writer();
-  for (int y = std::max(0, 0 - pos.y);
-       y < std::min(Height(), writer.Height() - pos.y); ++y) {
-    for (int x = std::max(0, 0 - pos.x);
-         x < std::min(Width(), writer.Width() - pos.x); ++x) {
-      const auto c = At(x, y);
-      if (c != tc) {
-        writer.Write(c, pos + Vector2D<int>{x, y});
+  for (int y = 0; y < height; ++y) {
+    auto& spans = opaque_spans[y];
+    spans.clear();
+    int x = 0;
+    while (x < width) {
+      while (x < width && data[y][x] == tc) ++x;
+      const int span_begin = x;
+      while (x < width && data[y][x] != tc) ++x;
+      if (span_begin < x) {
+        spans.push_back({span_begin, x - span_begin});
       }
     }
   }
+  opaque_spans_dirty = false;
 }
 
 void Window::Write(const PixelColor& c, int x, int y) {
@@ -70,9 +101,26 @@ void Window::Write(const PixelColor& c, int x, int y) {
   }
   data[y][x] = c;
   shadow_buffer.Writer().Write(c, x, y);
+  opaque_spans_dirty = true;
+}
+
+void Window::WriteSpan(const PixelColor& c, int x, int y, int width) {
+  if (y < 0 || y >= Height()) {
+    return;
+  }
+  const int x_begin = std::max(x, 0);
+  const int x_end = std::min(x + width, Width());
+  if (x_begin >= x_end) {
+    return;
+  }
+  std::fill(data[y].begin() + x_begin, data[y].begin() + x_end, c);
+  shadow_buffer.Writer().WriteSpan(c, x_begin, y, x_end - x_begin);
+  opaque_spans_dirty = true;
 }
 
 void Window::Move(Vector2D<int> dest_pos, const Rectangle<int>& src) {
+  // ずらしている途中で描画されても気付けるように，先に数えておく
+  ++move_count;
   shadow_buffer.Move(dest_pos, src);
 }
 
@@ -153,7 +201,12 @@ void DrawWindowTitle(PixelWriter& writer, const char* title, bool active) {
   }
 
   FillRect(writer, {3, 3}, {win_w - 6, 18}, ToColor(bgcolor));
-  WriteString(writer, 24, 4, ToColor(0xffffff), title);
+  if (TrueTypeFontAvailable()) {
+    WriteStringTT(writer, {24, 4}, ToColor(0xffffff), ToColor(bgcolor), title,
+                  14);
+  } else {
+    WriteString(writer, 24, 4, ToColor(0xffffff), title);
+  }
 
   for (int y = 0; y < kCloseButtonHeight; ++y) {
     for (int x = 0; x < kCloseButtonWidth; ++x) {
@@ -16,17 +16,22 @@ class Window : public PixelWriter {
   Window& operator=(const Window& rhs) = delete;
 
   void Write(const PixelColor& c, int x, int y) override;
+  void WriteSpan(const PixelColor& c, int x, int y, int width) override;
   virtual void Move(Vector2D<int> dest_pos, const Rectangle<int>& src);
 
   int Width() const override { return width; }
   int Height() const override { return height; }
 
   Vector2D<int> Size() const { return {width, height}; }
+  // Move で中身をずらした回数．LayerManager::Scroll が描画との前後を判断する
+  uint64_t MoveCount() const { return move_count; }
 
   void DrawTo(FrameBuffer& dest, Vector2D<int> position,
               const Rectangle<int>& area);
+  bool HasTransparentColor() const { return transparent_color.has_value(); }
   void SetTrasparentColor(std::optional<PixelColor> c) {
     transparent_color = c;
+    opaque_spans_dirty = true;
   }
 
   PixelColor& At(int x, int y) { return data[y][x]; }
@@ -36,11 +41,21 @@ class Window : public PixelWriter {
   virtual void Deactivate() {}
 
  private:
+  // 透過色でない画素が連続する区間
+  struct OpaqueSpan {
+    int x, width;
+  };
+
   int width, height;
 
   std::vector<std::vector<PixelColor>> data{};
   std::optional<PixelColor> transparent_color{std::nullopt};
   FrameBuffer shadow_buffer{};
+  uint64_t move_count{0};
+
+  std::vector<std::vector<OpaqueSpan>> opaque_spans{};
+  bool opaque_spans_dirty{true};
+  void UpdateOpaqueSpans();
 };
 
 class ToplevelWindow : public Window {
@@ -58,6 +73,10 @@ class ToplevelWindow : public Window {
       window.Write(c, x + kTopLeftMargin.x, y + kTopLeftMargin.y);
     }
 
+    void WriteSpan(const PixelColor& c, int x, int y, int width) override {
+      window.WriteSpan(c, x + kTopLeftMargin.x, y + kTopLeftMargin.y, width);
+    }
+
     int Width() const override { return window.Width() - kMarginX; }
     int Height() const override { return window.Height() - kMarginY; }
 
@@ -0,0 +1,17 @@
+#include "graphics.hpp"
+#include "hostbench.hpp"
+
+namespace {
+
+void BenchRectangleIntersect(hostbench::State& state) {
+  Rectangle<int> a{{10, 20}, {300, 200}};
+  Rectangle<int> b{{0, 0}, {1024, 768}};
+  for (auto _ : state) {
+    hostbench::DoNotOptimize(a);
+    hostbench::DoNotOptimize(a & b);
+    a.pos.x = (a.pos.x + 7) % 1024;
+  }
+}
+HOSTBENCH(BenchRectangleIntersect);
+
+}  // namespace
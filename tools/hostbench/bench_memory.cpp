@@ -0,0 +1,42 @@
+#include <memory>
+#include <vector>
+
+#include "hostbench.hpp"
+#include "memory_manager.hpp"
+
+namespace {
+
+// 割り当て表だけで 4MiB あるので，スタックではなくヒープに置く
+std::unique_ptr<BitmapMemoryManager> NewManager(size_t frames) {
+  auto manager = std::make_unique<BitmapMemoryManager>();
+  manager->SetMemoryRange(FrameID{1}, FrameID{frames});
+  return manager;
+}
+
+void BenchFrameAllocateFree(hostbench::State& state) {
+  auto manager = NewManager(1 << 18);
+  for (auto _ : state) {
+    auto [frame, err] = manager->Allocate(1);
+    hostbench::DoNotOptimize(frame);
+    manager->Free(frame, 1);
+  }
+}
+HOSTBENCH(BenchFrameAllocateFree);
+
+/* 先頭から 1 フレームおきに埋まっていると，連続した領域を探す
+   Allocate は割り当て表を長く走査することになる． */
+void BenchFrameAllocateFragmented(hostbench::State& state) {
+  const size_t kFrames = 1 << 16;
+  auto manager = NewManager(kFrames);
+  for (size_t i = 1; i < kFrames / 2; i += 2) {
+    manager->MarkAllocated(FrameID{i}, 1);
+  }
+  for (auto _ : state) {
+    auto [frame, err] = manager->Allocate(4);
+    hostbench::DoNotOptimize(frame);
+    manager->Free(frame, 4);
+  }
+}
+HOSTBENCH(BenchFrameAllocateFragmented);
+
+}  // namespace
@@ -0,0 +1,53 @@
+#include <array>
+
+#include "hostbench.hpp"
+#include "queue.hpp"
+#include "usb/arraymap.hpp"
+
+namespace {
+
+void BenchArrayQueuePushPop(hostbench::State& state) {
+  std::array<int, 32> buf;
+  ArrayQueue<int> queue{buf};
+  for (auto _ : state) {
+    for (int i = 0; i < 16; ++i) {
+      queue.Push(i);
+    }
+    for (int i = 0; i < 16; ++i) {
+      hostbench::DoNotOptimize(queue.Front());
+      queue.Pop();
+    }
+  }
+  state.SetItemsProcessed(16);
+}
+HOSTBENCH(BenchArrayQueuePushPop);
+
+// usb::ArrayMap は線形探索なので，一杯のときの最後の要素が最も遅い
+void BenchArrayMapGetLast(hostbench::State& state) {
+  usb::ArrayMap<int, int, 16> map;
+  for (int i = 0; i < 16; ++i) {
+    map.Put(i, i * 2);
+  }
+  for (auto _ : state) {
+    hostbench::DoNotOptimize(map.Get(15));
+  }
+}
+HOSTBENCH(BenchArrayMapGetLast);
+
+void BenchArrayMapPutDelete(hostbench::State& state) {
+  usb::ArrayMap<int, int, 16> map;
+  for (auto _ : state) {
+    for (int i = 0; i < 16; ++i) {
+      map.Put(i, i);
+    }
+    for (int i = 0; i < 16; ++i) {
+      map.Delete(i);
+    }
+    hostbench::DoNotOptimize(&map);
+    hostbench::ClobberMemory();
+  }
+  state.SetItemsProcessed(16);
+}
+HOSTBENCH(BenchArrayMapPutDelete);
+
+}  // namespace
@@ -0,0 +1,20 @@
+#include "hostbench.hpp"
+#include "timer.hpp"
+
+namespace {
+
+// 期限の異なるタイマを積んだ状態で Tick を回し，期限が来たら積み直す
+void BenchTimerManagerTick(hostbench::State& state) {
+  TimerManager manager;
+  for (int i = 0; i < 64; ++i) {
+    manager.AddTimer(Timer{static_cast<unsigned long>(i + 1), i});
+  }
+  unsigned long next = 65;
+  for (auto _ : state) {
+    manager.Tick();
+    manager.AddTimer(Timer{next++, 0});
+  }
+}
+HOSTBENCH(BenchTimerManagerTick);
+
+}  // namespace
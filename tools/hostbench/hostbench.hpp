@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+  カーネルの部品をホストで測るための小さなベンチマーク枠組み．
+  Google Benchmark と同じ書き方で測りたい処理を書く．
+
+    void BenchFoo(hostbench::State& state) {
+      for (auto _ : state) {
+        hostbench::DoNotOptimize(Foo());
+      }
+    }
+    HOSTBENCH(BenchFoo);
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hostbench {
+
+class State {
+ public:
+  explicit State(uint64_t iterations) : iterations_{iterations} {}
+
+  class Iterator {
+   public:
+    explicit Iterator(uint64_t remaining) : remaining_{remaining} {}
+    bool operator!=(const Iterator&) const { return remaining_ != 0; }
+    void operator++() { --remaining_; }
+    int operator*() const { return 0; }
+
+   private:
+    uint64_t remaining_;
+  };
+
+  Iterator begin() const { return Iterator{iterations_}; }
+  Iterator end() const { return Iterator{0}; }
+  uint64_t Iterations() const { return iterations_; }
+
+  // 1 回の繰り返しで処理した量．指定すると毎秒の処理量も表示する
+  void SetItemsProcessed(uint64_t items) { items_ = items; }
+  uint64_t ItemsProcessed() const { return items_; }
+
+ private:
+  uint64_t iterations_;
+  uint64_t items_{0};
+};
+
+using BenchFunc = void(State&);
+
+struct Registrar {
+  Registrar(const char* name, BenchFunc* func);
+};
+
+template <class T>
+inline void DoNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void ClobberMemory() { asm volatile("" : : : "memory"); }
+
+}  // namespace hostbench
+
+#define HOSTBENCH(func) \
+  static ::hostbench::Registrar hostbench_registrar_##func{#func, func}
@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+  カーネルの部品をホストで確かめるための小さなテスト枠組み．
+
+    HOSTTEST(ArrayQueuePushPop) {
+      ...
+      CHECK(queue.Count() == 1);
+    }
+
+  CHECK は失敗しても続け，REQUIRE は失敗したらそのテストを打ち切る．
+*/
+
+namespace hosttest {
+
+using TestFunc = void();
+
+struct Registrar {
+  Registrar(const char* name, TestFunc* func);
+};
+
+void Fail(const char* file, int line, const char* expr);
+
+}  // namespace hosttest
+
+#define HOSTTEST(name)                                   \
+  static void name();                                    \
+  static ::hosttest::Registrar hosttest_registrar_##name{ \
+      #name, name};                                      \
+  static void name()
+
+#define CHECK(expr)                                \
+  do {                                             \
+    if (!(expr)) {                                 \
+      ::hosttest::Fail(__FILE__, __LINE__, #expr); \
+    }                                              \
+  } while (0)
+
+#define REQUIRE(expr)                              \
+  do {                                             \
+    if (!(expr)) {                                 \
+      ::hosttest::Fail(__FILE__, __LINE__, #expr); \
+      return;                                      \
+    }                                              \
+  } while (0)
@@ -0,0 +1,64 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "hostbench.hpp"
+
+namespace {
+
+struct Entry {
+  const char* name;
+  hostbench::BenchFunc* func;
+};
+
+std::vector<Entry>& Registry() {
+  static std::vector<Entry> registry;
+  return registry;
+}
+
+// 繰り返し回数を倍々に増やし，この時間を超えたら結果とする
+const double kMinSeconds = 0.2;
+
+}  // namespace
+
+hostbench::Registrar::Registrar(const char* name, BenchFunc* func) {
+  Registry().push_back({name, func});
+}
+
+/* 使い方: hostbench [名前の一部]
+   結果はカーネルの bench コマンドと同じ "BENCH <name> <value> <unit>" 形式 */
+int main(int argc, char** argv) {
+  const char* filter = argc > 1 ? argv[1] : nullptr;
+
+  for (const auto& entry : Registry()) {
+    if (filter && !strstr(entry.name, filter)) {
+      continue;
+    }
+
+    uint64_t iterations = 1;
+    double seconds = 0;
+    uint64_t items = 0;
+    while (true) {
+      hostbench::State state{iterations};
+      const auto start = std::chrono::steady_clock::now();
+      entry.func(state);
+      const auto end = std::chrono::steady_clock::now();
+      seconds = std::chrono::duration<double>(end - start).count();
+      items = state.ItemsProcessed();
+      if (seconds >= kMinSeconds || iterations >= (1ull << 40)) {
+        break;
+      }
+      iterations *= 2;
+    }
+
+    // 処理量を指定したものは毎秒の処理量を，それ以外は 1 回あたりの時間を出す
+    if (items) {
+      printf("BENCH %s %.0f item/s\n", entry.name,
+             items * iterations / seconds);
+    } else {
+      printf("BENCH %s %.0f ns\n", entry.name, seconds * 1e9 / iterations);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,66 @@
+/*
+  ホストでリンクするための，カーネルの残りの部分の代わり．
+  ここで定義するものは測る対象の部品から参照されるだけで，中身は使わない．
+  ただし送られたメッセージはテストで確かめられるよう記録する．
+*/
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+
+#include "acpi.hpp"
+#include "interrupt.hpp"
+#include "logger.hpp"
+#include "paging.hpp"
+#include "perf.hpp"
+#include "serial.hpp"
+#include "task.hpp"
+
+extern "C" {
+caddr_t program_break, program_break_end;
+
+uint64_t ReadTSC() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+}
+
+int Log(LogLevel level, const char* format, ...) { return 0; }
+
+void NotifyEndOfInterrupt() {}
+
+// ホストではページテーブルを触れないので，fat::MapFile は常に失敗する
+WithError<uintptr_t> MapReadOnly(uintptr_t phys, size_t bytes) {
+  return {0, MAKE_ERROR(Error::kNotImplemented)};
+}
+
+void Remap(uintptr_t virt, uintptr_t phys, size_t bytes) {}
+void Unmap(uintptr_t virt, size_t bytes) {}
+
+ScopedPerfCounter::ScopedPerfCounter(PerfRegion& region) : region_{region} {}
+ScopedPerfCounter::~ScopedPerfCounter() {}
+
+namespace acpi {
+void WaitMilliseconds(unsigned long msec) {}
+}  // namespace acpi
+
+namespace serial {
+void Poll() {}
+}  // namespace serial
+
+TaskManager* task_manager;
+
+// TimerManager::Tick が送るメッセージは数えて，最後のものだけ覚えておく
+uint64_t stub_messages_sent;
+Message stub_last_message;
+
+Error TaskManager::SendMessage(uint64_t id, const Message& msg) {
+  ++stub_messages_sent;
+  stub_last_message = msg;
+  return MAKE_ERROR(Error::kSuccess);
+}
+
+void TaskManager::SwitchTask(bool current_sleep) {}
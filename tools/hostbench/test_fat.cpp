@@ -0,0 +1,317 @@
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "block.hpp"
+#include "fat.hpp"
+#include "hosttest.hpp"
+
+namespace {
+
+/*
+  テスト用の小さな FAT32 ボリューム．
+  512 バイトのセクタ 1 つを 1 クラスタとし，ルートディレクトリ（クラスタ 2）に
+  HELLO.TXT（クラスタ 3, 4）と APPS ディレクトリ（クラスタ 5），
+  APPS の中に FOO（クラスタ 6）を置く．
+*/
+const size_t kSectorSize = 512;
+const size_t kReservedSectors = 32;
+const size_t kFATSectors = 16;
+const size_t kNumFATs = 2;
+const size_t kDataSector = kReservedSectors + kNumFATs * kFATSectors;
+
+const std::string kHelloText = [] {
+  std::string s;
+  for (int i = 0; s.size() < 600; ++i) {
+    s += "line " + std::to_string(i) + "\n";
+  }
+  return s.substr(0, 600);
+}();
+const char kFooText[] = "foo binary";
+
+void PutEntry(std::vector<uint8_t>& image, unsigned long cluster, int index,
+              const char* name, fat::Attribute attr,
+              unsigned long first_cluster, uint32_t size) {
+  fat::DirectoryEntry entry{};
+  memcpy(entry.name, name, 11);
+  entry.attr = attr;
+  entry.first_cluster_low = first_cluster & 0xffff;
+  entry.first_cluster_high = first_cluster >> 16;
+  entry.file_size = size;
+  memcpy(&image[(kDataSector + cluster - 2) * kSectorSize +
+                index * sizeof(entry)],
+         &entry, sizeof(entry));
+}
+
+void SetFAT(std::vector<uint8_t>& image, unsigned long cluster,
+            uint32_t value) {
+  for (size_t i = 0; i < kNumFATs; ++i) {
+    memcpy(&image[(kReservedSectors + i * kFATSectors) * kSectorSize +
+                  cluster * 4],
+           &value, 4);
+  }
+}
+
+std::vector<uint8_t> MakeVolume(size_t total_sectors) {
+  std::vector<uint8_t> image(total_sectors * kSectorSize);
+
+  fat::BPB bpb{};
+  memcpy(bpb.oem_name, "MIKANOS ", 8);
+  bpb.bytes_per_sector = kSectorSize;
+  bpb.sectors_per_cluster = 1;
+  bpb.reserved_sector_count = kReservedSectors;
+  bpb.num_fats = kNumFATs;
+  bpb.media = 0xf8;
+  bpb.total_sectors_32 = total_sectors;
+  bpb.fat_size_32 = kFATSectors;
+  bpb.root_cluster = 2;
+  memcpy(bpb.volume_label, "HOSTTEST   ", 11);
+  memcpy(bpb.fs_type, "FAT32   ", 8);
+  memcpy(image.data(), &bpb, sizeof(bpb));
+  image[510] = 0x55;
+  image[511] = 0xaa;
+
+  SetFAT(image, 0, 0x0ffffff8);
+  SetFAT(image, 1, 0x0fffffff);
+  SetFAT(image, 2, fat::kEndOfClusterchain);
+  SetFAT(image, 3, 4);
+  SetFAT(image, 4, fat::kEndOfClusterchain);
+  SetFAT(image, 5, fat::kEndOfClusterchain);
+  SetFAT(image, 6, fat::kEndOfClusterchain);
+
+  PutEntry(image, 2, 0, "HELLO   TXT", fat::Attribute::kArchive, 3,
+           kHelloText.size());
+  PutEntry(image, 2, 1, "APPS       ", fat::Attribute::kDirectory, 5, 0);
+  PutEntry(image, 5, 0, ".          ", fat::Attribute::kDirectory, 5, 0);
+  PutEntry(image, 5, 1, "..         ", fat::Attribute::kDirectory, 0, 0);
+  PutEntry(image, 5, 2, "FOO        ", fat::Attribute::kArchive, 6,
+           sizeof(kFooText) - 1);
+
+  memcpy(&image[(kDataSector + 3 - 2) * kSectorSize], kHelloText.data(),
+         kHelloText.size());
+  memcpy(&image[(kDataSector + 6 - 2) * kSectorSize], kFooText,
+         sizeof(kFooText) - 1);
+  return image;
+}
+
+// ボリュームとその RAM ディスク．fat の状態は大域変数なので，1 つずつ使う
+struct TestVolume {
+  explicit TestVolume(size_t total_sectors)
+      : TestVolume{total_sectors, total_sectors} {}
+  TestVolume(size_t total_sectors, size_t device_sectors)
+      : image{MakeVolume(total_sectors)},
+        device{image.data(), kSectorSize, device_sectors} {}
+
+  std::vector<uint8_t> image;
+  RAMBlockDevice device;
+};
+
+HOSTTEST(FatParseBPB) {
+  TestVolume volume{2048};
+  REQUIRE(!fat::Initialize(volume.device));
+  CHECK(fat::boot_volume_image->bytes_per_sector == kSectorSize);
+  CHECK(fat::boot_volume_image->root_cluster == 2);
+  CHECK(fat::bytes_per_cluster == kSectorSize);
+  CHECK(fat::ClusterOffset(2) == kDataSector * kSectorSize);
+  CHECK(fat::NextCluster(3) == 4);
+  CHECK(fat::NextCluster(4) == fat::kEndOfClusterchain);
+
+  // データ領域のクラスタ 2 から 2048 - 64 個のうち 5 個が使用中
+  CHECK(fat::CountFreeClusters() == 2048 - kDataSector - 5);
+}
+
+HOSTTEST(FatRejectsNonFAT32) {
+  TestVolume volume{2048};
+  volume.image[511] = 0;
+  CHECK(fat::Initialize(volume.device).Cause() == Error::kInvalidFormat);
+}
+
+HOSTTEST(FatRejectedVolumeKeepsCurrent) {
+  TestVolume current{2048};
+  REQUIRE(!fat::Initialize(current.device));
+
+  // 署名はあるがジオメトリが壊れているボリュームは，何も変えずに断る
+  TestVolume broken{2048};
+  broken.image[offsetof(fat::BPB, sectors_per_cluster)] = 0;
+  CHECK(fat::Initialize(broken.device).Cause() == Error::kInvalidFormat);
+  TestVolume too_small{2048, kDataSector};
+  CHECK(fat::Initialize(too_small.device).Cause() == Error::kInvalidFormat);
+
+  CHECK(fat::boot_volume_image->sectors_per_cluster == 1);
+  CHECK(fat::NextCluster(3) == 4);
+  CHECK(fat::CountFreeClusters() == 2048 - kDataSector - 5);
+  auto entry = fat::FindFile("hello.txt");
+  REQUIRE(entry);
+  std::string buf(kHelloText.size(), '\0');
+  CHECK(fat::ReadFile(*entry, 0, &buf[0], buf.size()) == kHelloText.size());
+  CHECK(buf == kHelloText);
+}
+
+HOSTTEST(FatReadDirectory) {
+  TestVolume volume{2048};
+  REQUIRE(!fat::Initialize(volume.device));
+
+  auto hello = fat::FindFile("hello.txt");
+  REQUIRE(hello);
+  auto [base, ext] = fat::ReadName(*hello);
+  CHECK(base == "HELLO");
+  CHECK(ext == "TXT");
+  CHECK(hello->file_size == kHelloText.size());
+  CHECK(!fat::IsDirectory(*hello));
+  CHECK(fat::NameIsEqual(*hello, "Hello.Txt"));
+
+  auto apps = fat::FindFile("APPS");
+  REQUIRE(apps);
+  CHECK(fat::IsDirectory(*apps));
+
+  const auto& index = fat::GetDirectoryIndex(0);
+  CHECK(index.entries.size() == 2);
+  CHECK(!fat::FindFile("missing"));
+}
+
+HOSTTEST(FatFindPath) {
+  TestVolume volume{2048};
+  REQUIRE(!fat::Initialize(volume.device));
+
+  auto foo = fat::FindFile("/apps/foo");
+  REQUIRE(foo);
+  CHECK(foo->FirstCluster() == 6);
+  CHECK(fat::FindFile("foo", 5) == foo);
+  CHECK(!fat::FindFile("/hello.txt/foo"));
+}
+
+// 2 クラスタにまたがるファイルを，境界をまたいで読む
+HOSTTEST(FatReadFile) {
+  TestVolume volume{2048};
+  REQUIRE(!fat::Initialize(volume.device));
+
+  auto hello = fat::FindFile("HELLO.TXT");
+  REQUIRE(hello);
+  const auto& extents = fat::GetExtents(hello->FirstCluster());
+  REQUIRE(extents.size() == 1);
+  CHECK(extents[0].cluster == 3);
+  CHECK(extents[0].length == 2);
+
+  std::vector<char> buf(1024);
+  CHECK(fat::ReadFile(*hello, 0, buf.data(), buf.size()) ==
+        kHelloText.size());
+  CHECK(memcmp(buf.data(), kHelloText.data(), kHelloText.size()) == 0);
+
+  CHECK(fat::ReadFile(*hello, 500, buf.data(), 50) == 50);
+  CHECK(memcmp(buf.data(), kHelloText.data() + 500, 50) == 0);
+  CHECK(fat::ReadFile(*hello, kHelloText.size(), buf.data(), 1) == 0);
+}
+
+// 開いている記述子があるファイルは消せず，閉じれば消せる
+HOSTTEST(FatDeleteOpenFile) {
+  TestVolume volume{2048};
+  REQUIRE(!fat::Initialize(volume.device));
+  auto hello = fat::FindIndexedEntry("HELLO.TXT");
+  REQUIRE(hello);
+  const auto free_clusters = fat::CountFreeClusters();
+
+  {
+    fat::FileDescriptor fd{*hello, false};
+    CHECK(fat::DeleteFile("HELLO.TXT").Cause() == Error::kBusy);
+    CHECK(fat::CountFreeClusters() == free_clusters);
+
+    char buf[16];
+    CHECK(fd.Read(buf, 4) == 4);
+    CHECK(memcmp(buf, kHelloText.data(), 4) == 0);
+  }
+
+  CHECK(!fat::DeleteFile("HELLO.TXT"));
+  CHECK(!fat::FindFile("HELLO.TXT"));
+  CHECK(fat::CountFreeClusters() == free_clusters + 2);
+}
+
+/* 1 クラスタずつ書き足して，空きがなくなったら kFull で止まることを確かめる．
+   書けたクラスタ数を返す． */
+size_t FillVolume(fat::IndexedEntry& file) {
+  std::vector<uint8_t> buf(kSectorSize, 0xa5);
+  size_t clusters = 0;
+  while (true) {
+    auto [written, err] =
+        fat::WriteFile(file, clusters * kSectorSize, buf.data(), buf.size());
+    if (err) {
+      CHECK(err.Cause() == Error::kFull);
+      return clusters;
+    }
+    CHECK(written == buf.size());
+    ++clusters;
+  }
+}
+
+HOSTTEST(FatFillVolume) {
+  TestVolume volume{2048};
+  REQUIRE(!fat::Initialize(volume.device));
+  const auto free_clusters = fat::CountFreeClusters();
+
+  auto [file, err] = fat::CreateFile("BIG.DAT");
+  REQUIRE(!err);
+  CHECK(FillVolume(*file) == free_clusters);
+  CHECK(fat::CountFreeClusters() == 0);
+  CHECK(file->entry.file_size == free_clusters * kSectorSize);
+
+  // 空きがなくなった後の書き込みはクラスタを失わずに失敗する
+  CHECK(fat::WriteFile(*file, 0, "x", 1).error.Cause() == Error::kSuccess);
+  CHECK(fat::CreateFile("MORE.DAT").error.Cause() == Error::kSuccess);
+  auto more = fat::FindIndexedEntry("MORE.DAT");
+  REQUIRE(more);
+  CHECK(fat::WriteFile(*more, 0, "x", 1).error.Cause() == Error::kFull);
+  CHECK(more->entry.FirstCluster() == 0);
+  CHECK(!fat::Sync());
+
+  CHECK(!fat::DeleteFile("BIG.DAT"));
+  CHECK(fat::CountFreeClusters() == free_clusters);
+}
+
+// ためておいた書き込みが入りきらなければ，Write と Flush が失敗を知らせる
+HOSTTEST(FatFileDescriptorReportsFull) {
+  TestVolume volume{2048};
+  REQUIRE(!fat::Initialize(volume.device));
+  auto [file, err] = fat::CreateFile("BIG.DAT");
+  REQUIRE(!err);
+  std::vector<uint8_t> fill(fat::CountFreeClusters() * kSectorSize, 0xa5);
+  REQUIRE(!fat::WriteFile(*file, 0, fill.data(), fill.size()).error);
+
+  fat::FileDescriptor fd{*file, true};
+  std::vector<uint8_t> chunk(1024, 0x5a);
+  const size_t kChunks = fat::FileDescriptor::kWriteBufferBytes / chunk.size();
+  for (size_t i = 0; i + 1 < kChunks; ++i) {
+    CHECK(fd.Write(chunk.data(), chunk.size()) == chunk.size());
+  }
+  // バッファが一杯になって書き出すところで，短い数が返る
+  CHECK(fd.Write(chunk.data(), chunk.size()) < chunk.size());
+  CHECK(file->entry.file_size == fill.size());
+
+  CHECK(fd.Write("x", 1) == 1);
+  CHECK(fd.Flush().Cause() == Error::kFull);
+  CHECK(!fd.Flush());
+}
+
+/* ローダが先頭しか読み込まなかったボリュームでは，BPB が示す大きさではなく
+   デバイスに収まるクラスタだけを割り当てる */
+HOSTTEST(FatFillTruncatedVolume) {
+  const size_t kBPBSectors = 4096;
+  const size_t kDeviceSectors = 1024;
+  TestVolume volume{kBPBSectors, kDeviceSectors};
+  REQUIRE(!fat::Initialize(volume.device));
+  const auto free_clusters = fat::CountFreeClusters();
+  CHECK(free_clusters == kDeviceSectors - kDataSector - 5);
+
+  auto [file, err] = fat::CreateFile("BIG.DAT");
+  REQUIRE(!err);
+  CHECK(FillVolume(*file) == free_clusters);
+  CHECK(!fat::Sync());
+
+  // デバイスの外には何も書かれていない
+  bool untouched = true;
+  for (size_t i = kDeviceSectors * kSectorSize; i < volume.image.size(); ++i) {
+    untouched &= volume.image[i] == 0;
+  }
+  CHECK(untouched);
+}
+
+}  // namespace
@@ -0,0 +1,43 @@
+#include "graphics.hpp"
+#include "hosttest.hpp"
+
+namespace {
+
+bool Equal(const Rectangle<int>& a, const Rectangle<int>& b) {
+  return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.size.x == b.size.x &&
+         a.size.y == b.size.y;
+}
+
+HOSTTEST(RectangleIntersectOverlap) {
+  Rectangle<int> a{{10, 20}, {100, 50}};
+  Rectangle<int> b{{50, 0}, {100, 40}};
+  CHECK(Equal(a & b, {{50, 20}, {60, 20}}));
+  CHECK(Equal(b & a, {{50, 20}, {60, 20}}));
+}
+
+HOSTTEST(RectangleIntersectContained) {
+  Rectangle<int> outer{{0, 0}, {1024, 768}};
+  Rectangle<int> inner{{10, 20}, {30, 40}};
+  CHECK(Equal(outer & inner, inner));
+  CHECK(Equal(inner & outer, inner));
+}
+
+HOSTTEST(RectangleIntersectDisjoint) {
+  Rectangle<int> a{{0, 0}, {10, 10}};
+  Rectangle<int> right{{20, 0}, {10, 10}};
+  Rectangle<int> below{{0, 20}, {10, 10}};
+  CHECK(Equal(a & right, {{0, 0}, {0, 0}}));
+  CHECK(Equal(a & below, {{0, 0}, {0, 0}}));
+}
+
+// 辺が接するだけなら，幅か高さが 0 の長方形になる
+HOSTTEST(RectangleIntersectTouching) {
+  Rectangle<int> a{{0, 0}, {10, 10}};
+  Rectangle<int> b{{10, 0}, {10, 10}};
+  const auto r = a & b;
+  CHECK(r.pos.x == 10);
+  CHECK(r.size.x == 0);
+  CHECK(r.size.y == 10);
+}
+
+}  // namespace
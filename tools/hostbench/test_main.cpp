@@ -0,0 +1,54 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "hosttest.hpp"
+
+namespace {
+
+struct Entry {
+  const char* name;
+  hosttest::TestFunc* func;
+};
+
+std::vector<Entry>& Registry() {
+  static std::vector<Entry> registry;
+  return registry;
+}
+
+int failures;  // 実行中のテストで失敗した CHECK の数
+
+}  // namespace
+
+hosttest::Registrar::Registrar(const char* name, TestFunc* func) {
+  Registry().push_back({name, func});
+}
+
+void hosttest::Fail(const char* file, int line, const char* expr) {
+  printf("%s:%d: CHECK failed: %s\n", file, line, expr);
+  ++failures;
+}
+
+/* 使い方: hosttest [名前の一部]
+   失敗したテストがあれば終了コードを 1 にする */
+int main(int argc, char** argv) {
+  const char* filter = argc > 1 ? argv[1] : nullptr;
+
+  int num_run = 0, num_failed = 0;
+  for (const auto& entry : Registry()) {
+    if (filter && !strstr(entry.name, filter)) {
+      continue;
+    }
+
+    failures = 0;
+    entry.func();
+    ++num_run;
+    if (failures) {
+      ++num_failed;
+    }
+    printf("%s %s\n", failures ? "FAIL" : "ok  ", entry.name);
+  }
+
+  printf("%d tests, %d failed\n", num_run, num_failed);
+  return num_failed ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+#include <memory>
+
+#include "hosttest.hpp"
+#include "memory_manager.hpp"
+
+namespace {
+
+// 割り当て表だけで 4MiB あるので，スタックではなくヒープに置く
+std::unique_ptr<BitmapMemoryManager> NewManager(size_t begin, size_t end) {
+  auto manager = std::make_unique<BitmapMemoryManager>();
+  manager->SetMemoryRange(FrameID{begin}, FrameID{end});
+  return manager;
+}
+
+HOSTTEST(BitmapMemoryManagerAllocateFree) {
+  auto manager = NewManager(1, 64);
+  auto a = manager->Allocate(3);
+  auto b = manager->Allocate(2);
+  REQUIRE(!a.error && !b.error);
+  CHECK(a.value.ID() == 1);
+  CHECK(b.value.ID() == 4);
+
+  // 解放した場所は先頭から探す次の割り当てで再び使われる
+  CHECK(!manager->Free(a.value, 3));
+  auto c = manager->Allocate(3);
+  REQUIRE(!c.error);
+  CHECK(c.value.ID() == 1);
+}
+
+// 連続した空きがなければ，その先の十分な空きを探す
+HOSTTEST(BitmapMemoryManagerSkipsFragments) {
+  auto manager = NewManager(0, 64);
+  for (size_t i = 0; i < 16; i += 2) {
+    manager->MarkAllocated(FrameID{i}, 1);
+  }
+  auto frame = manager->Allocate(2);
+  REQUIRE(!frame.error);
+  CHECK(frame.value.ID() == 15);
+
+  auto single = manager->Allocate(1);
+  REQUIRE(!single.error);
+  CHECK(single.value.ID() == 1);
+}
+
+// 範囲の終わりを越えて割り当てない
+HOSTTEST(BitmapMemoryManagerRangeEnd) {
+  auto manager = NewManager(1, 9);
+  size_t allocated = 0;
+  while (true) {
+    auto frame = manager->Allocate(1);
+    if (frame.error) {
+      CHECK(frame.error.Cause() == Error::kNoEnoughMemory);
+      CHECK(frame.value.ID() == kNullFrame.ID());
+      break;
+    }
+    CHECK(frame.value.ID() >= 1 && frame.value.ID() < 9);
+    ++allocated;
+  }
+  CHECK(allocated == 8);
+
+  auto wide = NewManager(0, 8);
+  wide->MarkAllocated(FrameID{0}, 6);
+  CHECK(wide->Allocate(4).error.Cause() == Error::kNoEnoughMemory);
+  auto last = wide->Allocate(2);
+  REQUIRE(!last.error);
+  CHECK(last.value.ID() == 6);
+}
+
+}  // namespace
@@ -0,0 +1,84 @@
+#include <array>
+
+#include "hosttest.hpp"
+#include "queue.hpp"
+#include "usb/arraymap.hpp"
+
+namespace {
+
+HOSTTEST(ArrayQueueFifo) {
+  std::array<int, 4> buf;
+  ArrayQueue<int> queue{buf};
+  CHECK(queue.Capacity() == 4);
+  CHECK(queue.Count() == 0);
+
+  for (int i = 0; i < 3; ++i) {
+    CHECK(!queue.Push(i));
+  }
+  CHECK(queue.Count() == 3);
+  for (int i = 0; i < 3; ++i) {
+    CHECK(queue.Front() == i);
+    CHECK(!queue.Pop());
+  }
+  CHECK(queue.Count() == 0);
+}
+
+// 書き込み位置と読み込み位置が配列の末尾で折り返しても順序を保つ
+HOSTTEST(ArrayQueueWrapAround) {
+  std::array<int, 4> buf;
+  ArrayQueue<int> queue{buf};
+  int next_push = 0, next_pop = 0;
+  for (int round = 0; round < 10; ++round) {
+    CHECK(!queue.Push(next_push++));
+    CHECK(!queue.Push(next_push++));
+    CHECK(queue.Front() == next_pop++);
+    CHECK(!queue.Pop());
+    CHECK(queue.Front() == next_pop++);
+    CHECK(!queue.Pop());
+  }
+  CHECK(queue.Count() == 0);
+}
+
+HOSTTEST(ArrayQueueFullAndEmpty) {
+  std::array<int, 2> buf;
+  ArrayQueue<int> queue{buf};
+  CHECK(queue.Pop().Cause() == Error::kEmpty);
+
+  CHECK(!queue.Push(1));
+  CHECK(!queue.Push(2));
+  CHECK(queue.Push(3).Cause() == Error::kFull);
+  CHECK(queue.Count() == 2);
+  CHECK(queue.Front() == 1);
+}
+
+HOSTTEST(ArrayMapPutGetDelete) {
+  usb::ArrayMap<int, int, 4> map;
+  CHECK(!map.Get(1));
+
+  map.Put(1, 10);
+  map.Put(2, 20);
+  CHECK(map.Get(1) == 10);
+  CHECK(map.Get(2) == 20);
+  CHECK(!map.Get(3));
+
+  map.Delete(1);
+  CHECK(!map.Get(1));
+  CHECK(map.Get(2) == 20);
+
+  // 空いた場所は再び使える
+  map.Put(3, 30);
+  CHECK(map.Get(3) == 30);
+}
+
+// 一杯のときの Put は何もしない
+HOSTTEST(ArrayMapFull) {
+  usb::ArrayMap<int, int, 2> map;
+  map.Put(1, 10);
+  map.Put(2, 20);
+  map.Put(3, 30);
+  CHECK(map.Get(1) == 10);
+  CHECK(map.Get(2) == 20);
+  CHECK(!map.Get(3));
+}
+
+}  // namespace
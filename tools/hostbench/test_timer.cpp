@@ -0,0 +1,60 @@
+#include "hosttest.hpp"
+#include "message.hpp"
+#include "timer.hpp"
+
+extern uint64_t stub_messages_sent;
+extern Message stub_last_message;
+
+namespace {
+
+HOSTTEST(TimerManagerTimeoutOrder) {
+  TimerManager manager;
+  const auto sent = stub_messages_sent;
+  manager.AddTimer(Timer{5, 2});
+  manager.AddTimer(Timer{3, 1});
+
+  manager.Tick();
+  manager.Tick();
+  CHECK(stub_messages_sent == sent);
+
+  manager.Tick();
+  CHECK(manager.CurrentTick() == 3);
+  CHECK(stub_messages_sent == sent + 1);
+  CHECK(stub_last_message.type == Message::kTimerTimeout);
+  CHECK(stub_last_message.arg.timer.timeout == 3);
+  CHECK(stub_last_message.arg.timer.value == 1);
+
+  manager.Tick();
+  manager.Tick();
+  CHECK(stub_messages_sent == sent + 2);
+  CHECK(stub_last_message.arg.timer.value == 2);
+}
+
+// 同じ tick に期限が来たタイマは 1 回の Tick ですべて通知する
+HOSTTEST(TimerManagerSameTick) {
+  TimerManager manager;
+  const auto sent = stub_messages_sent;
+  for (int i = 0; i < 4; ++i) {
+    manager.AddTimer(Timer{1, i});
+  }
+  manager.Tick();
+  CHECK(stub_messages_sent == sent + 4);
+}
+
+// タスク切り替え用のタイマはメッセージを送らず，Tick の戻り値で知らせて積み直す
+HOSTTEST(TimerManagerTaskTimer) {
+  TimerManager manager;
+  const auto sent = stub_messages_sent;
+  manager.AddTimer(Timer{kTaskTimerPeriod, kTaskTimerValue});
+
+  int timeouts = 0;
+  for (int i = 0; i < kTaskTimerPeriod * 3; ++i) {
+    if (manager.Tick()) {
+      ++timeouts;
+    }
+  }
+  CHECK(timeouts == 3);
+  CHECK(stub_messages_sent == sent);
+}
+
+}  // namespace
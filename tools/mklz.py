@@ -0,0 +1,189 @@
+#!/usr/bin/python3
+
+"""kernel.elf やボリュームイメージを MKLZ 形式に圧縮する．
+
+MKLZ はローダがファイルを読みながら展開するための入れ物で，
+中身は独立した LZ4 ブロックの列になっている（数値はすべてリトルエンディアン）．
+
+    ヘッダ   "MKLZ", u32 ブロックの大きさ, u64 展開後の大きさ
+    ブロック u32 圧縮後の大きさ（最上位ビットが 1 なら無圧縮）, データ
+
+最後以外のブロックは展開するとちょうどブロックの大きさになる．
+"""
+
+import argparse
+import struct
+import sys
+
+
+MAGIC = b'MKLZ'
+HEADER = struct.Struct('<4sIQ')
+BLOCK_HEADER = struct.Struct('<I')
+STORED_FLAG = 0x80000000
+
+MIN_MATCH = 4
+MAX_OFFSET = 65535
+# LZ4 の決まりで，ブロックの最後の 5 バイトはリテラルでなければならず，
+# 最後の一致は末尾から 12 バイトより前で始まらなければならない
+LAST_LITERALS = 5
+MF_LIMIT = 12
+
+
+def _write_length(out: bytearray, length: int):
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+
+def _emit(out: bytearray, literals: bytes, offset: int, match_len: int):
+    lit_len = len(literals)
+    token_lit = min(lit_len, 15)
+    token_match = 0 if offset == 0 else min(match_len - MIN_MATCH, 15)
+    out.append(token_lit << 4 | token_match)
+    if lit_len >= 15:
+        _write_length(out, lit_len - 15)
+    out += literals
+    if offset == 0:
+        return
+    out += struct.pack('<H', offset)
+    if match_len - MIN_MATCH >= 15:
+        _write_length(out, match_len - MIN_MATCH - 15)
+
+
+def compress_block(src: bytes) -> bytes:
+    n = len(src)
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+    limit = n - MF_LIMIT
+    while i < limit:
+        key = src[i:i + MIN_MATCH]
+        cand = table.get(key)
+        table[key] = i
+        if cand is None or i - cand > MAX_OFFSET:
+            i += 1
+            continue
+
+        # 0 が続く領域などで長くなるので，まとめて比べてから 1 バイトずつ詰める
+        m = MIN_MATCH
+        max_m = n - LAST_LITERALS - i
+        while m < max_m:
+            step = min(256, max_m - m)
+            if src[cand + m:cand + m + step] == src[i + m:i + m + step]:
+                m += step
+                continue
+            while m < max_m and src[cand + m] == src[i + m]:
+                m += 1
+            break
+
+        _emit(out, src[anchor:i], i - cand, m)
+        i += m
+        anchor = i
+
+    _emit(out, src[anchor:], 0, 0)
+    return bytes(out)
+
+
+def decompress_block(src: bytes, size: int) -> bytes:
+    out = bytearray()
+    ip = 0
+    while ip < len(src):
+        token = src[ip]
+        ip += 1
+        length = token >> 4
+        if length == 15:
+            while True:
+                b = src[ip]
+                ip += 1
+                length += b
+                if b != 255:
+                    break
+        out += src[ip:ip + length]
+        ip += length
+        if ip >= len(src):
+            break
+
+        offset = src[ip] | src[ip + 1] << 8
+        ip += 2
+        length = (token & 0xf) + MIN_MATCH
+        if token & 0xf == 15:
+            while True:
+                b = src[ip]
+                ip += 1
+                length += b
+                if b != 255:
+                    break
+        start = len(out) - offset
+        for k in range(length):
+            out.append(out[start + k])
+    if len(out) != size:
+        raise ValueError('broken block: {} != {}'.format(len(out), size))
+    return bytes(out)
+
+
+def compress(data: bytes, block_size: int) -> bytes:
+    chunks = [HEADER.pack(MAGIC, block_size, len(data))]
+    for begin in range(0, len(data), block_size):
+        block = data[begin:begin + block_size]
+        packed = compress_block(block)
+        if len(packed) >= len(block):
+            chunks.append(BLOCK_HEADER.pack(len(block) | STORED_FLAG))
+            chunks.append(block)
+        else:
+            chunks.append(BLOCK_HEADER.pack(len(packed)))
+            chunks.append(packed)
+    return b''.join(chunks)
+
+
+def decompress(data: bytes) -> bytes:
+    magic, block_size, size = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        raise ValueError('not a MKLZ file')
+    pos = HEADER.size
+    out = []
+    remain = size
+    while remain > 0:
+        header, = BLOCK_HEADER.unpack_from(data, pos)
+        pos += BLOCK_HEADER.size
+        packed_len = header & ~STORED_FLAG
+        block_len = min(block_size, remain)
+        packed = data[pos:pos + packed_len]
+        pos += packed_len
+        if header & STORED_FLAG:
+            out.append(packed)
+        else:
+            out.append(decompress_block(packed, block_len))
+        remain -= block_len
+    return b''.join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('input', help='path to an input file')
+    parser.add_argument('-o', help='path to an output file', required=True)
+    parser.add_argument('-d', help='decompress', action='store_true')
+    parser.add_argument('--block-size', help='bytes per block',
+                        type=int, default=64 * 1024)
+    ns = parser.parse_args()
+
+    with open(ns.input, 'rb') as f:
+        data = f.read()
+
+    if ns.d:
+        result = decompress(data)
+    else:
+        result = compress(data, ns.block_size)
+        # 書き出す前に展開して確かめる
+        if decompress(result) != data:
+            sys.exit('round trip failed')
+        print('{}: {} -> {} bytes'.format(ns.input, len(data), len(result)),
+              file=sys.stderr)
+
+    with open(ns.o, 'wb') as out:
+        out.write(result)
+
+
+if __name__ == '__main__':
+    main()
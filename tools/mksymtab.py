@@ -0,0 +1,126 @@
+#!/usr/bin/python3
+
+"""リンクした kernel.elf の関数シンボルを .ksymtab セクションに書き込む．
+
+nm -n で得たアドレス順の関数シンボルを，kernel/symbol.hpp の
+EmbeddedSymtabHeader / EmbeddedSymbol の形式に並べ，
+ファイル上の .ksymtab セクションの中身をその場で書き換える．
+セクションの大きさはカーネル側で決まっているので，ロード先の配置は変わらない．
+"""
+
+import argparse
+import os
+import re
+import struct
+import subprocess
+import sys
+
+
+SECTION = b'.ksymtab'
+HEADER = struct.Struct('<4sIII')
+ENTRY = struct.Struct('<QII')
+# nm -n -S の行．大きさの列はないことがあり，デマングルした名前は空白を含む
+NM_LINE = re.compile(
+    r'^([0-9a-fA-F]{8,}) (?:([0-9a-fA-F]{8,}) )?([A-Za-z]) (.*)$')
+
+
+def find_section(image: bytes, name: bytes):
+    """ELF64 のセクションヘッダから name のファイル上の位置と大きさを返す．"""
+    if image[:4] != b'\x7fELF' or image[4] != 2:
+        raise ValueError('not an ELF64 file')
+    e_shoff, = struct.unpack_from('<Q', image, 0x28)
+    e_shentsize, e_shnum, e_shstrndx = struct.unpack_from('<HHH', image, 0x3a)
+
+    def shdr(i):
+        # sh_name, sh_type, sh_flags, sh_addr, sh_offset, sh_size
+        return struct.unpack_from('<IIQQQQ', image, e_shoff + i * e_shentsize)
+
+    strtab_offset = shdr(e_shstrndx)[4]
+    for i in range(e_shnum):
+        sh_name, _, _, _, sh_offset, sh_size = shdr(i)
+        begin = strtab_offset + sh_name
+        if image[begin:image.index(b'\0', begin)] == name:
+            return sh_offset, sh_size
+    raise ValueError('no {} section'.format(name.decode()))
+
+
+def strip_arguments(name: str) -> str:
+    """"ns::Foo<int>::Bar(int, char) const" を "ns::Foo<int>::Bar" にする．"""
+    end = name.rfind(')')
+    if end < 0:
+        return name
+    depth = 0
+    for i in range(end, -1, -1):
+        if name[i] == ')':
+            depth += 1
+        elif name[i] == '(':
+            depth -= 1
+            if depth == 0:
+                return name[:i] if i > 0 else name
+    return name
+
+
+def load_symbols(nm: str, path: str):
+    out = subprocess.run([nm, '-n', '-S', '-C', '--defined-only', path],
+                         check=True, stdout=subprocess.PIPE,
+                         universal_newlines=True).stdout
+    symbols = []
+    for line in out.splitlines():
+        m = NM_LINE.match(line)
+        if not m:
+            continue
+        addr, size, kind, name = m.groups()
+        if kind not in ('T', 't', 'W', 'w'):
+            continue
+        addr = int(addr, 16)
+        if symbols and symbols[-1][0] == addr:
+            continue
+        symbols.append((addr, int(size or '0', 16), strip_arguments(name)))
+    return symbols
+
+
+def build(symbols, capacity: int) -> bytes:
+    strings = bytearray()
+    offsets = {}
+    entries = []
+    for addr, size, name in symbols:
+        if name not in offsets:
+            offsets[name] = len(strings)
+            strings += name.encode() + b'\0'
+        entries.append(ENTRY.pack(addr, min(size, 0xffffffff), offsets[name]))
+
+    strings_offset = HEADER.size + ENTRY.size * len(entries)
+    blob = (HEADER.pack(b'KSYM', len(entries), strings_offset, 0) +
+            b''.join(entries) + bytes(strings))
+    if len(blob) > capacity:
+        raise ValueError('symbol table needs {} bytes, but {} has {}; '
+                         'enlarge kEmbeddedSymtabBytes'.format(
+                             len(blob), SECTION.decode(), capacity))
+    return blob + bytes(capacity - len(blob))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('kernel', help='path to kernel.elf')
+    parser.add_argument('--nm', help='nm command',
+                        default=os.environ.get('NM', 'nm'))
+    ns = parser.parse_args()
+
+    with open(ns.kernel, 'rb') as f:
+        image = f.read()
+    offset, size = find_section(image, SECTION)
+    symbols = load_symbols(ns.nm, ns.kernel)
+    try:
+        blob = build(symbols, size)
+    except ValueError as e:
+        sys.exit(str(e))
+
+    with open(ns.kernel, 'r+b') as f:
+        f.seek(offset)
+        f.write(blob)
+    print('{}: {} symbols in {}'.format(ns.kernel, len(symbols),
+                                        SECTION.decode()), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()